@@ -0,0 +1,249 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+
+/* Generate a synthetic qrels file and trec_results run for benchmarking
+   trec_eval (see bench_trec_eval.c and 'make bench').
+
+   Each query retrieves depth documents.  A fraction (judged_frac) of the
+   retrieved documents is judged, and further unretrieved documents
+   (unret_frac times depth) are judged, each with a relevance grade drawn
+   from the grade distribution.  Docnos are "D" followed by a zero padded
+   number, docno_len characters in all; the ranks of a query's documents
+   are a random permutation of its docnos, so docno order and rank order
+   differ.
+
+   Everything generated for a query depends only on the seed and the
+   query's number, and the run does not depend on the judgements at all,
+   so files generated with the same seed and different judgement options
+   (eg -G) go with the same run.
+*/
+
+static char *usage = "Usage: bench_gen [-n num_queries] [-d depth] [-g grade_fractions]\n\
+       [-j judged_frac] [-u unret_frac] [-l docno_len] [-o qid_order]\n\
+       [-G num_jgs] [-s seed] qrels_file run_file\n\
+  -n num_queries     Number of queries (default 1000)\n\
+  -d depth           Documents retrieved per query (default 1000)\n\
+  -g grade_fractions Comma separated fractions of judged documents with\n\
+                     relevance 0, 1, 2, ... (default 0.7,0.2,0.1)\n\
+  -j judged_frac     Fraction of retrieved documents judged (default 0.5)\n\
+  -u unret_frac      Judged unretrieved documents per query, as a fraction\n\
+                     of depth (default 0.2)\n\
+  -l docno_len       Length of each docno (default 12)\n\
+  -o qid_order       'sorted': zero padded qids, in order in both files\n\
+                     (default).  'numeric': qids 1..num_queries unpadded, in\n\
+                     numeric (not string) order.  'shuffled': zero padded\n\
+                     qids, run queries in random order\n\
+  -G num_jgs         Judgement groups (second qrels field, for -R qrels_jg):\n\
+                     each group judges the same documents, drawing their\n\
+                     grades separately (default 1)\n\
+  -s seed            Random seed (default 1)\n";
+
+#define MAX_GRADES 20
+
+static double grade_cum[MAX_GRADES];    /* Cumulative grade fractions */
+static long num_grades;
+
+static uint64_t rand_state;
+
+static int get_grades (char *grade_fractions);
+static void rand_seed (uint64_t seed, uint64_t stream);
+static uint64_t rand_next ();
+static double rand_unif ();
+static long rand_grade ();
+
+int
+main (argc, argv)
+int argc;
+char *argv[];
+{
+    long num_queries = 1000;
+    long depth = 1000;
+    double judged_frac = 0.5;
+    double unret_frac = 0.2;
+    long docno_len = 12;
+    char *qid_order = "sorted";
+    long num_jgs = 1;
+    uint64_t seed = 1;
+    FILE *qrels_fd, *run_fd;
+    long *qid_perm, *doc_perm;
+    char *judged;
+    long num_docs, num_unret, qid_width;
+    long i, j, q, jg, tmp;
+    char qid[32];
+    int c;
+
+    if (UNDEF == get_grades ("0.7,0.2,0.1"))
+	exit (1);
+    while (-1 != (c = getopt (argc, argv, "n:d:g:j:u:l:o:G:s:"))) {
+	switch (c) {
+	case 'n': num_queries = atol (optarg); break;
+	case 'd': depth = atol (optarg); break;
+	case 'g':
+	    if (UNDEF == get_grades (optarg))
+		exit (1);
+	    break;
+	case 'j': judged_frac = atof (optarg); break;
+	case 'u': unret_frac = atof (optarg); break;
+	case 'l': docno_len = atol (optarg); break;
+	case 'o': qid_order = optarg; break;
+	case 'G': num_jgs = atol (optarg); break;
+	case 's': seed = (uint64_t) atol (optarg); break;
+	default:
+	    (void) fputs (usage, stderr);
+	    exit (1);
+	}
+    }
+    if (optind + 2 != argc || num_queries < 1 || depth < 1 ||
+	judged_frac < 0.0 || judged_frac > 1.0 || unret_frac < 0.0 ||
+	docno_len < 2 || num_jgs < 1 ||
+	(strcmp (qid_order, "sorted") && strcmp (qid_order, "numeric") &&
+	 strcmp (qid_order, "shuffled"))) {
+	(void) fputs (usage, stderr);
+	exit (1);
+    }
+
+    num_unret = (long) (unret_frac * depth + 0.5);
+    num_docs = depth + num_unret;
+    if (NULL == (qid_perm = Malloc (num_queries, long)) ||
+	NULL == (doc_perm = Malloc (num_docs, long)) ||
+	NULL == (judged = Malloc (num_docs, char)))
+	exit (3);
+    if (NULL == (qrels_fd = fopen (argv[optind], "w")) ||
+	NULL == (run_fd = fopen (argv[optind+1], "w"))) {
+	fprintf (stderr, "bench_gen: Cannot create output files\n");
+	exit (2);
+    }
+
+    /* Order in which queries are written to the run */
+    for (q = 0; q < num_queries; q++)
+	qid_perm[q] = q;
+    if (0 == strcmp (qid_order, "shuffled")) {
+	rand_seed (seed, 0);
+	for (q = num_queries - 1; q > 0; q--) {
+	    j = (long) (rand_next () % (uint64_t) (q + 1));
+	    tmp = qid_perm[q]; qid_perm[q] = qid_perm[j]; qid_perm[j] = tmp;
+	}
+    }
+    qid_width = 0;
+    if (strcmp (qid_order, "numeric"))
+	qid_width = (long) snprintf (qid, sizeof (qid), "%ld", num_queries);
+
+    for (i = 0; i < num_queries; i++) {
+	q = qid_perm[i];
+	(void) snprintf (qid, sizeof (qid), "%0*ld", (int) qid_width, q + 1);
+
+	/* Docnos of the query (doc_perm[r] retrieved at rank r, for r below
+	   depth) */
+	rand_seed (seed, (uint64_t) q + 1);
+	for (j = 0; j < num_docs; j++)
+	    doc_perm[j] = q * num_docs + j;
+	for (j = num_docs - 1; j > 0; j--) {
+	    long k = (long) (rand_next () % (uint64_t) (j + 1));
+	    tmp = doc_perm[j]; doc_perm[j] = doc_perm[k]; doc_perm[k] = tmp;
+	}
+	for (j = 0; j < depth; j++)
+	    fprintf (run_fd, "%s Q0 D%0*ld %ld %.4f bench\n",
+		     qid, (int) docno_len - 1, doc_perm[j], j + 1,
+		     (double) (depth - j));
+
+	/* Judgements, all drawn after the run so that it does not depend
+	   on them */
+	for (j = 0; j < num_docs; j++)
+	    judged[j] = j >= depth || rand_unif () < judged_frac;
+	for (jg = 0; jg < num_jgs; jg++) {
+	    for (j = 0; j < num_docs; j++) {
+		if (judged[j])
+		    fprintf (qrels_fd, "%s %ld D%0*ld %ld\n",
+			     qid, jg, (int) docno_len - 1, doc_perm[j],
+			     rand_grade ());
+	    }
+	}
+    }
+
+    if (0 != fclose (qrels_fd) || 0 != fclose (run_fd)) {
+	fprintf (stderr, "bench_gen: Cannot write output files\n");
+	exit (2);
+    }
+    Free (qid_perm);
+    Free (doc_perm);
+    Free (judged);
+    exit (0);
+}
+
+/* Set grade_cum from the comma separated grade_fractions (normalized to
+   sum to 1) */
+static int
+get_grades (char *grade_fractions)
+{
+    char *ptr = grade_fractions;
+    double sum = 0.0;
+    long i;
+
+    num_grades = 0;
+    while (*ptr) {
+	if (num_grades >= MAX_GRADES) {
+	    fprintf (stderr, "bench_gen: At most %d grades\n", MAX_GRADES);
+	    return (UNDEF);
+	}
+	sum += strtod (ptr, &ptr);
+	grade_cum[num_grades++] = sum;
+	if (*ptr == ',')
+	    ptr++;
+	else if (*ptr) {
+	    fprintf (stderr, "bench_gen: Illegal grade fractions '%s'\n",
+		     grade_fractions);
+	    return (UNDEF);
+	}
+    }
+    if (num_grades == 0 || sum <= 0.0) {
+	fprintf (stderr, "bench_gen: Illegal grade fractions '%s'\n",
+		 grade_fractions);
+	return (UNDEF);
+    }
+    for (i = 0; i < num_grades; i++)
+	grade_cum[i] /= sum;
+    return (1);
+}
+
+/* splitmix64, seeded separately for each stream (query) */
+static void
+rand_seed (uint64_t seed, uint64_t stream)
+{
+    rand_state = seed * 0x9e3779b97f4a7c15ULL ^ stream * 0xbf58476d1ce4e5b9ULL;
+}
+
+static uint64_t
+rand_next ()
+{
+    uint64_t z = (rand_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+/* Uniform in [0,1) */
+static double
+rand_unif ()
+{
+    return ((double) (rand_next () >> 11) / 9007199254740992.0);
+}
+
+static long
+rand_grade ()
+{
+    double u = rand_unif ();
+    long i;
+
+    for (i = 0; i < num_grades - 1; i++) {
+	if (u < grade_cum[i])
+	    break;
+    }
+    return (i);
+}
@@ -0,0 +1,457 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#include "trec_format.h"
+
+/* Microbenchmark of the calc_meas and acc_meas procedures of each measure
+   (see 'make bench_meas').
+
+   Synthetic queries are built in memory, as get_qrels and
+   get_trec_results would give them: each has num_rel relevant documents
+   (grades drawn from the grade distribution) and num_nonrel judged
+   nonrelevant documents, of which a fraction is retrieved at random ranks
+   among num_ret results, the rest of the results being unjudged.
+
+   Each measure is timed alone over all the queries, several passes.  For
+   each query the forms shared by most measures, RES_RELS and RANK_STATS,
+   are formed first (not timed against the measure, but reported on lines
+   of their own), so a measure's time is its own calculation and
+   accumulation, including any form only some measures use (eg the GAINS
+   of ndcg).  Allocations are counted by wrapping malloc, calloc and
+   realloc at link time (-Wl,--wrap).
+*/
+
+static char *usage = "Usage: bench_meas [-m measure] [-n num_queries] [-p passes]\n\
+       [-r num_ret] [-R num_rel] [-N num_nonrel] [-f ret_frac]\n\
+       [-g grade_fractions] [-s seed]\n\
+  -m measure         Measure or nickname timed (default all_trec); may be\n\
+                     repeated.  Measures of rel_info format 'qrels' only\n\
+  -n num_queries     Distinct queries (default 200)\n\
+  -p passes          Passes over the queries (default 20)\n\
+  -r num_ret         Documents retrieved per query (default 1000)\n\
+  -R num_rel         Relevant documents per query (default 50)\n\
+  -N num_nonrel      Judged nonrelevant documents per query (default 200)\n\
+  -f ret_frac        Fraction of judged documents retrieved (default 0.8)\n\
+  -g grade_fractions Comma separated fractions of relevant documents with\n\
+                     relevance 1, 2, ... (default 0.6,0.3,0.1)\n\
+  -s seed            Random seed (default 1)\n";
+
+extern int te_num_trec_measures;
+extern TREC_MEAS *te_trec_measures[];
+extern int te_num_trec_measure_nicknames;
+extern TREC_MEASURE_NICKNAMES te_trec_measure_nicknames[];
+extern int te_num_form_inter_procs;
+extern FORM_INTER_PROCS te_form_inter_procs[];
+
+#define MAX_GRADES 20
+
+typedef struct {
+    REL_INFO rel_info;
+    RESULTS results;
+    TEXT_QRELS_INFO qrels_info;
+    TEXT_RESULTS_INFO results_info;
+    char *docnos;               /* Storage of the docnos of the query */
+} BENCH_QUERY;
+
+/* Number of allocations made, counted by the malloc wrappers */
+static long num_allocs = 0;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t num, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+
+static double grade_cum[MAX_GRADES];
+static long num_grades;
+static uint64_t rand_state;
+
+static int make_query (BENCH_QUERY *query, long q, long num_ret,
+		       long num_rel, long num_nonrel, double ret_frac);
+static int mark_measures (char *name);
+static int get_grades (char *grade_fractions);
+static double now ();
+static uint64_t rand_next ();
+static double rand_unif ();
+
+int
+main (argc, argv)
+int argc;
+char *argv[];
+{
+    EPI epi;
+    BENCH_QUERY *queries;
+    TREC_EVAL accum_eval, q_eval;
+    RES_RELS res_rels;
+    RANK_STATS rank_stats;
+    long num_queries = 200;
+    long passes = 20;
+    long num_ret = 1000;
+    long num_rel = 50;
+    long num_nonrel = 200;
+    double ret_frac = 0.8;
+    long measure_marked = 0;
+    double overhead, t0, t1, form_secs, stats_secs, secs;
+    long allocs, form_allocs, stats_allocs, num_calls;
+    long i, m, p, q;
+    int c;
+
+    (void) memset (&epi, 0, sizeof (EPI));
+    epi.summary_flag = 1;
+    epi.relation_flag = 1;
+    epi.relevance_level = 1;
+    epi.max_num_docs_per_topic = MAXLONG;
+    epi.rel_info_format = "qrels";
+    epi.results_format = "trec_results";
+    epi.num_threads = 1;
+    epi.run_tag = "";
+    if (NULL == (epi.meas_arg = Malloc (1, MEAS_ARG)))
+	exit (3);
+    epi.meas_arg[0].measure_name = NULL;
+    rand_state = 1;
+    if (UNDEF == get_grades ("0.6,0.3,0.1"))
+	exit (1);
+
+    while (-1 != (c = getopt (argc, argv, "m:n:p:r:R:N:f:g:s:"))) {
+	switch (c) {
+	case 'm':
+	    if (UNDEF == mark_measures (optarg))
+		exit (1);
+	    measure_marked++;
+	    break;
+	case 'n': num_queries = atol (optarg); break;
+	case 'p': passes = atol (optarg); break;
+	case 'r': num_ret = atol (optarg); break;
+	case 'R': num_rel = atol (optarg); break;
+	case 'N': num_nonrel = atol (optarg); break;
+	case 'f': ret_frac = atof (optarg); break;
+	case 'g':
+	    if (UNDEF == get_grades (optarg))
+		exit (1);
+	    break;
+	case 's': rand_state = (uint64_t) atol (optarg); break;
+	default:
+	    (void) fputs (usage, stderr);
+	    exit (1);
+	}
+    }
+    if (optind != argc || num_queries < 1 || passes < 1 || num_ret < 1 ||
+	num_rel < 0 || num_nonrel < 0 || ret_frac < 0.0 || ret_frac > 1.0) {
+	(void) fputs (usage, stderr);
+	exit (1);
+    }
+    if (0 == measure_marked && UNDEF == mark_measures ("all_trec"))
+	exit (1);
+
+    if (NULL == (queries = Malloc (num_queries, BENCH_QUERY)))
+	exit (3);
+    for (q = 0; q < num_queries; q++) {
+	if (UNDEF == make_query (&queries[q], q, num_ret, num_rel,
+				 num_nonrel, ret_frac))
+	    exit (3);
+    }
+
+    accum_eval = (TREC_EVAL) {"all",  0, NULL, 0, 0};
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (MEASURE_MARKED(te_trec_measures[m]) &&
+	    UNDEF == te_trec_measures[m]->init_meas (&epi,
+						     te_trec_measures[m],
+						     &accum_eval)) {
+	    fprintf (stderr, "bench_meas: Cannot initialize measure '%s'\n",
+		     te_trec_measures[m]->name);
+	    exit (2);
+	}
+    }
+    if (NULL == (q_eval.values = Malloc (accum_eval.num_values,
+					 TREC_EVAL_VALUE)))
+	exit (3);
+    (void) memcpy (q_eval.values, accum_eval.values,
+		   accum_eval.num_values * sizeof (TREC_EVAL_VALUE));
+    q_eval.num_values = accum_eval.num_values;
+    q_eval.num_queries  = 0;
+
+    /* Cost of reading the clock around a call */
+    t0 = now ();
+    for (i = 0; i < 100000; i++)
+	t1 = now ();
+    overhead = (t1 - t0) / 100000;
+
+    printf ("bench_meas: %ld queries x %ld passes, num_ret %ld, num_rel %ld, num_nonrel %ld, ret_frac %.2f\n",
+	    num_queries, passes, num_ret, num_rel, num_nonrel, ret_frac);
+    printf ("%-28s %12s %13s\n", "measure", "ns/query", "allocs/query");
+    form_secs = stats_secs = 0.0;
+    form_allocs = stats_allocs = 0;
+    num_calls = 0;
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (! MEASURE_REQUESTED(te_trec_measures[m]))
+	    continue;
+	secs = 0.0;
+	allocs = 0;
+	for (p = 0; p < passes; p++) {
+	    for (q = 0; q < num_queries; q++) {
+		for (i = 0; i < q_eval.num_values; i++)
+		    q_eval.values[i].value = 0;
+		q_eval.qid = queries[q].results.qid;
+
+		num_allocs = 0;
+		t0 = now ();
+		if (UNDEF == te_form_res_rels (&epi, &queries[q].rel_info,
+					       &queries[q].results,
+					       &res_rels)) {
+		    fprintf (stderr, "bench_meas: Cannot form query\n");
+		    exit (4);
+		}
+		t1 = now ();
+		form_secs += t1 - t0 - overhead;
+		form_allocs += num_allocs;
+		num_allocs = 0;
+		t0 = now ();
+		if (UNDEF == te_form_rank_stats (&epi, &queries[q].rel_info,
+						 &queries[q].results,
+						 &rank_stats)) {
+		    fprintf (stderr, "bench_meas: Cannot form query\n");
+		    exit (4);
+		}
+		t1 = now ();
+		stats_secs += t1 - t0 - overhead;
+		stats_allocs += num_allocs;
+		num_calls++;
+
+		num_allocs = 0;
+		t0 = now ();
+		if (UNDEF == te_trec_measures[m]->calc_meas
+		    (&epi, &queries[q].rel_info, &queries[q].results,
+		     te_trec_measures[m], &q_eval) ||
+		    UNDEF == te_trec_measures[m]->acc_meas
+		    (&epi, te_trec_measures[m], &q_eval, &accum_eval)) {
+		    fprintf (stderr, "bench_meas: Can't calculate measure '%s'\n",
+			     te_trec_measures[m]->name);
+		    exit (4);
+		}
+		t1 = now ();
+		secs += t1 - t0 - overhead;
+		allocs += num_allocs;
+	    }
+	}
+	printf ("%-28s %12.1f %13.2f\n", te_trec_measures[m]->name,
+		secs * 1.0e9 / (passes * num_queries),
+		(double) allocs / (passes * num_queries));
+    }
+    if (num_calls > 0) {
+	printf ("%-28s %12.1f %13.2f\n", "(te_form_res_rels)",
+		form_secs * 1.0e9 / num_calls,
+		(double) form_allocs / num_calls);
+	printf ("%-28s %12.1f %13.2f\n", "(te_form_rank_stats)",
+		stats_secs * 1.0e9 / num_calls,
+		(double) stats_allocs / num_calls);
+    }
+
+    for (i = 0; i < te_num_form_inter_procs; i++) {
+	if (UNDEF == te_form_inter_procs[i].cleanup ())
+	    exit (10);
+    }
+    for (q = 0; q < num_queries; q++) {
+	Free (queries[q].qrels_info.text_qrels);
+	Free (queries[q].results_info.text_results);
+	Free (queries[q].docnos);
+	Free (queries[q].rel_info.qid);
+    }
+    Free (queries);
+    Free (q_eval.values);
+    Free (accum_eval.values);
+    Free (epi.meas_arg);
+    exit (0);
+}
+
+/* Build query q: judged docnos "J<q>.<j>" (docid j, in docno order),
+   unjudged "U<q>.<j>", retrieved in random order with decreasing sims */
+static int
+make_query (BENCH_QUERY *query, long q, long num_ret, long num_rel,
+	    long num_nonrel, double ret_frac)
+{
+    long num_judged = num_rel + num_nonrel;
+    long num_results, i, j, tmp, g;
+    long *ranks;
+    char *ptr;
+    double u;
+
+    if (NULL == (query->docnos = Malloc ((num_judged + num_ret) * 32,
+					 char)) ||
+	NULL == (query->rel_info.qid = Malloc (32, char)) ||
+	NULL == (query->qrels_info.text_qrels = Malloc (num_judged + 1,
+							TEXT_QRELS)) ||
+	NULL == (query->results_info.text_results = Malloc (num_ret,
+							     TEXT_RESULTS)) ||
+	NULL == (ranks = Malloc (num_judged + num_ret, long)))
+	return (UNDEF);
+    (void) snprintf (query->rel_info.qid, 32, "%ld", q + 1);
+    query->rel_info.rel_format = "qrels";
+    query->rel_info.q_rel_info = &query->qrels_info;
+    query->results.qid = query->rel_info.qid;
+    query->results.run_id = "bench";
+    query->results.ret_format = "trec_results";
+    query->results.q_results = &query->results_info;
+
+    /* Judgements, relevant ones at random positions */
+    ptr = query->docnos;
+    for (j = 0; j < num_judged; j++) {
+	query->qrels_info.text_qrels[j].docno = ptr;
+	ptr += 1 + sprintf (ptr, "J%ld.%09ld", q + 1, j);
+	query->qrels_info.text_qrels[j].docid = j;
+	query->qrels_info.text_qrels[j].rel = 0;
+    }
+    for (i = 0; i < num_rel; i++) {
+	do {
+	    j = (long) (rand_next () % (uint64_t) num_judged);
+	} while (query->qrels_info.text_qrels[j].rel);
+	u = rand_unif ();
+	for (g = 0; g < num_grades - 1 && u >= grade_cum[g]; g++)
+	    ;
+	query->qrels_info.text_qrels[j].rel = g + 1;
+    }
+    query->qrels_info.num_text_qrels = num_judged;
+    query->qrels_info.max_num_text_qrels = num_judged + 1;
+
+    /* Retrieved judged docs (ranks[i] >= 0), then unjudged (-1 - i) */
+    num_results = 0;
+    for (j = 0; j < num_judged && num_results < num_ret; j++) {
+	if (rand_unif () < ret_frac)
+	    ranks[num_results++] = j;
+    }
+    for (i = 0; num_results < num_ret; i++)
+	ranks[num_results++] = -1 - i;
+    for (i = num_results - 1; i > 0; i--) {
+	j = (long) (rand_next () % (uint64_t) (i + 1));
+	tmp = ranks[i]; ranks[i] = ranks[j]; ranks[j] = tmp;
+    }
+    for (i = 0; i < num_results; i++) {
+	TEXT_RESULTS *text_result = &query->results_info.text_results[i];
+	if (ranks[i] >= 0) {
+	    text_result->docno = query->qrels_info.text_qrels[ranks[i]].docno;
+	    text_result->docid = ranks[i];
+	}
+	else {
+	    text_result->docno = ptr;
+	    ptr += 1 + sprintf (ptr, "U%ld.%09ld", q + 1, -1 - ranks[i]);
+	    text_result->docid = DOCID_NONPOOL;
+	}
+	text_result->docno_len = strlen (text_result->docno);
+	text_result->sim = (double) (num_results - i);
+    }
+    query->results_info.num_text_results = num_results;
+    query->results_info.max_num_text_results = num_ret;
+    query->results_info.rank_ordered = 1;
+    Free (ranks);
+    return (1);
+}
+
+/* Mark measure name (or the measures of nickname name) to be timed */
+static int
+mark_measures (char *name)
+{
+    char **names;
+    long i, m;
+
+    for (i = 0; i < te_num_trec_measure_nicknames; i++) {
+	if (0 == strcmp (name, te_trec_measure_nicknames[i].name))
+	    break;
+    }
+    for (names = i < te_num_trec_measure_nicknames ?
+	     te_trec_measure_nicknames[i].name_list : &name;
+	 *names; names++) {
+	for (m = 0; m < te_num_trec_measures; m++) {
+	    if (0 == strcmp (*names, te_trec_measures[m]->name)) {
+		te_trec_measures[m]->eval_index = -2;
+		break;
+	    }
+	}
+	if (m >= te_num_trec_measures) {
+	    fprintf (stderr, "bench_meas: Unknown measure '%s'\n", *names);
+	    return (UNDEF);
+	}
+	if (names == &name)
+	    break;
+    }
+    return (1);
+}
+
+/* Set grade_cum from the comma separated grade_fractions */
+static int
+get_grades (char *grade_fractions)
+{
+    char *ptr = grade_fractions;
+    double sum = 0.0;
+    long i;
+
+    num_grades = 0;
+    while (*ptr && num_grades < MAX_GRADES) {
+	sum += strtod (ptr, &ptr);
+	grade_cum[num_grades++] = sum;
+	if (*ptr == ',')
+	    ptr++;
+	else if (*ptr)
+	    break;
+    }
+    if (*ptr || num_grades == 0 || sum <= 0.0) {
+	fprintf (stderr, "bench_meas: Illegal grade fractions '%s'\n",
+		 grade_fractions);
+	return (UNDEF);
+    }
+    for (i = 0; i < num_grades; i++)
+	grade_cum[i] /= sum;
+    return (1);
+}
+
+/* Seconds on a monotonic wall clock */
+static double
+now ()
+{
+    struct timespec ts;
+
+    (void) clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9);
+}
+
+/* splitmix64 */
+static uint64_t
+rand_next ()
+{
+    uint64_t z = (rand_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+static double
+rand_unif ()
+{
+    return ((double) (rand_next () >> 11) / 9007199254740992.0);
+}
+
+/* Allocation counting wrappers (linked with -Wl,--wrap=malloc etc) */
+void *
+__wrap_malloc (size_t size)
+{
+    num_allocs++;
+    return (__real_malloc (size));
+}
+
+void *
+__wrap_calloc (size_t num, size_t size)
+{
+    num_allocs++;
+    return (__real_calloc (num, size));
+}
+
+void *
+__wrap_realloc (void *ptr, size_t size)
+{
+    num_allocs++;
+    return (__real_realloc (ptr, size));
+}
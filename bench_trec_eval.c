@@ -0,0 +1,377 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#include "trec_format.h"
+
+/* Time the phases of a trec_eval evaluation of one measure set (see
+   'make bench', and bench_gen.c for generating input files).
+
+   The evaluation is that of
+       trec_eval [-q] -R <rel_format> -m <measures> rel_info_file results_file
+   (as given by the measure set, below) and its output is printed to
+   stdout as by trec_eval.  Queries are evaluated serially, and for each
+   query the intermediate form shared by the set's measures
+   (te_form_res_rels, te_form_res_rels_jg or form_prefs_pair_counts) is
+   formed before the measures are calculated, so that the form phase is
+   timed apart from the calc phase (measures then find the form cached).
+   Forms specific to some measures (eg the gains of ndcg) are timed as
+   part of calc.
+
+   Wall clock times of the phases are printed to stderr.
+*/
+
+static char *usage = "Usage: bench_trec_eval [-q] [-j num_threads] [-s measure_set]\n\
+       rel_info_file results_file\n\
+  -q              Print values of each query (timed as print phase)\n\
+  -j num_threads  Threads for loading rel_info_file and results_file\n\
+  -s measure_set  One of 'official' (default), 'all_trec', 'prefs'\n\
+                  (-R qrels_prefs -m all_prefs), 'qrels_jg' (-R qrels_jg)\n";
+
+extern int te_num_trec_measures;
+extern TREC_MEAS *te_trec_measures[];
+extern int te_num_trec_measure_nicknames;
+extern TREC_MEASURE_NICKNAMES te_trec_measure_nicknames[];
+extern int te_num_rel_info_format;
+extern REL_INFO_FILE_FORMAT te_rel_info_format[];
+extern int te_num_results_format;
+extern RESULTS_FILE_FORMAT te_results_format[];
+extern int te_num_form_inter_procs;
+extern FORM_INTER_PROCS te_form_inter_procs[];
+
+static int form_res_rels (const EPI *epi, const REL_INFO *rel_info,
+			  const RESULTS *results);
+static int form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
+			     const RESULTS *results);
+static int form_prefs (const EPI *epi, const REL_INFO *rel_info,
+		       const RESULTS *results);
+
+typedef struct {
+    char *name;
+    char *rel_info_format;
+    char *nickname;             /* Measures evaluated */
+    int (*form) (const EPI *epi, const REL_INFO *rel_info,
+		 const RESULTS *results);
+} MEASURE_SET;
+
+static MEASURE_SET measure_sets[] = {
+    {"official", "qrels", "official", form_res_rels},
+    {"all_trec", "qrels", "all_trec", form_res_rels},
+    {"prefs", "qrels_prefs", "all_prefs", form_prefs},
+    {"qrels_jg", "qrels_jg", "qrels_jg", form_res_rels_jg},
+};
+static int num_measure_sets = sizeof (measure_sets) / sizeof (measure_sets[0]);
+
+#define PHASE_LOAD_REL_INFO 0
+#define PHASE_LOAD_RESULTS 1
+#define PHASE_INIT 2
+#define PHASE_FORM 3
+#define PHASE_CALC 4
+#define PHASE_ACC 5
+#define PHASE_PRINT 6
+#define NUM_PHASES 7
+
+static char *phase_names[NUM_PHASES] = {
+    "load_rel_info", "load_results", "init", "form", "calc", "acc", "print"
+};
+static double phase_secs[NUM_PHASES];
+static double phase_start;
+
+static double now ();
+static void end_phase (int phase);
+static int mark_measures (char *nickname);
+
+int
+main (argc, argv)
+int argc;
+char *argv[];
+{
+    EPI epi;
+    MEASURE_SET *set = &measure_sets[0];
+    ALL_REL_INFO all_rel_info;
+    ALL_RESULTS all_results;
+    REL_INFO *rel_info_ptr;
+    RESULTS *results;
+    TREC_EVAL accum_eval, q_eval;
+    long num_rel_info_queries;
+    long i, m, r;
+    double total;
+    int c;
+
+    (void) memset (&epi, 0, sizeof (EPI));
+    epi.summary_flag = 1;
+    epi.relation_flag = 1;
+    epi.relevance_level = 1;
+    epi.max_num_docs_per_topic = MAXLONG;
+    epi.results_format = "trec_results";
+    epi.num_threads = 1;
+    epi.run_tag = "";
+    if (NULL == (epi.meas_arg = Malloc (1, MEAS_ARG)))
+	exit (3);
+    epi.meas_arg[0].measure_name = NULL;
+
+    while (-1 != (c = getopt (argc, argv, "qj:s:"))) {
+	switch (c) {
+	case 'q':
+	    epi.query_flag++;
+	    break;
+	case 'j':
+	    epi.num_threads = atol (optarg);
+	    break;
+	case 's':
+	    for (i = 0; i < num_measure_sets; i++) {
+		if (0 == strcmp (optarg, measure_sets[i].name))
+		    break;
+	    }
+	    if (i >= num_measure_sets) {
+		(void) fputs (usage, stderr);
+		exit (1);
+	    }
+	    set = &measure_sets[i];
+	    break;
+	default:
+	    (void) fputs (usage, stderr);
+	    exit (1);
+	}
+    }
+    if (optind + 2 != argc || epi.num_threads < 1) {
+	(void) fputs (usage, stderr);
+	exit (1);
+    }
+    epi.rel_info_format = set->rel_info_format;
+    if (UNDEF == mark_measures (set->nickname))
+	exit (1);
+
+    /* Load */
+    phase_start = now ();
+    for (i = 0; i < te_num_rel_info_format; i++) {
+	if (0 == strcmp (epi.rel_info_format, te_rel_info_format[i].name))
+	    break;
+    }
+    if (UNDEF == te_rel_info_format[i].get_file (&epi, argv[optind],
+						 &all_rel_info)) {
+	fprintf (stderr, "bench_trec_eval: Quit in file '%s'\n", argv[optind]);
+	exit (2);
+    }
+    num_rel_info_queries = all_rel_info.num_q_rels;
+    end_phase (PHASE_LOAD_REL_INFO);
+    for (r = 0; r < te_num_results_format; r++) {
+	if (0 == strcmp (epi.results_format, te_results_format[r].name))
+	    break;
+    }
+    if (UNDEF == te_results_format[r].get_file (&epi, argv[optind+1],
+						&all_results)) {
+	fprintf (stderr, "bench_trec_eval: Quit in file '%s'\n",
+		 argv[optind+1]);
+	exit (2);
+    }
+    end_phase (PHASE_LOAD_RESULTS);
+
+    /* Initialize measures, as in trec_eval */
+    accum_eval = (TREC_EVAL) {"all",  0, NULL, 0, 0};
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (MEASURE_MARKED(te_trec_measures[m]) &&
+	    UNDEF == te_trec_measures[m]->init_meas (&epi,
+						     te_trec_measures[m],
+						     &accum_eval)) {
+	    fprintf (stderr, "bench_trec_eval: Cannot initialize measure '%s'\n",
+		     te_trec_measures[m]->name);
+	    exit (2);
+	}
+    }
+    if (NULL == (q_eval.values = Malloc (accum_eval.num_values,
+					 TREC_EVAL_VALUE)))
+	exit (3);
+    (void) memcpy (q_eval.values, accum_eval.values,
+		   accum_eval.num_values * sizeof (TREC_EVAL_VALUE));
+    q_eval.num_values = accum_eval.num_values;
+    q_eval.num_queries  = 0;
+    end_phase (PHASE_INIT);
+
+    /* Evaluate each query */
+    for (i = 0; i < all_results.num_q_results; i++) {
+	results = &all_results.results[i];
+	if (MAP_OK != hashmap_get (all_rel_info.map, results->qid,
+				   (void **) &rel_info_ptr))
+	    continue;
+	for (m = 0; m < q_eval.num_values; m++)
+	    q_eval.values[m].value = 0;
+	q_eval.qid = results->qid;
+
+	phase_start = now ();
+	if (UNDEF == set->form (&epi, rel_info_ptr, results)) {
+	    fprintf (stderr, "bench_trec_eval: Cannot form query '%s'\n",
+		     results->qid);
+	    exit (4);
+	}
+	end_phase (PHASE_FORM);
+	for (m = 0; m < te_num_trec_measures; m++) {
+	    if (MEASURE_REQUESTED(te_trec_measures[m]) &&
+		UNDEF == te_trec_measures[m]->calc_meas (&epi, rel_info_ptr,
+							 results,
+							 te_trec_measures[m],
+							 &q_eval)) {
+		fprintf (stderr, "bench_trec_eval: Can't calculate measure '%s'\n",
+			 te_trec_measures[m]->name);
+		exit (4);
+	    }
+	}
+	end_phase (PHASE_CALC);
+	for (m = 0; m < te_num_trec_measures; m++) {
+	    if (MEASURE_REQUESTED(te_trec_measures[m]) &&
+		UNDEF == te_trec_measures[m]->acc_meas (&epi,
+							te_trec_measures[m],
+							&q_eval,
+							&accum_eval)) {
+		fprintf (stderr, "bench_trec_eval: Can't accumulate measure '%s'\n",
+			 te_trec_measures[m]->name);
+		exit (5);
+	    }
+	}
+	accum_eval.num_queries++;
+	end_phase (PHASE_ACC);
+	if (epi.query_flag) {
+	    for (m = 0; m < te_num_trec_measures; m++) {
+		if (MEASURE_REQUESTED(te_trec_measures[m]) &&
+		    UNDEF == te_trec_measures[m]->print_single_meas
+		    (&epi, te_trec_measures[m], &q_eval)) {
+		    fprintf (stderr, "bench_trec_eval: Can't print query measure '%s'\n",
+			     te_trec_measures[m]->name);
+		    exit (6);
+		}
+	    }
+	    end_phase (PHASE_PRINT);
+	}
+    }
+    if (accum_eval.num_queries == 0) {
+	fprintf (stderr, "bench_trec_eval: No queries with both results and relevance info\n");
+	exit (7);
+    }
+
+    /* Final averages and printing */
+    phase_start = now ();
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (MEASURE_REQUESTED(te_trec_measures[m]) &&
+	    (UNDEF == te_trec_measures[m]->calc_avg_meas (&epi,
+							  te_trec_measures[m],
+							  &all_rel_info,
+							  &accum_eval) ||
+	     UNDEF == te_trec_measures[m]->print_final_and_cleanup_meas
+	     (&epi, te_trec_measures[m], &accum_eval))) {
+	    fprintf (stderr, "bench_trec_eval: Can't print measure '%s'\n",
+		     te_trec_measures[m]->name);
+	    exit (8);
+	}
+    }
+    (void) fflush (stdout);
+    end_phase (PHASE_PRINT);
+
+    fprintf (stderr, "bench_trec_eval: measure set %s, %ld queries evaluated (%ld with rel_info, %ld with results)\n",
+	     set->name, accum_eval.num_queries, num_rel_info_queries,
+	     all_results.num_q_results);
+    fprintf (stderr, "%-14s %10s %12s\n", "phase", "seconds", "us/query");
+    total = 0.0;
+    for (i = 0; i < NUM_PHASES; i++) {
+	fprintf (stderr, "%-14s %10.3f %12.2f\n", phase_names[i],
+		 phase_secs[i],
+		 phase_secs[i] * 1.0e6 / accum_eval.num_queries);
+	total += phase_secs[i];
+    }
+    fprintf (stderr, "%-14s %10.3f %12.2f\n", "total", total,
+	     total * 1.0e6 / accum_eval.num_queries);
+
+    if (UNDEF == te_results_format[r].cleanup ())
+	exit (10);
+    for (i = 0; i < te_num_rel_info_format; i++) {
+	if (0 == strcmp (epi.rel_info_format, te_rel_info_format[i].name) &&
+	    UNDEF == te_rel_info_format[i].cleanup ())
+	    exit (10);
+    }
+    for (i = 0; i < te_num_form_inter_procs; i++) {
+	if (UNDEF == te_form_inter_procs[i].cleanup ())
+	    exit (10);
+    }
+    if (UNDEF == te_form_gains_tables_cleanup ())
+	exit (10);
+    Free (q_eval.values);
+    Free (accum_eval.values);
+    Free (epi.meas_arg);
+    exit (0);
+}
+
+static int
+form_res_rels (const EPI *epi, const REL_INFO *rel_info,
+	       const RESULTS *results)
+{
+    RES_RELS res_rels;
+    return (te_form_res_rels (epi, rel_info, results, &res_rels));
+}
+
+static int
+form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
+		  const RESULTS *results)
+{
+    RES_RELS_JG res_rels;
+    return (te_form_res_rels_jg (epi, rel_info, results, &res_rels));
+}
+
+static int
+form_prefs (const EPI *epi, const REL_INFO *rel_info, const RESULTS *results)
+{
+    RESULTS_PREFS results_prefs;
+    return (form_prefs_pair_counts (epi, rel_info, results, &results_prefs));
+}
+
+/* Seconds on a monotonic wall clock */
+static double
+now ()
+{
+    struct timespec ts;
+
+    (void) clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9);
+}
+
+/* Add the time since phase_start to phase, and start the next phase */
+static void
+end_phase (int phase)
+{
+    double t = now ();
+
+    phase_secs[phase] += t - phase_start;
+    phase_start = t;
+}
+
+/* Mark the measures of nickname (or the single measure nickname) to be
+   evaluated */
+static int
+mark_measures (char *nickname)
+{
+    char **name;
+    long i, m;
+
+    for (i = 0; i < te_num_trec_measure_nicknames; i++) {
+	if (0 == strcmp (nickname, te_trec_measure_nicknames[i].name))
+	    break;
+    }
+    if (i >= te_num_trec_measure_nicknames) {
+	fprintf (stderr, "bench_trec_eval: Unknown measures '%s'\n", nickname);
+	return (UNDEF);
+    }
+    for (name = te_trec_measure_nicknames[i].name_list; *name; name++) {
+	for (m = 0; m < te_num_trec_measures; m++) {
+	    if (0 == strcmp (*name, te_trec_measures[m]->name)) {
+		te_trec_measures[m]->eval_index = -2;
+		break;
+	    }
+	}
+    }
+    return (1);
+}
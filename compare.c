@@ -0,0 +1,453 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#include "hashmap.h"
+
+/* Paired significance tests between two runs (trec_eval --compare).
+
+   While the two runs are evaluated against the same rel_info, the value
+   of every measure for every query of each run is kept
+   (te_compare_add_query, after any zscore conversion).  te_compare_print
+   then pairs the queries evaluated in both runs and, for each value,
+   prints the means of both runs and of their difference d (run 2 minus
+   run 1), and the two-sided p-values of
+     - the paired t-test,
+     - the sign test (queries with d == 0 dropped),
+     - the paired randomization test: the sign of each d is flipped at
+       random num_permutations times, and p is the fraction of
+       permutations (counting the observed one) whose |sum d| is at least
+       the observed |sum d|.
+
+   The randomization test is the expensive one (permutations times
+   queries).  Queries are taken in groups of 8: the 256 sums of the
+   subsets of a group's d values are tabulated once per block of
+   PERM_BLOCK permutations, and each permutation then adds one table
+   entry per group, indexed by 8 of its random sign bits.  The sums of a
+   block stay in cache while all the groups are added in.  Blocks are
+   shared out to epi->num_threads threads.  The sign bits of a block and
+   group are a hash of their numbers, so p-values do not depend on the
+   number of threads.
+*/
+
+#define PERM_BLOCK 1024
+#define GROUP_SIZE 8
+#define PERM_SEED 0x2545f4914f6cdd1dULL
+
+/* The queries of a run, and their values (num_values per query, in the
+   order of the first run's values) */
+typedef struct {
+    char **qids;
+    double *values;
+    long num_queries;
+    long max_num_queries;
+    long max_num_values;
+} COMPARE_RUN;
+
+/* A thread's share of the randomization tests of all values */
+typedef struct {
+    const double *diffs;        /* num_values rows of num_groups * GROUP_SIZE
+				   d values, padded with 0 */
+    const double *observed;     /* For each value, |sum d| less rounding
+				   tolerance */
+    const double *totals;       /* For each value, sum d */
+    long num_values;
+    long num_groups;
+    long num_permutations;
+    long num_blocks;
+    volatile long *next_block;
+    long *counts;               /* For each value, permutations at least as
+				   extreme as observed */
+    double *sums;               /* PERM_BLOCK permutation sums */
+} PERM_THREAD;
+
+static COMPARE_RUN runs[2];
+static long current_run = -1;
+static char **value_names = NULL;
+static long num_values = 0;
+
+static int perm_thread (void *arg);
+static uint64_t perm_bits (const uint64_t block, const uint64_t group,
+			   const uint64_t word);
+static double t_test_p (const double t, const double df);
+static double sign_test_p (const long num_pos, const long num_neg);
+static double betai (const double a, const double b, const double x);
+static double betacf (const double a, const double b, const double x);
+static void free_runs ();
+
+/* Values of following te_compare_add_query calls belong to run (0 or
+   1) */
+void
+te_compare_start_run (const long run)
+{
+    current_run = run;
+}
+
+/* Keep the values of the evaluated query q_eval of the current run */
+int
+te_compare_add_query (const TREC_EVAL *q_eval)
+{
+    COMPARE_RUN *run;
+    long i;
+
+    if (current_run < 0 || current_run > 1)
+	return (1);
+    run = &runs[current_run];
+
+    if (NULL == value_names) {
+	/* Names are freed with the measures, after each run */
+	num_values = q_eval->num_values;
+	if (NULL == (value_names = Malloc (num_values, char *)))
+	    return (UNDEF);
+	for (i = 0; i < num_values; i++) {
+	    if (NULL == (value_names[i] =
+			 Malloc (strlen (q_eval->values[i].name) + 1, char)))
+		return (UNDEF);
+	    (void) strcpy (value_names[i], q_eval->values[i].name);
+	}
+    }
+    if (q_eval->num_values != num_values) {
+	fprintf (stderr, "trec_eval.compare: runs have different measure values\n");
+	return (UNDEF);
+    }
+
+    if (NULL == (run->qids = te_chk_and_realloc (run->qids,
+						 &run->max_num_queries,
+						 run->num_queries + 1,
+						 sizeof (char *))) ||
+	NULL == (run->values = te_chk_and_realloc (run->values,
+						   &run->max_num_values,
+						   (run->num_queries + 1) *
+						   num_values,
+						   sizeof (double))) ||
+	NULL == (run->qids[run->num_queries] =
+		 Malloc (strlen (q_eval->qid) + 1, char)))
+	return (UNDEF);
+    (void) strcpy (run->qids[run->num_queries], q_eval->qid);
+    for (i = 0; i < num_values; i++)
+	run->values[run->num_queries * num_values + i] =
+	    q_eval->values[i].value;
+    run->num_queries++;
+    return (1);
+}
+
+/* Pair the queries of the two runs, print the tests of each value to
+   stdout, and free everything kept */
+int
+te_compare_print (const EPI *epi)
+{
+    map_t qid_map;
+    any_t ptr;
+    long *pairs;                /* Query of run 0, of run 1, for each pair */
+    long num_pairs = 0;
+    long num_groups, row_len;
+    double *diffs, *totals, *observed;
+    long *counts;
+    PERM_THREAD *threads;
+    long num_threads;
+    volatile long next_block = 0;
+    long q, v, t;
+
+    if (NULL == (qid_map = hashmap_new_size (runs[0].num_queries)) ||
+	NULL == (pairs = Malloc (2 * (runs[1].num_queries + 1), long)))
+	return (UNDEF);
+    for (q = 0; q < runs[0].num_queries; q++) {
+	if (MAP_OMEM == hashmap_put (qid_map, runs[0].qids[q],
+				     (any_t) &runs[0].qids[q]))
+	    return (UNDEF);
+    }
+    for (q = 0; q < runs[1].num_queries; q++) {
+	if (MAP_OK == hashmap_get (qid_map, runs[1].qids[q], &ptr)) {
+	    pairs[2*num_pairs] = (char **) ptr - runs[0].qids;
+	    pairs[2*num_pairs+1] = q;
+	    num_pairs++;
+	}
+    }
+    hashmap_free (qid_map);
+    if (num_pairs == 0) {
+	fprintf (stderr, "trec_eval.compare: No queries evaluated in both runs\n");
+	return (UNDEF);
+    }
+
+    /* d values, a row per value, so that the randomization test of a
+       value reads them in order */
+    num_groups = (num_pairs + GROUP_SIZE - 1) / GROUP_SIZE;
+    row_len = num_groups * GROUP_SIZE;
+    if (NULL == (diffs = Malloc (num_values * row_len, double)) ||
+	NULL == (totals = Malloc (num_values, double)) ||
+	NULL == (observed = Malloc (num_values, double)) ||
+	NULL == (counts = Malloc (num_values, long)))
+	return (UNDEF);
+    for (v = 0; v < num_values; v++) {
+	double abs_sum = 0.0;
+	totals[v] = 0.0;
+	for (q = 0; q < row_len; q++) {
+	    double d = 0.0;
+	    if (q < num_pairs)
+		d = runs[1].values[pairs[2*q+1] * num_values + v] -
+		    runs[0].values[pairs[2*q] * num_values + v];
+	    diffs[v * row_len + q] = d;
+	    totals[v] += d;
+	    abs_sum += fabs (d);
+	}
+	/* Sums of the same d values added in another order may differ in
+	   the last bits */
+	observed[v] = fabs (totals[v]) - 1.0e-9 * abs_sum;
+	counts[v] = 0;
+    }
+
+    if (epi->num_permutations > 0) {
+	num_threads = MIN (epi->num_threads,
+			   (epi->num_permutations + PERM_BLOCK - 1) / PERM_BLOCK);
+	if (NULL == (threads = Malloc (num_threads, PERM_THREAD)))
+	    return (UNDEF);
+	for (t = 0; t < num_threads; t++) {
+	    threads[t].diffs = diffs;
+	    threads[t].observed = observed;
+	    threads[t].totals = totals;
+	    threads[t].num_values = num_values;
+	    threads[t].num_groups = num_groups;
+	    threads[t].num_permutations = epi->num_permutations;
+	    threads[t].num_blocks =
+		(epi->num_permutations + PERM_BLOCK - 1) / PERM_BLOCK;
+	    threads[t].next_block = &next_block;
+	    if (NULL == (threads[t].counts = Malloc (num_values, long)) ||
+		NULL == (threads[t].sums = Malloc (PERM_BLOCK, double)))
+		return (UNDEF);
+	    (void) memset (threads[t].counts, 0, num_values * sizeof (long));
+	}
+	if (UNDEF == te_run_threads (perm_thread, threads,
+				     sizeof (PERM_THREAD), num_threads))
+	    return (UNDEF);
+	for (t = 0; t < num_threads; t++) {
+	    for (v = 0; v < num_values; v++)
+		counts[v] += threads[t].counts[v];
+	    Free (threads[t].counts);
+	    Free (threads[t].sums);
+	}
+	Free (threads);
+    }
+
+    printf ("%-22s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n",
+	    "measure", "num_q", "mean_1", "mean_2", "diff", "t", "p_t",
+	    "sign+", "sign-", "p_sign", "p_rand");
+    for (v = 0; v < num_values; v++) {
+	double sum_1 = 0.0, sum_2 = 0.0, mean_d, ss = 0.0, t_stat, p_t;
+	long num_pos = 0, num_neg = 0;
+	const double *d = &diffs[v * row_len];
+
+	for (q = 0; q < num_pairs; q++) {
+	    sum_1 += runs[0].values[pairs[2*q] * num_values + v];
+	    sum_2 += runs[1].values[pairs[2*q+1] * num_values + v];
+	    if (d[q] > 0.0)
+		num_pos++;
+	    else if (d[q] < 0.0)
+		num_neg++;
+	}
+	mean_d = totals[v] / num_pairs;
+	for (q = 0; q < num_pairs; q++)
+	    ss += (d[q] - mean_d) * (d[q] - mean_d);
+
+	if (num_pairs < 2 || ss <= 0.0) {
+	    /* No variance: identical runs, or a constant difference */
+	    t_stat = 0.0;
+	    p_t = (num_pos + num_neg == 0) ? 1.0 : 0.0;
+	}
+	else {
+	    t_stat = mean_d / sqrt (ss / (num_pairs - 1) / num_pairs);
+	    p_t = t_test_p (t_stat, (double) (num_pairs - 1));
+	}
+
+	printf ("%-22s\t%ld\t%.4f\t%.4f\t%.4f\t%.4f\t%.4g\t%ld\t%ld\t%.4g\t",
+		value_names[v], num_pairs, sum_1 / num_pairs,
+		sum_2 / num_pairs, mean_d, t_stat, p_t, num_pos, num_neg,
+		sign_test_p (num_pos, num_neg));
+	if (epi->num_permutations > 0)
+	    printf ("%.4g\n", (double) (counts[v] + 1) /
+		    (double) (epi->num_permutations + 1));
+	else
+	    printf ("-\n");
+    }
+
+    Free (pairs);
+    Free (diffs);
+    Free (totals);
+    Free (observed);
+    Free (counts);
+    free_runs ();
+    return (1);
+}
+
+/* Take blocks of permutations until none are left, counting for each
+   value those whose |sum| reaches the observed one */
+static int
+perm_thread (void *arg)
+{
+    PERM_THREAD *pt = (PERM_THREAD *) arg;
+    double table[1 << GROUP_SIZE];
+    double *sums = pt->sums;
+    const double *d;
+    long block, num_perms, v, g, p, i, bit;
+    uint64_t w;
+
+    while ((block = te_atomic_next (pt->next_block)) < pt->num_blocks) {
+	num_perms = MIN (PERM_BLOCK,
+			 pt->num_permutations - block * PERM_BLOCK);
+	for (v = 0; v < pt->num_values; v++) {
+	    (void) memset (sums, 0, PERM_BLOCK * sizeof (double));
+	    for (g = 0; g < pt->num_groups; g++) {
+		/* table[s] is the sum of the d values of the group's
+		   queries in subset s */
+		d = &pt->diffs[(v * pt->num_groups + g) * GROUP_SIZE];
+		table[0] = 0.0;
+		for (bit = 0; bit < GROUP_SIZE; bit++) {
+		    for (i = 0; i < (1 << bit); i++)
+			table[(1 << bit) + i] = table[i] + d[bit];
+		}
+		/* Each 64 bit word gives the subsets of 8 permutations */
+		for (p = 0; p < PERM_BLOCK; p += 8) {
+		    w = perm_bits ((uint64_t) block, (uint64_t) g,
+				   (uint64_t) p / 8);
+		    sums[p]   += table[w & 0xff];
+		    sums[p+1] += table[(w >> 8) & 0xff];
+		    sums[p+2] += table[(w >> 16) & 0xff];
+		    sums[p+3] += table[(w >> 24) & 0xff];
+		    sums[p+4] += table[(w >> 32) & 0xff];
+		    sums[p+5] += table[(w >> 40) & 0xff];
+		    sums[p+6] += table[(w >> 48) & 0xff];
+		    sums[p+7] += table[(w >> 56) & 0xff];
+		}
+	    }
+	    /* Queries in the subset keep their sign, the others flip it */
+	    for (p = 0; p < num_perms; p++) {
+		if (fabs (2.0 * sums[p] - pt->totals[v]) >= pt->observed[v])
+		    pt->counts[v]++;
+	    }
+	}
+    }
+    return (1);
+}
+
+/* Random sign bits of word of (block, group): splitmix64 of the three
+   numbers, independent of the thread drawing them */
+static uint64_t
+perm_bits (const uint64_t block, const uint64_t group, const uint64_t word)
+{
+    uint64_t z = PERM_SEED ^ (block * 0x9e3779b97f4a7c15ULL) ^
+	(group * 0xbf58476d1ce4e5b9ULL) ^ (word * 0x94d049bb133111ebULL);
+
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31));
+}
+
+/* Two-sided p-value of Student's t with df degrees of freedom */
+static double
+t_test_p (const double t, const double df)
+{
+    return (betai (df / 2.0, 0.5, df / (df + t * t)));
+}
+
+/* Two-sided p-value of num_pos successes in num_pos + num_neg fair coin
+   flips */
+static double
+sign_test_p (const long num_pos, const long num_neg)
+{
+    long k = MIN (num_pos, num_neg);
+    long n = num_pos + num_neg;
+    double p;
+
+    if (n == 0 || k * 2 == n)
+	return (1.0);
+    /* P(X <= k) for X binomial (n, 1/2) */
+    p = 2.0 * betai ((double) (n - k), (double) (k + 1), 0.5);
+    return (MIN (p, 1.0));
+}
+
+/* Regularized incomplete beta function I_x(a,b) */
+static double
+betai (const double a, const double b, const double x)
+{
+    double front;
+
+    if (x <= 0.0)
+	return (0.0);
+    if (x >= 1.0)
+	return (1.0);
+    front = exp (lgamma (a + b) - lgamma (a) - lgamma (b) +
+		 a * log (x) + b * log (1.0 - x));
+    /* The continued fraction converges quickly only for x below
+       (a+1)/(a+b+2); use the symmetry I_x(a,b) = 1 - I_1-x(b,a) above */
+    if (x < (a + 1.0) / (a + b + 2.0))
+	return (front * betacf (a, b, x) / a);
+    return (1.0 - front * betacf (b, a, 1.0 - x) / b);
+}
+
+/* Continued fraction of the incomplete beta function (modified Lentz) */
+static double
+betacf (const double a, const double b, const double x)
+{
+    double c = 1.0, d, h, aa, del;
+    long m;
+
+    d = 1.0 - (a + b) * x / (a + 1.0);
+    if (fabs (d) < 1.0e-300)
+	d = 1.0e-300;
+    d = 1.0 / d;
+    h = d;
+    for (m = 1; m <= 300; m++) {
+	aa = m * (b - m) * x / ((a + 2*m - 1.0) * (a + 2*m));
+	d = 1.0 + aa * d;
+	if (fabs (d) < 1.0e-300)
+	    d = 1.0e-300;
+	c = 1.0 + aa / c;
+	if (fabs (c) < 1.0e-300)
+	    c = 1.0e-300;
+	d = 1.0 / d;
+	h *= d * c;
+	aa = -(a + m) * (a + b + m) * x / ((a + 2*m) * (a + 2*m + 1.0));
+	d = 1.0 + aa * d;
+	if (fabs (d) < 1.0e-300)
+	    d = 1.0e-300;
+	c = 1.0 + aa / c;
+	if (fabs (c) < 1.0e-300)
+	    c = 1.0e-300;
+	d = 1.0 / d;
+	del = d * c;
+	h *= del;
+	if (fabs (del - 1.0) < 1.0e-15)
+	    break;
+    }
+    return (h);
+}
+
+static void
+free_runs ()
+{
+    long r, q;
+
+    for (r = 0; r < 2; r++) {
+	for (q = 0; q < runs[r].num_queries; q++)
+	    Free (runs[r].qids[q]);
+	Free (runs[r].qids);
+	Free (runs[r].values);
+	runs[r].qids = NULL;
+	runs[r].values = NULL;
+	runs[r].num_queries = runs[r].max_num_queries = 0;
+	runs[r].max_num_values = 0;
+    }
+    for (q = 0; q < num_values; q++)
+	Free (value_names[q]);
+    Free (value_names);
+    value_names = NULL;
+    num_values = 0;
+    current_run = -1;
+}
@@ -0,0 +1,168 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#include "trec_format.h"
+
+/* Comparison procedures for docnos.
+   Docnos from the trec_results file are not NULL terminated; they are
+   (pointer, length) spans pointing directly into the read-only mapping
+   of the results file.  Docnos from rel_info files are ordinary NULL
+   terminated strings.  The orderings given here are identical to strcmp
+   on the equivalent NULL terminated strings (docnos contain no NULL
+   characters), so sorting and merging behave exactly as before.
+*/
+
+/* Compare two docno spans.  Returns <0, 0, >0 as strcmp would. */
+int
+te_docno_cmp (const char *docno1, const long len1,
+	      const char *docno2, const long len2)
+{
+    int cmp = memcmp (docno1, docno2, (size_t) MIN (len1, len2));
+    if (cmp)
+	return (cmp);
+    if (len1 < len2)
+	return (-1);
+    return (len1 > len2);
+}
+
+/* Compare NULL terminated str with a docno span.  Returns <0, 0, >0 as
+   strcmp (str, docno) would. */
+int
+te_docno_strcmp (const char *str, const char *docno, const long len)
+{
+    int cmp = strncmp (str, docno, (size_t) len);
+    if (cmp)
+	return (cmp);
+    return (str[len] != '\0');
+}
+
+/* Docno interning table.
+   Every distinct docno in the rel_info file is assigned a small integer
+   docid (0 .. num_docids-1) by the rel_info loader, which is read before
+   the results file.  The results loader then resolves each retrieved docno
+   to its docid (or DOCID_NONPOOL if the docno was never judged) once, so
+   that merging results with judgements is an integer lookup rather than a
+   per-query string merge.  Interned docnos are not copied; they must stay
+   valid until te_docno_intern_cleanup is called. */
+
+static map_t docid_map = NULL;
+static long num_docids = 0;
+
+/* Instead of being built by interning, the table may be attached from a
+   compiled qrels_bin file (see get_qrels_bin.c).  Lookups then probe the
+   file's own open addressing index, so nothing is hashed at load time.
+   te_docno_intern must not be used while a table is attached. */
+static long bin_num_docids = 0;
+static const long *bin_offsets = NULL;  /* docid -> offset of docno in
+					   bin_strtab */
+static const char *bin_strtab = NULL;
+static const long *bin_index = NULL;    /* Hash slot -> docid+1, 0 if empty.
+					   Linear probing */
+static long bin_index_size = 0;         /* Power of 2 */
+
+/* Return the docid of NULL terminated docno, assigning a new one if docno
+   has not been seen before.  UNDEF on error. */
+long
+te_docno_intern (char *docno)
+{
+    any_t value;
+
+    if (NULL == docid_map && NULL == (docid_map = hashmap_new ()))
+	return (UNDEF);
+    if (MAP_OK == hashmap_get (docid_map, docno, &value))
+	return ((long) (size_t) value);
+    if (MAP_OK != hashmap_put (docid_map, docno,
+			       (any_t) (size_t) num_docids))
+	return (UNDEF);
+    return (num_docids++);
+}
+
+/* Return the docid of the docno span, or DOCID_NONPOOL if it was never
+   interned.  Safe to call from several threads once interning is done. */
+long
+te_docno_lookup (const char *docno, const long len)
+{
+    any_t value;
+    unsigned long slot;
+    long docid;
+
+    if (bin_index) {
+	slot = te_docno_hash (docno, len) & (bin_index_size - 1);
+	while (bin_index[slot]) {
+	    docid = bin_index[slot] - 1;
+	    if (0 == te_docno_strcmp (bin_strtab + bin_offsets[docid],
+				      docno, len))
+		return (docid);
+	    slot = (slot + 1) & (bin_index_size - 1);
+	}
+	return (DOCID_NONPOOL);
+    }
+    if (NULL == docid_map ||
+	MAP_OK != hashmap_get_len (docid_map, docno, (int) len, &value))
+	return (DOCID_NONPOOL);
+    return ((long) (size_t) value);
+}
+
+long
+te_docno_num_docids ()
+{
+    if (bin_index)
+	return (bin_num_docids);
+    return (num_docids);
+}
+
+/* Hash of a docno span, as used by the qrels_bin docno index.  Stable
+   (32 bit FNV-1a, whatever the size of long), since compiled files store
+   slots computed with it; its width is recorded in their header. */
+uint32_t
+te_docno_hash (const char *docno, const long len)
+{
+    uint32_t hash = 2166136261U;
+    long i;
+
+    for (i = 0; i < len; i++) {
+	hash ^= (unsigned char) docno[i];
+	hash *= 16777619U;
+    }
+    return (hash);
+}
+
+/* Attach a docno table compiled into a qrels_bin file.  Docid i is the
+   NULL terminated string strtab + offsets[i]; index (index_size slots, a
+   power of 2) maps te_docno_hash of each docno, by linear probing, to its
+   docid + 1.  The arrays must stay valid until te_docno_intern_cleanup. */
+int
+te_docno_attach (const long num, const long *offsets, const char *strtab,
+		 const long *index, const long index_size)
+{
+    bin_num_docids = num;
+    bin_offsets = offsets;
+    bin_strtab = strtab;
+    bin_index = index;
+    bin_index_size = index_size;
+    return (1);
+}
+
+int
+te_docno_intern_cleanup ()
+{
+    if (docid_map != NULL) {
+	hashmap_free (docid_map);
+	docid_map = NULL;
+    }
+    num_docids = 0;
+    bin_num_docids = 0;
+    bin_offsets = NULL;
+    bin_strtab = NULL;
+    bin_index = NULL;
+    bin_index_size = 0;
+    return (1);
+}
@@ -0,0 +1,450 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "trec_format.h"
+#include "functions.h"
+
+/* Cache of the values of evaluated queries, kept in a file between
+   invocations (trec_eval --cache cache_file), so that when a run is
+   evaluated again after only some of its queries changed, only those are
+   calculated again.
+
+   A query's values are keyed by a 64 bit hash of its judgements (qid,
+   and the docno and relevance of each), and of its results (qid, and the
+   docno and sim of each, in input order).  The file is only used if it
+   was written for the same evaluation plan: a hash of the trec_eval
+   version, the options changing query values, and the names of all the
+   values calculated (which include measure parameters).  Otherwise it is
+   ignored and rewritten.  Only the qrels and trec_results formats (or
+   their bin forms) are cached; queries of other formats are always
+   calculated, as are all queries when debugging (-D).
+
+   The values cached are the raw values calculated for a query, before
+   any conversion to zscores.  Measures that keep per query state of their
+   own (runid, relstring) are calculated again even for cached queries.
+
+   te_eval_cache_get only reads the cache, so the threads evaluating
+   queries (-j) may use it at the same time.  te_eval_cache_put (after
+   each evaluated query, in results order) must be called by one thread.
+
+   The file written by te_eval_cache_close holds the entries of the
+   queries evaluated in this invocation, in order: a CACHE_HEADER,
+   followed for each entry by its key and num_values doubles.  Values are
+   stored in the native format and byte order.  It is written to a
+   temporary file first, then renamed, so concurrent invocations (eg
+   requests of a --server) never see a partly written file.
+   Invocations that write the same cache file at the same time are
+   serialized by an flock of "<cache_file>.lock".  While holding it, a
+   writer that finds the file was replaced since it was opened (by another
+   invocation) reads it again and also writes back all of its entries, so
+   neither loses the queries of the other.  On Windows there is no lock
+   and the last writer wins.
+*/
+
+#define CACHE_MAGIC "TECACHE1"
+
+typedef struct {
+    char magic[8];              /* CACHE_MAGIC (not NULL terminated) */
+    uint64_t plan;              /* Hash of the evaluation plan */
+    long num_values;            /* Values per entry */
+    long num_entries;
+} CACHE_HEADER;
+
+static char *cache_file = NULL;
+static struct stat cache_stat;  /* Of cache_file when opened, if it existed */
+static long cache_stat_valid = 0;
+static uint64_t cache_plan;
+static long cache_num_values = 0;
+static long num_entries = 0;
+static long max_entries = 0;
+static uint64_t *entry_keys;
+static double *entry_values;    /* num_values for each entry */
+static char *entry_used;        /* Set if entry is to be written */
+static long max_entry_values = 0;
+static long max_entry_used = 0;
+/* Open addressing index of entries (index + 1, 0 is empty) by key,
+   with linear probing.  Size is a power of 2, at least twice
+   num_entries */
+static long *index_slots;
+static long index_size = 0;
+
+static int read_entries (FILE *fd, const char *file, const long merge);
+static int add_entry (const uint64_t key);
+static long find_entry (const uint64_t key);
+static int build_index (const long new_size);
+static uint64_t hash_bytes (uint64_t hash, const void *bytes, long len);
+static uint64_t hash_long (uint64_t hash, long value);
+
+/* Load cache file (if it exists and matches the plan of epi and q_eval).
+   Called once the measures of the first run are initialized */
+int
+te_eval_cache_open (const EPI *epi, const char *file,
+		    const char *version_id, const TREC_EVAL *q_eval)
+{
+    FILE *fd;
+    long i;
+    int ret;
+
+    /* Keep the first run's plan for all runs */
+    if (cache_file)
+	return (1);
+    if (NULL == (cache_file = Malloc (strlen (file) + 1, char)))
+	return (UNDEF);
+    (void) strcpy (cache_file, file);
+
+    cache_plan = hash_bytes (0, version_id, strlen (version_id));
+    cache_plan = hash_bytes (cache_plan, epi->rel_info_format,
+			     strlen (epi->rel_info_format));
+    cache_plan = hash_bytes (cache_plan, epi->results_format,
+			     strlen (epi->results_format));
+    cache_plan = hash_long (cache_plan, epi->relevance_level);
+    cache_plan = hash_long (cache_plan, epi->judged_docs_only_flag);
+    cache_plan = hash_long (cache_plan, epi->num_docs_in_coll);
+    cache_plan = hash_long (cache_plan, epi->max_num_docs_per_topic);
+    cache_plan = hash_long (cache_plan, q_eval->num_values);
+    for (i = 0; i < q_eval->num_values; i++)
+	cache_plan = hash_bytes (cache_plan, q_eval->values[i].name,
+				 strlen (q_eval->values[i].name) + 1);
+    cache_num_values = q_eval->num_values;
+
+    if (NULL == (fd = fopen (file, "rb")))
+	/* No cache yet */
+	return (1);
+    cache_stat_valid = (0 == fstat (fileno (fd), &cache_stat));
+    ret = read_entries (fd, file, 0);
+    (void) fclose (fd);
+    return (ret);
+}
+
+/* Read the entries of the cache file open on fd (if it was written for
+   this plan).  Entries read when opening the cache are only written back
+   if used by this invocation.  Entries read when merging (from the file
+   another invocation wrote meanwhile) are all written back */
+static int
+read_entries (FILE *fd, const char *file, const long merge)
+{
+    CACHE_HEADER header;
+    uint64_t key;
+    long i, e, start;
+
+    if (1 != fread (&header, sizeof (CACHE_HEADER), 1, fd) ||
+	strncmp (header.magic, CACHE_MAGIC, 8) ||
+	header.plan != cache_plan ||
+	header.num_values != cache_num_values)
+	/* Written for another plan; start afresh */
+	return (1);
+    start = num_entries;
+    for (i = 0; i < header.num_entries; i++) {
+	if (NULL == (entry_values =
+		     te_chk_and_realloc (entry_values, &max_entry_values,
+					 (num_entries + 1) * cache_num_values,
+					 sizeof (double))))
+	    return (UNDEF);
+	if (1 != fread (&key, sizeof (uint64_t), 1, fd) ||
+	    cache_num_values != (long) fread (&entry_values[num_entries *
+							    cache_num_values],
+					      sizeof (double),
+					      cache_num_values, fd)) {
+	    fprintf (stderr, "trec_eval.eval_cache: Truncated cache file '%s' ignored\n",
+		     file);
+	    /* Drop the entries read from it (the last ones added) */
+	    num_entries = start;
+	    if (index_size > 0 && UNDEF == build_index (index_size))
+		return (UNDEF);
+	    break;
+	}
+	if (merge && -1 != (e = find_entry (key))) {
+	    entry_used[e] = 1;
+	    continue;
+	}
+	if (UNDEF == add_entry (key))
+	    return (UNDEF);
+	/* Only entries used by this invocation are written back */
+	entry_used[num_entries-1] = (char) merge;
+    }
+    return (1);
+}
+
+/* Find the key of the query given by rel_info and results.  If its values
+   are cached, copy them into q_eval and return 1; else return 0.  Returns
+   UNDEF if the query cannot be cached */
+int
+te_eval_cache_get (const EPI *epi, const REL_INFO *rel_info,
+		   const RESULTS *results, uint64_t *key, TREC_EVAL *q_eval)
+{
+    const TEXT_QRELS_INFO *trec_qrels;
+    const TEXT_RESULTS_INFO *text_results_info;
+    uint64_t hash;
+    long i, e;
+
+    if (NULL == cache_file || epi->debug_level > 0 ||
+	strcmp (rel_info->rel_format, "qrels") ||
+	strcmp (results->ret_format, "trec_results"))
+	return (UNDEF);
+    trec_qrels = (TEXT_QRELS_INFO *) rel_info->q_rel_info;
+    text_results_info = (TEXT_RESULTS_INFO *) results->q_results;
+
+    hash = hash_bytes (cache_plan, rel_info->qid, strlen (rel_info->qid) + 1);
+    hash = hash_long (hash, trec_qrels->num_text_qrels);
+    for (i = 0; i < trec_qrels->num_text_qrels; i++) {
+	hash = hash_bytes (hash, trec_qrels->text_qrels[i].docno,
+			   strlen (trec_qrels->text_qrels[i].docno) + 1);
+	hash = hash_long (hash, trec_qrels->text_qrels[i].rel);
+    }
+    hash = hash_bytes (hash, results->qid, strlen (results->qid) + 1);
+    hash = hash_long (hash, text_results_info->num_text_results);
+    for (i = 0; i < text_results_info->num_text_results; i++) {
+	hash = hash_long (hash, text_results_info->text_results[i].docno_len);
+	hash = hash_bytes (hash, text_results_info->text_results[i].docno,
+			   text_results_info->text_results[i].docno_len);
+	hash = hash_bytes (hash, &text_results_info->text_results[i].sim,
+			   sizeof (double));
+    }
+    *key = hash;
+
+    if (-1 == (e = find_entry (hash)))
+	return (0);
+    for (i = 0; i < cache_num_values; i++)
+	q_eval->values[i].value = entry_values[e * cache_num_values + i];
+    return (1);
+}
+
+/* Record that q_eval holds the values of the query with key, which is to
+   be kept in the cache */
+int
+te_eval_cache_put (const uint64_t key, const TREC_EVAL *q_eval)
+{
+    double *values;
+    long i, e;
+
+    if (-1 != (e = find_entry (key))) {
+	entry_used[e] = 1;
+	return (1);
+    }
+    if (NULL == (entry_values =
+		 te_chk_and_realloc (entry_values, &max_entry_values,
+				     (num_entries + 1) * cache_num_values,
+				     sizeof (double))))
+	return (UNDEF);
+    values = &entry_values[num_entries * cache_num_values];
+    for (i = 0; i < cache_num_values; i++)
+	values[i] = q_eval->values[i].value;
+    return (add_entry (key));
+}
+
+/* Write the cache file (if opened) and free the cache */
+int
+te_eval_cache_close ()
+{
+    FILE *fd;
+    CACHE_HEADER header;
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct stat new_stat;
+#endif
+    char *tmp_file;
+    long e;
+    int lock_fd = -1;
+    int ret = 1;
+
+    if (NULL == cache_file)
+	return (1);
+
+    if (NULL == (tmp_file = Malloc (strlen (cache_file) + 32, char)))
+	return (UNDEF);
+#if !defined(_WIN32) && !defined(_WIN64)
+    /* Merge the entries of the file if another invocation replaced it
+       since the cache was opened.  The lock is held until the new file is
+       renamed */
+    sprintf (tmp_file, "%s.lock", cache_file);
+    if (-1 == (lock_fd = open (tmp_file, O_RDWR | O_CREAT, 0666)) ||
+	-1 == flock (lock_fd, LOCK_EX)) {
+	fprintf (stderr, "trec_eval.eval_cache: Cannot lock cache file '%s'\n",
+		 tmp_file);
+	ret = UNDEF;
+    }
+    else if (NULL != (fd = fopen (cache_file, "rb"))) {
+	if (! cache_stat_valid ||
+	    0 != fstat (fileno (fd), &new_stat) ||
+	    new_stat.st_ino != cache_stat.st_ino ||
+	    new_stat.st_dev != cache_stat.st_dev ||
+	    new_stat.st_size != cache_stat.st_size ||
+	    new_stat.st_mtime != cache_stat.st_mtime)
+	    ret = read_entries (fd, cache_file, 1);
+	(void) fclose (fd);
+    }
+#endif
+
+    (void) memcpy (header.magic, CACHE_MAGIC, 8);
+    header.plan = cache_plan;
+    header.num_values = cache_num_values;
+    header.num_entries = 0;
+    for (e = 0; e < num_entries; e++)
+	header.num_entries += entry_used[e];
+
+    sprintf (tmp_file, "%s.%ld", cache_file, (long) getpid ());
+    fd = NULL;
+    if (ret == UNDEF ||
+	NULL == (fd = fopen (tmp_file, "wb")) ||
+	1 != fwrite (&header, sizeof (CACHE_HEADER), 1, fd))
+	ret = UNDEF;
+    for (e = 0; ret != UNDEF && e < num_entries; e++) {
+	if (entry_used[e] &&
+	    (1 != fwrite (&entry_keys[e], sizeof (uint64_t), 1, fd) ||
+	     cache_num_values != (long) fwrite (&entry_values[e *
+							      cache_num_values],
+						sizeof (double),
+						cache_num_values, fd)))
+	    ret = UNDEF;
+    }
+    if (fd && 0 != fclose (fd))
+	ret = UNDEF;
+#if defined(_WIN32) || defined(_WIN64)
+    /* rename does not replace an existing file on Windows */
+    if (ret != UNDEF)
+	(void) unlink (cache_file);
+#endif
+    if (ret != UNDEF && 0 != rename (tmp_file, cache_file))
+	ret = UNDEF;
+    if (ret == UNDEF) {
+	fprintf (stderr, "trec_eval.eval_cache: Cannot write cache file '%s'\n",
+		 cache_file);
+	(void) unlink (tmp_file);
+    }
+    if (-1 != lock_fd)
+	/* Also releases the lock */
+	(void) close (lock_fd);
+    Free (tmp_file);
+
+    Free (cache_file);
+    cache_file = NULL;
+    cache_stat_valid = 0;
+    if (max_entries > 0) {
+	Free (entry_keys);
+	max_entries = 0;
+    }
+    if (max_entry_values > 0) {
+	Free (entry_values);
+	max_entry_values = 0;
+    }
+    if (max_entry_used > 0) {
+	Free (entry_used);
+	max_entry_used = 0;
+    }
+    if (index_size > 0) {
+	Free (index_slots);
+	index_size = 0;
+    }
+    num_entries = 0;
+    return (ret);
+}
+
+/* Add the entry for key, whose values are already in place in
+   entry_values */
+static int
+add_entry (const uint64_t key)
+{
+    long slot;
+
+    if (NULL == (entry_keys =
+		 te_chk_and_realloc (entry_keys, &max_entries,
+				     num_entries + 1, sizeof (uint64_t))) ||
+	NULL == (entry_used =
+		 te_chk_and_realloc (entry_used, &max_entry_used,
+				     num_entries + 1, sizeof (char))))
+	return (UNDEF);
+    if (2 * (num_entries + 1) > index_size &&
+	UNDEF == build_index (index_size ? 2 * index_size : 1024))
+	return (UNDEF);
+    entry_keys[num_entries] = key;
+    entry_used[num_entries] = 1;
+    slot = (long) (key & (index_size - 1));
+    while (index_slots[slot])
+	slot = (slot + 1) & (index_size - 1);
+    index_slots[slot] = ++num_entries;
+    return (1);
+}
+
+static long
+find_entry (const uint64_t key)
+{
+    long slot;
+
+    if (0 == index_size)
+	return (-1);
+    slot = (long) (key & (index_size - 1));
+    while (index_slots[slot]) {
+	if (entry_keys[index_slots[slot] - 1] == key)
+	    return (index_slots[slot] - 1);
+	slot = (slot + 1) & (index_size - 1);
+    }
+    return (-1);
+}
+
+/* Index all entries in a new index of new_size slots */
+static int
+build_index (const long new_size)
+{
+    long e, slot;
+
+    if (index_size > 0)
+	Free (index_slots);
+    if (NULL == (index_slots = Malloc (new_size, long)))
+	return (UNDEF);
+    (void) memset (index_slots, 0, new_size * sizeof (long));
+    index_size = new_size;
+    for (e = 0; e < num_entries; e++) {
+	slot = (long) (entry_keys[e] & (index_size - 1));
+	while (index_slots[slot])
+	    slot = (slot + 1) & (index_size - 1);
+	index_slots[slot] = e + 1;
+    }
+    return (1);
+}
+
+/* Final mix of a 64 bit value (from MurmurHash3) */
+static uint64_t
+fmix (uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return (k);
+}
+
+/* Extend hash with len bytes, 8 at a time */
+static uint64_t
+hash_bytes (uint64_t hash, const void *bytes, long len)
+{
+    const char *ptr = (const char *) bytes;
+    uint64_t word;
+
+    hash = (hash ^ fmix ((uint64_t) len + 0x9e3779b97f4a7c15ULL)) *
+	0x87c37b91114253d5ULL;
+    while (len >= 8) {
+	(void) memcpy (&word, ptr, 8);
+	hash = (hash ^ fmix (word)) * 0x87c37b91114253d5ULL;
+	ptr += 8;
+	len -= 8;
+    }
+    if (len > 0) {
+	word = 0;
+	(void) memcpy (&word, ptr, (size_t) len);
+	hash = (hash ^ fmix (word)) * 0x87c37b91114253d5ULL;
+    }
+    return (fmix (hash));
+}
+
+static uint64_t
+hash_long (uint64_t hash, long value)
+{
+    return (hash_bytes (hash, &value, sizeof (long)));
+}
@@ -0,0 +1,445 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "trec_format.h"
+#include "functions.h"
+double log2(double x);
+
+/* Gain engine shared by the ndcg family of measures (ndcg, ndcg_p,
+   ndcg_rel, Rndcg, G, ndcg_cut, binG).
+
+   te_form_gains_init resolves the 'rel_level=gain' parameters of a
+   measure once, when the measure is initialized, into a table of the gain
+   of each relevance level kept in tm->meas_info (freed by
+   te_form_gains_release).  Levels not given a gain keep the default gain,
+   the level itself (0 for RELVALUE_NONPOOL and RELVALUE_UNJUDGED).
+   Measures that were not initialized that way (eg ndcg_cut) use the
+   default gains.  Measures with the same gains share a cache id.
+
+   te_form_gains extends the RES_RELS of a query with, under the gains of
+   a measure, the ideal ranking of the judged docs, the dcg at each rank of
+   both the ideal and the retrieved ranking, and the log2 rank discounts.
+   These are cached along with the query for each table, so however many
+   measures of the family are requested they are computed once per query,
+   and no space is allocated per query once the pools are large enough.
+
+   UNDEF returned if error, 0 if used cache values, 1 if new values.
+*/
+
+/* Gains of the relevance levels for a measure initialized with
+   te_form_gains_init.  A table only changes when its measure is
+   initialized or released, so te_form_gains reads it without locking */
+typedef struct {
+    TREC_MEAS *tm;
+    long id;                  /* Index of the cache for this table.  Tables
+				 with the same gains have the same id */
+    long num_levels;          /* Levels with a gain in level_gain */
+    double *level_gain;       /* level_gain[rel] for rel from
+				 RELVALUE_UNJUDGED through num_levels-1 */
+    double *level_gain_space; /* Malloc'd space level_gain points into */
+} GAIN_TABLE;
+
+/* All current tables, shared by all threads and evaluation contexts to
+   assign ids.  Only used under te_shared_lock.  A released slot is NULL */
+static GAIN_TABLE **gain_tables;
+static long num_gain_tables = 0;
+static long max_gain_tables = 0;
+
+/* Default gains (id 0).  Only the negative levels need an entry */
+static double default_level_gain[-RELVALUE_UNJUDGED] = {0.0, 0.0};
+static GAIN_TABLE default_gain_table =
+    {NULL, 0, 0, default_level_gain - RELVALUE_UNJUDGED, NULL};
+
+/* Cached GAINS of the current query for one table (one per id) */
+typedef struct {
+    long valid;
+    GAINS gains;
+    long *ideal_rel;
+    long max_ideal_rel;
+    double *ideal_gain;
+    long max_ideal_gain;
+    double *ideal_dcg;
+    long max_ideal_dcg;
+    double *results_dcg;
+    long max_results_dcg;
+} GAINS_CACHE;
+
+/* Current cached query (kept separately by each evaluation thread) */
+static TE_THREAD_LOCAL char *current_query = "no query";
+static TE_THREAD_LOCAL long max_current_query = 0;
+
+static TE_THREAD_LOCAL GAINS_CACHE *gains_cache;
+static TE_THREAD_LOCAL long max_gains_cache = 0;
+
+/* log2_rank[i] is log2 (i+2) for i < num_log2_rank */
+static TE_THREAD_LOCAL double *log2_rank;
+static TE_THREAD_LOCAL long max_log2_rank = 0;
+static TE_THREAD_LOCAL long num_log2_rank = 0;
+
+/* Relevance levels of the ideal ranking, by decreasing gain */
+static TE_THREAD_LOCAL long *level_order;
+static TE_THREAD_LOCAL long max_level_order = 0;
+
+static int same_gains (const GAIN_TABLE *table1, const GAIN_TABLE *table2);
+static int add_table (GAIN_TABLE *table, GAIN_TABLE *old_table);
+static void free_table (GAIN_TABLE *table);
+
+int
+te_form_gains_init (TREC_MEAS *tm)
+{
+    DOUBLE_PARAM_PAIR *pairs = NULL;
+    long num_pairs = 0;
+    GAIN_TABLE *table;
+    long i, level;
+    int ret;
+
+    if (tm->meas_params) {
+	pairs = (DOUBLE_PARAM_PAIR *) tm->meas_params->param_values;
+	num_pairs = tm->meas_params->num_params;
+    }
+
+    if (NULL == (table = Malloc (1, GAIN_TABLE)))
+	return (UNDEF);
+    table->tm = tm;
+    table->num_levels = 0;
+    for (i = 0; i < num_pairs; i++) {
+	level = atol (pairs[i].name);
+	if (level >= table->num_levels)
+	    table->num_levels = level + 1;
+    }
+    if (NULL == (table->level_gain_space =
+		 Malloc (table->num_levels - RELVALUE_UNJUDGED, double))) {
+	Free (table);
+	return (UNDEF);
+    }
+    table->level_gain = table->level_gain_space - RELVALUE_UNJUDGED;
+    for (level = RELVALUE_UNJUDGED; level < table->num_levels; level++)
+	table->level_gain[level] = level >= 0 ? (double) level : 0.0;
+    /* If a level is given more than once, the first gain given is used */
+    for (i = num_pairs - 1; i >= 0; i--) {
+	level = atol (pairs[i].name);
+	if (level >= RELVALUE_UNJUDGED)
+	    table->level_gain[level] = pairs[i].value;
+    }
+    /* Trailing levels with the default gain need not be in the table */
+    while (table->num_levels > 0 &&
+	   table->level_gain[table->num_levels-1] ==
+	   (double) (table->num_levels-1))
+	table->num_levels--;
+
+    /* Measures are initialized again for each of several runs; the new
+       table replaces the old table of tm */
+    te_shared_lock ();
+    ret = add_table (table, (GAIN_TABLE *) tm->meas_info);
+    te_shared_unlock ();
+    if (UNDEF == ret) {
+	free_table (table);
+	return (UNDEF);
+    }
+    if (tm->meas_info)
+	free_table ((GAIN_TABLE *) tm->meas_info);
+    tm->meas_info = table;
+    return (1);
+}
+
+/* Give table an id and put it in gain_tables in place of old_table (if
+   non-NULL), or else in the first free slot */
+static int
+add_table (GAIN_TABLE *table, GAIN_TABLE *old_table)
+{
+    long i, id;
+
+    /* Share the cache of another table with the same gains.  Otherwise
+       use the smallest id no other table has (ids of released tables may
+       still be shared by the tables that remain) */
+    table->id = 0;
+    if (! same_gains (table, &default_gain_table)) {
+	for (i = 0; i < num_gain_tables; i++) {
+	    if (gain_tables[i] != NULL && gain_tables[i] != old_table &&
+		same_gains (table, gain_tables[i])) {
+		table->id = gain_tables[i]->id;
+		break;
+	    }
+	}
+	for (id = 1; table->id == 0; id++) {
+	    for (i = 0; i < num_gain_tables; i++) {
+		if (gain_tables[i] != NULL && gain_tables[i] != old_table &&
+		    gain_tables[i]->id == id)
+		    break;
+	    }
+	    if (i == num_gain_tables)
+		table->id = id;
+	}
+    }
+
+    for (i = 0; i < num_gain_tables && gain_tables[i] != old_table; i++)
+	;
+    if (i == num_gain_tables) {
+	if (NULL == (gain_tables =
+		     te_chk_and_realloc (gain_tables, &max_gain_tables,
+					 num_gain_tables + 1,
+					 sizeof (GAIN_TABLE *))))
+	    return (UNDEF);
+	num_gain_tables++;
+    }
+    gain_tables[i] = table;
+    return (1);
+}
+
+static void
+free_table (GAIN_TABLE *table)
+{
+    Free (table->level_gain_space);
+    Free (table);
+}
+
+/* Free the gain table of tm (if any), whose measure is no longer used
+   (see libtrec_eval.h).  Its slot may be reused by a later measure */
+int
+te_form_gains_release (TREC_MEAS *tm)
+{
+    GAIN_TABLE *table = (GAIN_TABLE *) tm->meas_info;
+    long i;
+
+    if (NULL == table)
+	return (1);
+    te_shared_lock ();
+    for (i = 0; i < num_gain_tables; i++) {
+	if (gain_tables[i] == table) {
+	    gain_tables[i] = NULL;
+	    break;
+	}
+    }
+    te_shared_unlock ();
+    free_table (table);
+    tm->meas_info = NULL;
+    return (1);
+}
+
+int
+te_form_gains (const EPI *epi, const REL_INFO *rel_info,
+	       const RESULTS *results, const TREC_MEAS *tm, GAINS *gains)
+{
+    const GAIN_TABLE *table;
+    GAINS_CACHE *cache;
+    GAINS *cg;
+    RES_RELS *rr;
+    long i, j, level, num_levels;
+    long num_order, max_rank;
+    double gain;
+
+    if (0 != strcmp (current_query, results->qid)) {
+	/* New query.  Make sure enough space for query and save copy */
+	i = strlen(results->qid)+1;
+	if (NULL == (current_query =
+		     te_chk_and_malloc (current_query, &max_current_query,
+					i, sizeof (char))))
+	    return (UNDEF);
+	(void) strncpy (current_query, results->qid, i);
+	for (i = 0; i < max_gains_cache; i++)
+	    gains_cache[i].valid = 0;
+    }
+
+    if (NULL == (table = (const GAIN_TABLE *) tm->meas_info))
+	table = &default_gain_table;
+
+    /* Make sure there is a cache for the table (new caches zeroed) */
+    if (table->id >= max_gains_cache) {
+	long old_max = max_gains_cache;
+	if (NULL == (gains_cache =
+		     te_chk_and_realloc (gains_cache, &max_gains_cache,
+					 table->id + 1,
+					 sizeof (GAINS_CACHE))))
+	    return (UNDEF);
+	(void) memset (&gains_cache[old_max], 0,
+		       (max_gains_cache - old_max) * sizeof (GAINS_CACHE));
+    }
+    cache = &gains_cache[table->id];
+    cg = &cache->gains;
+    rr = &cg->res_rels;
+
+    if (UNDEF == te_form_res_rels (epi, rel_info, results, rr))
+	return (UNDEF);
+    if (cache->valid) {
+	*gains = *cg;
+	return (0);
+    }
+
+    cg->level_gain = table->level_gain;
+    cg->num_gain_levels = table->num_levels;
+
+    /* Order the judged levels with positive gain by decreasing gain (ties
+       by decreasing level).  There are few levels, so insertion sort */
+    num_levels = rr->num_rel_levels;
+    if (NULL == (level_order =
+		 te_chk_and_malloc (level_order, &max_level_order,
+				    num_levels + 1, sizeof (long))))
+	return (UNDEF);
+    num_order = 0;
+    cg->num_ideal = 0;
+    for (level = 0; level < num_levels; level++) {
+	gain = TE_GAIN (cg, level);
+	if (0 == rr->rel_levels[level] || gain <= 0.0)
+	    continue;
+	for (j = num_order;
+	     j > 0 && TE_GAIN (cg, level_order[j-1]) <= gain;
+	     j--)
+	    level_order[j] = level_order[j-1];
+	level_order[j] = level;
+	num_order++;
+	cg->num_ideal += rr->rel_levels[level];
+    }
+
+    /* Extend the discounts to cover both rankings */
+    max_rank = MAX (rr->num_ret, cg->num_ideal) + 1;
+    if (max_rank > num_log2_rank) {
+	if (NULL == (log2_rank =
+		     te_chk_and_realloc (log2_rank, &max_log2_rank,
+					 max_rank, sizeof (double))))
+	    return (UNDEF);
+	for (i = num_log2_rank; i < max_log2_rank; i++)
+	    log2_rank[i] = log2 ((double) (i+2));
+	num_log2_rank = max_log2_rank;
+    }
+    cg->log2_rank = log2_rank;
+
+    if (NULL == (cache->ideal_rel =
+		 te_chk_and_malloc (cache->ideal_rel, &cache->max_ideal_rel,
+				    cg->num_ideal + 1, sizeof (long))) ||
+	NULL == (cache->ideal_gain =
+		 te_chk_and_malloc (cache->ideal_gain, &cache->max_ideal_gain,
+				    cg->num_ideal + 1, sizeof (double))) ||
+	NULL == (cache->ideal_dcg =
+		 te_chk_and_malloc (cache->ideal_dcg, &cache->max_ideal_dcg,
+				    cg->num_ideal + 1, sizeof (double))) ||
+	NULL == (cache->results_dcg =
+		 te_chk_and_malloc (cache->results_dcg,
+				    &cache->max_results_dcg,
+				    rr->num_ret + 1, sizeof (double))))
+	return (UNDEF);
+    cg->ideal_rel = cache->ideal_rel;
+    cg->ideal_gain = cache->ideal_gain;
+    cg->ideal_dcg = cache->ideal_dcg;
+    cg->results_dcg = cache->results_dcg;
+
+    /* Ideal ranking and its dcg.  Note: rank i+1 discounted by log2(i+2) */
+    i = 0;
+    cg->ideal_dcg[0] = 0.0;
+    for (j = 0; j < num_order; j++) {
+	level = level_order[j];
+	gain = TE_GAIN (cg, level);
+	for (num_levels = rr->rel_levels[level]; num_levels > 0; num_levels--){
+	    cg->ideal_rel[i] = level;
+	    cg->ideal_gain[i] = gain;
+	    cg->ideal_dcg[i+1] = cg->ideal_dcg[i] + gain / log2_rank[i];
+	    i++;
+	}
+    }
+
+    /* dcg of the retrieved ranking */
+    cg->results_dcg[0] = 0.0;
+    for (i = 0; i < rr->num_ret; i++) {
+	gain = TE_GAIN (cg, rr->results_rel_list[i]);
+	if (gain != 0.0)
+	    cg->results_dcg[i+1] = cg->results_dcg[i] + gain / log2_rank[i];
+	else
+	    cg->results_dcg[i+1] = cg->results_dcg[i];
+    }
+
+    cache->valid = 1;
+    *gains = *cg;
+    return (1);
+}
+
+static int
+same_gains (const GAIN_TABLE *table1, const GAIN_TABLE *table2)
+{
+    long level;
+
+    if (table1->num_levels != table2->num_levels)
+	return (0);
+    for (level = RELVALUE_UNJUDGED; level < table1->num_levels; level++) {
+	if (table1->level_gain[level] != table2->level_gain[level])
+	    return (0);
+    }
+    return (1);
+}
+
+/* Forget the query cached, keeping the space formed for the next query */
+int
+te_form_gains_reset ()
+{
+    long i;
+
+    if (max_current_query > 0) {
+	Free (current_query);
+	max_current_query = 0;
+	current_query = "no_query";
+    }
+    for (i = 0; i < max_gains_cache; i++)
+	gains_cache[i].valid = 0;
+    return (1);
+}
+
+int
+te_form_gains_cleanup ()
+{
+    long i;
+
+    if (max_current_query > 0) {
+	Free (current_query);
+	max_current_query = 0;
+	current_query = "no_query";
+    }
+    for (i = 0; i < max_gains_cache; i++) {
+	if (gains_cache[i].max_ideal_rel > 0)
+	    Free (gains_cache[i].ideal_rel);
+	if (gains_cache[i].max_ideal_gain > 0)
+	    Free (gains_cache[i].ideal_gain);
+	if (gains_cache[i].max_ideal_dcg > 0)
+	    Free (gains_cache[i].ideal_dcg);
+	if (gains_cache[i].max_results_dcg > 0)
+	    Free (gains_cache[i].results_dcg);
+    }
+    if (max_gains_cache > 0) {
+	Free (gains_cache);
+	max_gains_cache = 0;
+    }
+    if (max_log2_rank > 0) {
+	Free (log2_rank);
+	max_log2_rank = 0;
+	num_log2_rank = 0;
+    }
+    if (max_level_order > 0) {
+	Free (level_order);
+	max_level_order = 0;
+    }
+    return (1);
+}
+
+/* Free the gain tables of the measures.  Only called once evaluation
+   is finished (unlike te_form_gains_cleanup, called by every thread) */
+int
+te_form_gains_tables_cleanup ()
+{
+    long i;
+
+    for (i = 0; i < num_gain_tables; i++) {
+	if (gain_tables[i] != NULL) {
+	    gain_tables[i]->tm->meas_info = NULL;
+	    free_table (gain_tables[i]);
+	}
+    }
+    if (max_gain_tables > 0) {
+	Free (gain_tables);
+	max_gain_tables = 0;
+    }
+    num_gain_tables = 0;
+    return (1);
+}
@@ -39,8 +39,10 @@ Three part process here:
    judgments are added - this happens when (doc A > doc B in JSG jsg1) and
    (doc B > doc C in JSG jsg2).  Note that a JG represents a single information
    need set of judgments, and is required to be consistent (inconsistent
-   preferences are represented in different JGs).  Preference array is of
-   size num_judged * num_judged.
+   preferences are represented in different JGs).  Preference array is a
+   bit array of size num_judged * num_judged, with each row packed into
+   64 bit words, so the transitive closure (Warshall's algorithm) or's
+   whole rows together a word at a time.
 3. Go through the preference in each JG, and count num_fulfilled and 
    num_possible preferences in categories "retrieved", "implied" and
    "not_retrieved" where
@@ -58,6 +60,11 @@ Three part process here:
    If rank1 retrieved and rank2 was not, then implied pref fulfilled.
    If rank1 not retrieved and rank2 was, then preference was not fulfilled.
    If both not retrieved, then that count is incremented.
+   Rather than comparing every pair, the last three counts are products of
+   the numbers of retrieved and not retrieved docs in the ECs.  The
+   unfulfilled prefs with both retrieved are the inversions in the list of
+   retrieved ranks of all ECs in rel_level order (each EC sorted by rank),
+   counted while merge sorting the list, in time O(n log (num ECs)).
   B. Given preference array PA there are five areas of importance, divided
    by lines i == NJR (where NJR is num_judged_ret), j == NJR, and i == j
                        NJR
@@ -79,14 +86,20 @@ Three part process here:
     Area A3 is preference implied fulfilled (i retrieved, j not)
     Area A4 is preference implied not fulfilled (i not retrieved, j retrieved)
     Area A5 is both i and j not retrieved.
-    Simply count the marks (PA[i][j] == 1) in each appropriate area.
+    Simply count the marks (PA[i][j] == 1) in each appropriate area, a word
+    of each row at a time.
 
     As well as storing counts within each JG, a counts array for the
-    entire pref_results is constructed. Counts_array CA is exactly the same 
-    format and size as the preference arrays, except CA[i][j] is the sum
+    entire pref_results is constructed. Counts_array CA is conceptually the
+    same size as the preference arrays, except CA[i][j] is the sum
     of the conceptual PA[i][j] over all JGs.  This allows counts of
     confirmations (CA[i][j] > 1) and conflicts (CA[i][j] and CA[j][i] both
-    non-zero).
+    non-zero).  Only the doc pairs with some preference are stored: the
+    counts are kept in a hash table keyed by doc pair while the JGs are
+    gone through, and then radix sorted into a list of pairs ordered by
+    docid_rank.  Since this takes time proportional to the number of
+    preferences (quadratic in the size of ECs), it is only done when asked
+    for by form_prefs_pair_counts.
 
     Not mentioned in steps 2 and 3 above since it adds even more confusion,
     is that the relevant (rel_level > 0.0) and nonrelevant docs are also
@@ -104,6 +117,7 @@ Three part process here:
 
 typedef struct {
     char *docno;
+    long docno_len;
     double sim;
     long rank;
 } DOCNO_RESULTS;
@@ -121,13 +135,17 @@ static int form_jg_ec (const PREFS_AND_RANKS *prefs, const long num_prefs,
 		       long *rank_pool_ptr, JG *jg,
 		       RESULTS_PREFS *results_prefs);
 static int add_ec_pref_to_jg (JG *jg, RESULTS_PREFS *results_prefs);
+static long count_inversions (long *ranks, long *temp, long *bounds,
+			      long num_runs);
 
 static int form_jg_pa (const PREFS_AND_RANKS *prefs, const long num_prefs,
 		       JG *jg, RESULTS_PREFS *results_prefs);
 static int add_transitives (PREFS_ARRAY *pa);
 static int add_pa_pref_to_jg (JG *jg, RESULTS_PREFS *results_prefs);
-static int mult_and_check_change (const PREFS_ARRAY *a1, const PREFS_ARRAY *a2,
-				  PREFS_ARRAY *res);
+static long count_pa_row (const uint64_t *row, long start, long end);
+static int reserve_pair_counts (long num_new_prefs);
+static void add_pair_count (long i, long j);
+static int sort_pair_counts (void);
 
 static int form_prefs_and_ranks (const EPI*epi,
 				 const TEXT_RESULTS_INFO *text_results_info,
@@ -136,7 +154,6 @@ static int form_prefs_and_ranks (const EPI*epi,
 				 long *num_judged, long *num_judged_ret);
 
 static void init_prefs_array (PREFS_ARRAY *pa);
-static void init_counts_array (COUNTS_ARRAY *ca);
 static int comp_prefs_and_ranks_jg_rel_level ();
 static int comp_prefs_and_ranks_docno();
 static int comp_sim_docno (), comp_docno (), comp_results_inc_rank ();
@@ -154,41 +171,49 @@ static void debug_print_prefs_and_ranks (PREFS_AND_RANKS *par, long num_prefs,
    thus effects on caching) */
  /* Temp Structure for mapping results docno to results rank */
 
-/* Current cached query */
-static char *current_query = "no query";
-static long max_current_query = 0;
+/* Current cached query (kept separately by each evaluation thread) */
+static TE_THREAD_LOCAL char *current_query = "no query";
+static TE_THREAD_LOCAL long max_current_query = 0;
 
 /* Space reserved for cached returned values */
-static long num_judged_ret;
-static long num_judged;
-static long num_jgs;
-static JG *jgs;
-static long max_num_jgs = 0;
-static long *rank_pool;
-static long max_rank_pool = 0;
-static EC *ec_pool;
-static long max_ec_pool = 0;
-static unsigned short *ca_pool;      
-static long max_ca_pool = 0;
-static unsigned short **ca_ptr_pool; 
-static long max_ca_ptr_pool = 0;
-static unsigned char *pa_pool;
-static long max_pa_pool = 0;
-static unsigned char **pa_ptr_pool;
-static long max_pa_ptr_pool = 0;
-static double *rel_pool;
-static long max_rel_pool = 0;
+static TE_THREAD_LOCAL long num_judged_ret;
+static TE_THREAD_LOCAL long num_judged;
+static TE_THREAD_LOCAL long num_jgs;
+static TE_THREAD_LOCAL JG *jgs;
+static TE_THREAD_LOCAL long max_num_jgs = 0;
+static TE_THREAD_LOCAL long *rank_pool;
+static TE_THREAD_LOCAL long max_rank_pool = 0;
+static TE_THREAD_LOCAL EC *ec_pool;
+static TE_THREAD_LOCAL long max_ec_pool = 0;
+static TE_THREAD_LOCAL PAIR_COUNTS *pair_pool;    /* Hash table of pair counts
+						     (open addressing), then
+						     sorted pair counts */
+static TE_THREAD_LOCAL long max_pair_pool = 0;
+static TE_THREAD_LOCAL long pair_table_size;       /* Power of 2 */
+static TE_THREAD_LOCAL long num_pairs;
+static TE_THREAD_LOCAL int pair_counts_formed;     /* For current query */
+static TE_THREAD_LOCAL uint64_t *pa_pool;
+static TE_THREAD_LOCAL long max_pa_pool = 0;
+static TE_THREAD_LOCAL uint64_t **pa_ptr_pool;
+static TE_THREAD_LOCAL long max_pa_ptr_pool = 0;
+static TE_THREAD_LOCAL double *rel_pool;
+static TE_THREAD_LOCAL long max_rel_pool = 0;
 /* Space reserved for intermediate values */
-static PREFS_AND_RANKS *prefs_and_ranks;
-static long max_prefs_and_ranks = 0;
-static DOCNO_RESULTS *docno_results;
-static long max_docno_results = 0;
-static unsigned char *temp_pa_pool;
-static long max_temp_pa_pool;
-static unsigned char **temp_pa_ptr_pool;
-static long max_temp_pa_ptr_pool;
-
-static long saved_num_judged = 0;
+static TE_THREAD_LOCAL PREFS_AND_RANKS *prefs_and_ranks;
+static TE_THREAD_LOCAL long max_prefs_and_ranks = 0;
+static TE_THREAD_LOCAL DOCNO_RESULTS *docno_results;
+static TE_THREAD_LOCAL long max_docno_results = 0;
+static TE_THREAD_LOCAL PAIR_COUNTS *temp_pair_pool;
+static TE_THREAD_LOCAL long max_temp_pair_pool = 0;
+static TE_THREAD_LOCAL long *pair_offsets;
+static TE_THREAD_LOCAL long max_pair_offsets = 0;
+static TE_THREAD_LOCAL long *doc_ec;      /* Index in ec_pool of the EC of
+					     each docid_rank, or -1 */
+static TE_THREAD_LOCAL long max_doc_ec = 0;
+static TE_THREAD_LOCAL long *merge_pool;
+static TE_THREAD_LOCAL long max_merge_pool = 0;
+static TE_THREAD_LOCAL long *run_bounds;
+static TE_THREAD_LOCAL long max_run_bounds = 0;
 
 
 
@@ -205,8 +230,8 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
     EC *ec_pool_ptr;
     double *rel_pool_ptr;
     long *rank_pool_ptr;
-    unsigned char *pa_pool_ptr;
-    unsigned char **pa_ptr_pool_ptr;
+    uint64_t *pa_pool_ptr;
+    uint64_t **pa_ptr_pool_ptr;
 
     long start_jg;
     long num_rel_level;
@@ -224,8 +249,9 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
 	results_prefs->jgs = jgs;
 	results_prefs->num_judged = num_judged;
 	results_prefs->num_judged_ret = num_judged_ret;
-	results_prefs->pref_counts = (COUNTS_ARRAY) {ca_pool,
-						     ca_ptr_pool,
+	results_prefs->pref_counts = (COUNTS_ARRAY) {pair_pool,
+						     pair_counts_formed ?
+						     num_pairs : 0,
 						     num_judged};
 	if (epi->debug_level >= 3)
 	    printf ("Returned Cached Form_prefs\n");
@@ -272,6 +298,21 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
 				       &num_judged_ret))
 	return (UNDEF);
 
+    /* Reserve space for EC pref counting */
+    if (NULL == (doc_ec =
+		 te_chk_and_malloc (doc_ec, &max_doc_ec,
+				    num_judged, sizeof (long))) ||
+	NULL == (merge_pool =
+		 te_chk_and_malloc (merge_pool, &max_merge_pool,
+				    2 * num_judged, sizeof (long))) ||
+	NULL == (run_bounds =
+		 te_chk_and_malloc (run_bounds, &max_run_bounds,
+				    trec_prefs->num_text_prefs + 1,
+				    sizeof (long))))
+	return (UNDEF);
+    for (i = 0; i < num_judged; i++)
+	doc_ec[i] = -1;
+
     /* Go through prefs_and ranks, count and reserve space for judgment groups.
        Also count number of JGs that have subgroups and will need preference
        arrays. */
@@ -290,17 +331,12 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
 	}
     }
 
-    /* Reserve pool space for JGs, and final pref_counts */
+    /* Reserve pool space for JGs.  pref_counts is formed later, if needed,
+       by form_prefs_pair_counts */
     if (NULL == (jgs =
-		 te_chk_and_malloc (jgs, &max_num_jgs, num_jgs, sizeof (JG))) ||
-	NULL == (ca_pool =
-		 te_chk_and_malloc (ca_pool, &max_ca_pool,
-				 num_judged * num_judged,
-				 sizeof (unsigned short))) ||
-	NULL == (ca_ptr_pool =
-		 te_chk_and_malloc (ca_ptr_pool, &max_ca_ptr_pool, num_judged, 
-				 sizeof (unsigned short *))))
+		 te_chk_and_malloc (jgs, &max_num_jgs, num_jgs, sizeof (JG))))
 	return (UNDEF);
+    pair_counts_formed = 0;
 
     if (num_jgs_with_subgroups) {
         /* Reserve pool space for preference arrays, and rel_level arrays */
@@ -310,13 +346,13 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
                                        sizeof(double))) ||
             NULL == (pa_pool =
                      te_chk_and_malloc(pa_pool, &max_pa_pool,
-                                       num_judged * num_judged *
+                                       num_judged * PA_NUM_WORDS(num_judged) *
                                        num_jgs_with_subgroups,
-                                       sizeof(unsigned char)))
+                                       sizeof(uint64_t)))
             || NULL == (pa_ptr_pool =
                         te_chk_and_malloc(pa_ptr_pool, &max_pa_ptr_pool,
                                           num_judged * num_jgs_with_subgroups,
-                                          sizeof(unsigned char *))))
+                                          sizeof(uint64_t *))))
             return (UNDEF);
     }
 
@@ -331,9 +367,7 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
     results_prefs->jgs = jgs;
     results_prefs->num_judged = num_judged;
     results_prefs->num_judged_ret = num_judged_ret;
-    results_prefs->pref_counts = (COUNTS_ARRAY) {ca_pool, ca_ptr_pool,
-						 num_judged};
-    init_counts_array (&results_prefs->pref_counts);
+    results_prefs->pref_counts = (COUNTS_ARRAY) {pair_pool, 0, num_judged};
 
     /* Go through prefs_and_ranks, determine and construct appropriate JG
        preference format.  Preferences are counted and add to summary values
@@ -354,8 +388,9 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
 		jgs[jg_ind].num_ecs = 0;  /* Indicator thet prefs_array used */
 		jgs[jg_ind].prefs_array = (PREFS_ARRAY) {pa_pool_ptr,
 						       pa_ptr_pool_ptr,
-						       num_judged};
-		pa_pool_ptr += num_judged * num_judged;
+						       num_judged,
+						       PA_NUM_WORDS(num_judged)};
+		pa_pool_ptr += num_judged * PA_NUM_WORDS(num_judged);
 		pa_ptr_pool_ptr += num_judged;
 		jgs[jg_ind].rel_array = rel_pool_ptr;
 		rel_pool_ptr += num_judged;
@@ -401,8 +436,9 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
 	jgs[jg_ind].num_ecs = 0;  /* Indicator thet prefs_array used */
 	jgs[jg_ind].prefs_array = (PREFS_ARRAY) {pa_pool_ptr,
 					       pa_ptr_pool_ptr,
-					       num_judged};
-	pa_pool_ptr += num_judged * num_judged;
+					       num_judged,
+					       PA_NUM_WORDS(num_judged)};
+	pa_pool_ptr += num_judged * PA_NUM_WORDS(num_judged);
 	pa_ptr_pool_ptr += num_judged;
 	jgs[jg_ind].rel_array = rel_pool_ptr;
 	rel_pool_ptr += num_judged;
@@ -424,12 +460,98 @@ form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
 				 results_prefs))
 	    return (UNDEF);
     }
+
     if (epi->debug_level >= 3)
 	debug_print_results_prefs (results_prefs);
 
     return (1);
 }
 
+/* Same as form_prefs_counts, but also forms results_prefs->pref_counts,
+   the counts over all JGs of the preferences between each pair of docs.
+   Only the measures looking at individual doc pairs need pref_counts,
+   which takes time proportional to the number of preferences.
+
+   UNDEF returned if error, 0 if used cache values, 1 if new values.
+*/
+int
+form_prefs_pair_counts (const EPI *epi, const REL_INFO *rel_info,
+			const RESULTS *results, RESULTS_PREFS *results_prefs)
+{
+    JG *jg;
+    long *ptr1, *ptr2;
+    long ec1, ec2;
+    long i, w;
+    long num_prefs;
+    uint64_t bits;
+    int ret;
+
+    if (UNDEF == (ret = form_prefs_counts (epi, rel_info, results,
+					   results_prefs)))
+	return (UNDEF);
+    if (pair_counts_formed)
+	return (ret);
+
+    pair_table_size = 0;
+    num_pairs = 0;
+    for (jg = jgs; jg < &jgs[num_jgs]; jg++) {
+	num_prefs = 0;
+	if (jg->num_ecs > 0) {
+	    /* EC JG.  Every doc of a higher EC preferred to every doc of a
+	       lower EC */
+	    for (ec1 = 0; ec1 < jg->num_ecs; ec1++) {
+		for (ec2 = ec1 + 1; ec2 < jg->num_ecs; ec2++)
+		    num_prefs += jg->ecs[ec1].num_in_ec *
+			jg->ecs[ec2].num_in_ec;
+	    }
+	    if (UNDEF == reserve_pair_counts (num_prefs))
+		return (UNDEF);
+	    for (ec1 = 0; ec1 < jg->num_ecs; ec1++) {
+		for (ec2 = ec1 + 1; ec2 < jg->num_ecs; ec2++) {
+		    for (ptr1 = jg->ecs[ec1].docid_ranks;
+			 ptr1 < &jg->ecs[ec1].docid_ranks[jg->ecs[ec1].num_in_ec];
+			 ptr1++) {
+			for (ptr2 = jg->ecs[ec2].docid_ranks;
+			     ptr2 < &jg->ecs[ec2].docid_ranks[jg->ecs[ec2].num_in_ec];
+			     ptr2++)
+			    add_pair_count (*ptr1, *ptr2);
+		    }
+		}
+	    }
+	}
+	else {
+	    /* Preference array JG */
+	    for (i = 0; i < num_judged; i++) {
+		for (w = 0; w < jg->prefs_array.num_words; w++)
+		    num_prefs += TE_POPCOUNT64 (jg->prefs_array.array[i][w]);
+	    }
+	    if (UNDEF == reserve_pair_counts (num_prefs))
+		return (UNDEF);
+	    for (i = 0; i < num_judged; i++) {
+		for (w = 0; w < jg->prefs_array.num_words; w++) {
+		    bits = jg->prefs_array.array[i][w];
+		    while (bits) {
+			add_pair_count (i, w * PA_WORD_BITS + TE_CTZ64 (bits));
+			bits &= bits - 1;
+		    }
+		}
+	    }
+	}
+    }
+
+    /* Turn the pref_counts hash table into the sorted list of pairs */
+    if (UNDEF == sort_pair_counts ())
+	return (UNDEF);
+    pair_counts_formed = 1;
+    results_prefs->pref_counts = (COUNTS_ARRAY) {pair_pool, num_pairs,
+						 num_judged};
+
+    if (epi->debug_level >= 3)
+	debug_print_counts_array (&results_prefs->pref_counts);
+
+    return (1);
+}
+
 static int
 form_jg_ec (const PREFS_AND_RANKS *prefs, const long num_prefs,
 	    long *rank_pool_ptr, JG *jg, RESULTS_PREFS *results_prefs) 
@@ -467,9 +589,14 @@ static int
 add_ec_pref_to_jg (JG *jg, RESULTS_PREFS *results_prefs)
 {
     long num_judged_ret = results_prefs->num_judged_ret;
-    unsigned short **pc = results_prefs->pref_counts.array;
-    long *ptr1, *ptr2;
-    long ec1, ec2;
+    long first_ec = jg->ecs - ec_pool;
+    long *ptr1;
+    long ec1;
+    long num_ret, num_notret;
+    long higher_ret = 0;         /* Num docs in higher ECs retrieved */
+    long higher_notret = 0;      /* Num docs in higher ECs not retrieved */
+    long num_prefs_ret = 0;
+    long num_merge = 0;
 
     jg->num_prefs_fulfilled_ret = 0; 
     jg->num_prefs_possible_ret = 0;  
@@ -481,70 +608,111 @@ add_ec_pref_to_jg (JG *jg, RESULTS_PREFS *results_prefs)
     jg->num_rel = 0;       
     jg->num_rel_ret = 0;   
 
-    /* Go through all ecs counting preferences, and setting up 
-       prefs_count */
+    /* Go through all ecs counting preferences with at most one doc
+       retrieved, and gathering the retrieved docs of each ec as a run
+       of merge_pool */
     for (ec1 = 0; ec1 < jg->num_ecs; ec1++) {
+	/* check for inconsistency: same doc in multiple ec */
+	for (ptr1 = jg->ecs[ec1].docid_ranks;
+	     ptr1 < &jg->ecs[ec1].docid_ranks[jg->ecs[ec1].num_in_ec];
+	     ptr1++) {
+	    if (doc_ec[*ptr1] >= first_ec && doc_ec[*ptr1] != first_ec + ec1) {
+		fprintf (stderr,
+			 "trec_eval.form_prefs_counts: Internal docid %ld occurs with different rel_level in same jsg\n", *ptr1);
+		return (UNDEF);
+	    }
+	    doc_ec[*ptr1] = first_ec + ec1;
+	}
+
 	/* Count num rel and ret */
+	run_bounds[ec1] = num_merge;
 	for (ptr1 = jg->ecs[ec1].docid_ranks;
 	     ptr1 < &jg->ecs[ec1].docid_ranks[jg->ecs[ec1].num_in_ec];
 	     ptr1++) {
 	    if (*ptr1 >= num_judged_ret)
 		break;
+	    merge_pool[num_merge++] = *ptr1;
 	}
+	num_ret = ptr1 - jg->ecs[ec1].docid_ranks;
+	num_notret = jg->ecs[ec1].num_in_ec - num_ret;
 	if (jg->ecs[ec1].rel_level > 0.0) {
-	    jg->num_rel_ret += ptr1 - jg->ecs[ec1].docid_ranks;
+	    jg->num_rel_ret += num_ret;
 	    jg->num_rel += jg->ecs[ec1].num_in_ec;
 	}
 	else {
-	    jg->num_nonrel_ret += ptr1 - jg->ecs[ec1].docid_ranks;
+	    jg->num_nonrel_ret += num_ret;
 	    jg->num_nonrel += jg->ecs[ec1].num_in_ec;
 	}
 
-	/* Count prefs */
-	for (ec2 = ec1 + 1; ec2 < jg->num_ecs; ec2++) {
-	    for (ptr1 = jg->ecs[ec1].docid_ranks;
-		 ptr1 < &jg->ecs[ec1].docid_ranks[jg->ecs[ec1].num_in_ec];
-		 ptr1++) {
-		for (ptr2 = jg->ecs[ec2].docid_ranks;
-		     ptr2 < &jg->ecs[ec2].docid_ranks[jg->ecs[ec2].num_in_ec];
-		     ptr2++) {
-		    /* Add pref to summary info */
-		    pc[*ptr1][*ptr2]++;
-		    /* check for inconsistency: same doc in multiple ec */
-		    if (*ptr1 == *ptr2) {
-			fprintf (stderr,
-				 "trec_eval.form_prefs_counts: Internal docid %ld occurs with different rel_level in same jsg\n", *ptr1);
-			return (UNDEF);
-			/* need to check this in pa also? */
-		    }
-		    /* Add count to appropriate jg_num* */
-		    if (*ptr1 < *ptr2) {
-			/* judgment fulfilled */
-			if (*ptr2 < num_judged_ret)
-			    jg->num_prefs_fulfilled_ret++;
-			else if (*ptr1 < num_judged_ret)
-			    jg->num_prefs_fulfilled_imp++;
-			else
-			    jg->num_prefs_possible_notoccur++;
-		    }
-		    else {
-			if (*ptr1 < num_judged_ret)
-			    jg->num_prefs_possible_ret++;
-			else if (*ptr2 < num_judged_ret)
-			    jg->num_prefs_possible_imp++;
-			else
-			    jg->num_prefs_possible_notoccur++;
-		    }
-		}
-	    }
-	}
+	/* Count prefs of docs in higher ecs over docs in this ec */
+	num_prefs_ret += higher_ret * num_ret;
+	jg->num_prefs_fulfilled_imp += higher_ret * num_notret;
+	jg->num_prefs_possible_imp += higher_notret * num_ret;
+	jg->num_prefs_possible_notoccur += higher_notret * num_notret;
+	higher_ret += num_ret;
+	higher_notret += num_notret;
     }
+    run_bounds[jg->num_ecs] = num_merge;
+
+    /* Prefs with both docs retrieved are not fulfilled when the doc of the
+       lower ec is ranked higher, ie an inversion of the runs */
+    jg->num_prefs_possible_ret = count_inversions (merge_pool,
+						   merge_pool + num_merge,
+						   run_bounds, jg->num_ecs);
+    jg->num_prefs_fulfilled_ret = num_prefs_ret - jg->num_prefs_possible_ret;
 
     jg->num_prefs_possible_ret += jg->num_prefs_fulfilled_ret;
     jg->num_prefs_possible_imp += jg->num_prefs_fulfilled_imp;
     return (1);
 }
 
+/* Return the number of inversions (pairs of ranks out of order) in ranks,
+   which is made up of num_runs sorted runs, run r being
+   ranks[bounds[r]..bounds[r+1]-1].  Runs are merged pairwise
+   (using temp, of the same size as ranks) until all of ranks is sorted;
+   bounds is overwritten. */
+static long
+count_inversions (long *ranks, long *temp, long *bounds, long num_runs)
+{
+    long num_inversions = 0;
+    long r, i, j, k;
+    long *swap;
+
+    while (num_runs > 1) {
+	for (r = 0; r + 1 < num_runs; r += 2) {
+	    i = bounds[r];
+	    j = bounds[r+1];
+	    k = bounds[r];
+	    while (i < bounds[r+1] && j < bounds[r+2]) {
+		if (ranks[j] < ranks[i]) {
+		    /* Out of order with all remaining ranks of first run */
+		    num_inversions += bounds[r+1] - i;
+		    temp[k++] = ranks[j++];
+		}
+		else
+		    temp[k++] = ranks[i++];
+	    }
+	    while (i < bounds[r+1])
+		temp[k++] = ranks[i++];
+	    while (j < bounds[r+2])
+		temp[k++] = ranks[j++];
+	}
+	if (r < num_runs) {
+	    /* Odd run out */
+	    for (i = bounds[r]; i < bounds[r+1]; i++)
+		temp[i] = ranks[i];
+	}
+	for (r = 0; 2 * r < num_runs; r++)
+	    bounds[r] = bounds[2 * r];
+	bounds[r] = bounds[num_runs];
+	num_runs = r;
+	swap = ranks;
+	ranks = temp;
+	temp = swap;
+    }
+    return (num_inversions);
+}
+
 static int
 form_jg_pa (const PREFS_AND_RANKS *prefs, const long num_prefs,
 	    JG *jg, RESULTS_PREFS *results_prefs) 
@@ -588,7 +756,7 @@ form_jg_pa (const PREFS_AND_RANKS *prefs, const long num_prefs,
 	/* Rest of JSG has lower rel_level */
 	while (j < num_prefs &&
 	       0 == strcmp (prefs[i].jsg, prefs[j].jsg)) {
-	    pa->array[prefs[i].rank][prefs[j].rank] = 1;
+	    PA_SET (pa, prefs[i].rank, prefs[j].rank);
 	    j++;
 	}
     }
@@ -605,78 +773,47 @@ form_jg_pa (const PREFS_AND_RANKS *prefs, const long num_prefs,
     return (1);
 }
 
+/* Add all transitive preferences to pa (Warshall's algorithm: after
+   step k, row i holds every doc reachable from i through docs 0..k, so
+   whenever i prefers k, everything k prefers is or'd into row i).
+   Aborts if the result is inconsistent (docs preferred to each other). */
 static int
 add_transitives(PREFS_ARRAY *pa)
 {
-    PREFS_ARRAY m1;
-    PREFS_ARRAY m2;
-
-    long i, j;
-    PREFS_ARRAY *array_in, *array_out, *temp;
-
-    /* Need two temporary arrays of same size as pa. Reserve space and
-       zero out arrays */
-    if (NULL == (temp_pa_pool =
-		 te_chk_and_malloc (temp_pa_pool, &max_temp_pa_pool,
-				 2 * pa->num_judged * pa->num_judged,
-				 sizeof (unsigned char))) ||
-	NULL == (temp_pa_ptr_pool =
-		 te_chk_and_malloc (temp_pa_ptr_pool, &max_temp_pa_ptr_pool,
-				 2 * pa->num_judged,
-				 sizeof (unsigned char *))))
-	return (UNDEF);
+    long i, j, k, w;
+    uint64_t *row_i, *row_k;
+    uint64_t bits;
 
-    m1 = (PREFS_ARRAY) {temp_pa_pool, temp_pa_ptr_pool, pa->num_judged};
-    m2 = (PREFS_ARRAY) {temp_pa_pool + pa->num_judged * pa->num_judged,
-		       temp_pa_ptr_pool + pa->num_judged,
-		       pa->num_judged};
-    if (pa->num_judged != saved_num_judged) {
-	/* if new size array, must reset row pointers */
-	saved_num_judged = pa->num_judged;
+    for (k = 0; k < pa->num_judged; k++) {
+	row_k = pa->array[k];
 	for (i = 0; i < pa->num_judged; i++) {
-	    m1.array[i] = m1.full_array + i * pa->num_judged;
-	    m2.array[i] = m2.full_array + i * pa->num_judged;
+	    if (i == k || ! PA_TEST (pa, i, k))
+		continue;
+	    row_i = pa->array[i];
+	    for (w = 0; w < pa->num_words; w++)
+		row_i[w] |= row_k[w];
 	}
     }
 
-    /* Add diagonal all ones in pa */
+    /* Check for inconsistencies */
     for (i = 0; i < pa->num_judged; i++) {
-	pa->array[i][i] = 1;
-    }
-
-    /* Multiply prefs_array by itself until there are no changes */
-    array_in = pa;
-    array_out = &m1;
-    if (mult_and_check_change (pa, array_in, array_out)) {
-	array_in = array_out;
-	array_out = &m2;
-	while (mult_and_check_change (pa, array_in, array_out)) {
-	    temp = array_in;
-	    array_in = array_out;
-	    array_out = temp;
-	}
-	/* There were changes,  now set pa values to those of array_out */
-	for (i = 0; i < pa->num_judged; i++) {
-	    for (j = 0; j <pa-> num_judged; j++) {
-		pa->array[i][j] = array_out->array[i][j];
+	for (w = 0; w < pa->num_words; w++) {
+	    bits = pa->array[i][w];
+	    while (bits) {
+		j = w * PA_WORD_BITS + TE_CTZ64 (bits);
+		bits &= bits - 1;
+		if (i != j && PA_TEST (pa, j, i)) {
+		    fprintf (stderr, "trec_eval.form_prefs_counts: Pref inconsistency found\n      internal rank %ld and internal rank %ld are conflicted\n", i, j);
+		    abort();
+		    return (-1);
+		}
 	    }
 	}
     }
 
-    /* Reset all diagonals to 0 in pa */
-    for (i = 0; i < pa->num_judged; i++) {
-	pa->array[i][i] = 0;
-    }
-
-    /* Check for inconsistencies */
+    /* A doc is never preferred to itself */
     for (i = 0; i < pa->num_judged; i++) {
-	for (j = 0; j <pa-> num_judged; j++) {
-	    if (i != j && pa->array[i][j] && pa->array[j][i]) {
-		fprintf (stderr, "trec_eval.form_prefs_counts: Pref inconsistency found\n      internal rank %ld and internal rank %ld are conflicted\n", i, j);
-		abort();
-		return (-1);
-	    }
-	}
+	pa->array[i][i / PA_WORD_BITS] &= ~((uint64_t) 1 << (i % PA_WORD_BITS));
     }
 
     return (1);
@@ -687,11 +824,10 @@ add_transitives(PREFS_ARRAY *pa)
 static int
 add_pa_pref_to_jg (JG *jg, RESULTS_PREFS *results_prefs)
 {
-    unsigned char **a = jg->prefs_array.array;
-    unsigned short **c = results_prefs->pref_counts.array;
+    uint64_t **a = jg->prefs_array.array;
     long num_judged = results_prefs->num_judged;
     long num_judged_ret = results_prefs->num_judged_ret;
-    long i,j;
+    long i;
 
     jg->num_prefs_fulfilled_ret = 0; 
     jg->num_prefs_possible_ret = 0;  
@@ -719,43 +855,23 @@ add_pa_pref_to_jg (JG *jg, RESULTS_PREFS *results_prefs)
     }
 
     for (i = 0; i < num_judged_ret; i++) {
-	for (j = 0; j < i; j++) {
-	    if (a[i][j]) {
-		/* Pref not fulfilled.  Area A2 (see comment at top) */
-		c[i][j]++;
-		jg->num_prefs_possible_ret++;
-	    }
-	}
-	for (j = i+1; j < num_judged_ret; j++) {
-	    if (a[i][j]) {
-		/* Pref fulfilled.  Area A1 (see comment at top) */
-		c[i][j]++;
-		jg->num_prefs_fulfilled_ret++;
-	    }
-	}
-	for (j = num_judged_ret; j < num_judged; j++) {
-	    if (a[i][j]) {
-		/* Pref fulfilled implied.  Area A3 (see comment at top) */
-		c[i][j]++;
-		jg->num_prefs_fulfilled_imp++;
-	    }
-	}
+	/* Pref not fulfilled.  Area A2 (see comment at top) */
+	jg->num_prefs_possible_ret += count_pa_row (a[i], 0, i);
+	/* Pref fulfilled.  Area A1 (see comment at top) */
+	jg->num_prefs_fulfilled_ret += count_pa_row (a[i], i + 1,
+						     num_judged_ret);
+	/* Pref fulfilled implied.  Area A3 (see comment at top) */
+	jg->num_prefs_fulfilled_imp += count_pa_row (a[i], num_judged_ret,
+						     num_judged);
     }
     for (i = num_judged_ret; i < num_judged; i++) {
-	for (j = 0; j < num_judged_ret; j++) {
-	    if (a[i][j]) {
-		/* Pref not fulfilled implied.  Area A4 (see comment at top) */
-		c[i][j]++;
-		jg->num_prefs_possible_imp++;
-	    }
-	}
-	for (j = num_judged_ret; j < num_judged; j++) {
-	    if (a[i][j]) {
-		/* Pref not occur at all.  Area A5 (see comment at top) */
-		c[i][j]++;
-		jg->num_prefs_possible_notoccur++;
-	    }
-	}
+	/* Pref not fulfilled implied.  Area A4 (see comment at top) */
+	jg->num_prefs_possible_imp += count_pa_row (a[i], 0,
+						    num_judged_ret);
+	/* Pref not occur at all.  Area A5 (see comment at top) */
+	jg->num_prefs_possible_notoccur += count_pa_row (a[i],
+							 num_judged_ret,
+							 num_judged);
     }
 
     jg->num_prefs_possible_ret += jg->num_prefs_fulfilled_ret;
@@ -763,28 +879,141 @@ add_pa_pref_to_jg (JG *jg, RESULTS_PREFS *results_prefs)
     return (1);
 }
 
-/* Multiply array a1 * array a2 and put result in array res.
-   Return (1) if array res is changed from array a2 after multiplication
-   else return 0 */
+/* Count the prefs (bits set) in row[start..end-1] of a preference array */
+static long
+count_pa_row (const uint64_t *row, long start, long end)
+{
+    long count = 0;
+    long w, last_w;
+    uint64_t bits;
+
+    if (start >= end)
+	return (0);
+    last_w = (end - 1) / PA_WORD_BITS;
+    for (w = start / PA_WORD_BITS; w <= last_w; w++) {
+	bits = row[w];
+	if (w == start / PA_WORD_BITS)
+	    bits &= ~(uint64_t) 0 << (start % PA_WORD_BITS);
+	if (w == last_w && end % PA_WORD_BITS)
+	    bits &= ~(~(uint64_t) 0 << (end % PA_WORD_BITS));
+	count += TE_POPCOUNT64 (bits);
+    }
+    return (count);
+}
+
+/* Slot of the pair_pool hash table for the doc pair (i < j).  Empty slots
+   have docid_rank2 == 0 */
+#define PAIR_SLOT(i,j) ((long) ((((uint64_t) (i) * num_judged + (j)) * \
+				 0x9e3779b97f4a7c15ULL) >> 32) & \
+			(pair_table_size - 1))
+
+/* Make sure the pair_pool hash table can take num_new_prefs more
+   preferences while staying at most half full, growing it if needed */
 static int
-mult_and_check_change (const PREFS_ARRAY *a1, const PREFS_ARRAY *a2, PREFS_ARRAY *res)
+reserve_pair_counts (long num_new_prefs)
 {
-    int change = 0;
-    long i, j, k;
-    for (i = 0; i < a1->num_judged; i++) {
-	for (j = 0; j < a1->num_judged; j++) {
-	    res->array[i][j] = 0;
-	    for (k = 0; k < a1->num_judged; k++) {
-		if (a1->array[i][k]  && a2->array[k][j]) {
-		    res->array[i][j] = 1;
-		    break;
-		}
-	    }
-	    
-	    if (a2->array[i][j] != res->array[i][j]) change = 1;
-	}
+    long new_size, needed, i, slot;
+    long max_pairs = num_judged * (num_judged - 1) / 2;
+
+    needed = num_pairs + num_new_prefs;
+    if (needed > max_pairs)
+	needed = max_pairs;
+    new_size = pair_table_size > 0 ? pair_table_size : 64;
+    while (new_size < 2 * needed)
+	new_size *= 2;
+    if (new_size == pair_table_size)
+	return (1);
+
+    /* Save current pairs, then rehash them into the larger table */
+    if (num_pairs > 0 &&
+	NULL == (temp_pair_pool =
+		 te_chk_and_malloc (temp_pair_pool, &max_temp_pair_pool,
+				    num_pairs, sizeof (PAIR_COUNTS))))
+	return (UNDEF);
+    for (i = 0, slot = 0; slot < pair_table_size; slot++) {
+	if (pair_pool[slot].docid_rank2)
+	    temp_pair_pool[i++] = pair_pool[slot];
+    }
+    if (NULL == (pair_pool =
+		 te_chk_and_malloc (pair_pool, &max_pair_pool,
+				    new_size, sizeof (PAIR_COUNTS))))
+	return (UNDEF);
+    pair_table_size = new_size;
+    (void) memset ((void *) pair_pool, 0, new_size * sizeof (PAIR_COUNTS));
+    for (i = 0; i < num_pairs; i++) {
+	slot = PAIR_SLOT (temp_pair_pool[i].docid_rank1,
+			  temp_pair_pool[i].docid_rank2);
+	while (pair_pool[slot].docid_rank2)
+	    slot = (slot + 1) & (pair_table_size - 1);
+	pair_pool[slot] = temp_pair_pool[i];
+    }
+    return (1);
+}
+
+/* Add a preference of doc i over doc j to prefs_count.  Space must have
+   been reserved by reserve_pair_counts */
+static void
+add_pair_count (long i, long j)
+{
+    long lo = MIN (i, j);
+    long hi = MAX (i, j);
+    long slot = PAIR_SLOT (lo, hi);
+
+    while (pair_pool[slot].docid_rank2 &&
+	   (pair_pool[slot].docid_rank1 != lo ||
+	    pair_pool[slot].docid_rank2 != hi))
+	slot = (slot + 1) & (pair_table_size - 1);
+    if (0 == pair_pool[slot].docid_rank2) {
+	pair_pool[slot].docid_rank1 = lo;
+	pair_pool[slot].docid_rank2 = hi;
+	num_pairs++;
+    }
+    if (i < j)
+	pair_pool[slot].count12++;
+    else
+	pair_pool[slot].count21++;
+}
+
+/* Sort the pairs of the pair_pool hash table by docid_rank1, docid_rank2
+   into the start of pair_pool.  Two counting sort passes (by docid_rank2
+   into temp_pair_pool, then stably by docid_rank1 back into pair_pool) */
+static int
+sort_pair_counts ()
+{
+    long i, slot;
+
+    if (num_pairs == 0)
+	return (1);
+    if (NULL == (temp_pair_pool =
+		 te_chk_and_malloc (temp_pair_pool, &max_temp_pair_pool,
+				    num_pairs, sizeof (PAIR_COUNTS))) ||
+	NULL == (pair_offsets =
+		 te_chk_and_malloc (pair_offsets, &max_pair_offsets,
+				    num_judged + 1, sizeof (long))))
+	return (UNDEF);
+
+    (void) memset ((void *) pair_offsets, 0, (num_judged + 1) * sizeof (long));
+    for (slot = 0; slot < pair_table_size; slot++) {
+	if (pair_pool[slot].docid_rank2)
+	    pair_offsets[pair_pool[slot].docid_rank2 + 1]++;
+    }
+    for (i = 1; i <= num_judged; i++)
+	pair_offsets[i] += pair_offsets[i-1];
+    for (slot = 0; slot < pair_table_size; slot++) {
+	if (pair_pool[slot].docid_rank2)
+	    temp_pair_pool[pair_offsets[pair_pool[slot].docid_rank2]++] =
+		pair_pool[slot];
     }
-    return (change);
+
+    (void) memset ((void *) pair_offsets, 0, (num_judged + 1) * sizeof (long));
+    for (i = 0; i < num_pairs; i++)
+	pair_offsets[temp_pair_pool[i].docid_rank1 + 1]++;
+    for (i = 1; i <= num_judged; i++)
+	pair_offsets[i] += pair_offsets[i-1];
+    for (i = 0; i < num_pairs; i++)
+	pair_pool[pair_offsets[temp_pair_pool[i].docid_rank1]++] =
+	    temp_pair_pool[i];
+    return (1);
 }
 
 static int form_prefs_and_ranks (const EPI*epi,
@@ -810,6 +1039,8 @@ static int form_prefs_and_ranks (const EPI*epi,
 
     for (i = 0; i < num_results; i++) {
 	docno_results[i].docno = text_results_info->text_results[i].docno;
+	docno_results[i].docno_len =
+	    text_results_info->text_results[i].docno_len;
 	docno_results[i].sim = text_results_info->text_results[i].sim;
     }
     /* Sort results by sim, breaking ties lexicographically using docno */
@@ -836,10 +1067,12 @@ static int form_prefs_and_ranks (const EPI*epi,
            comp_docno);
     /* Error checking for duplicates */
     for (i = 1; i < num_results; i++) {
-	if (0 == strcmp (docno_results[i].docno,
-			 docno_results[i-1].docno)) {
-	    fprintf (stderr, "trec_eval.form_prefs_counts: duplicate docs %s",
-		     docno_results[i].docno);
+	if (0 == te_docno_cmp (docno_results[i].docno,
+			       docno_results[i].docno_len,
+			       docno_results[i-1].docno,
+			       docno_results[i-1].docno_len)) {
+	    fprintf (stderr, "trec_eval.form_prefs_counts: duplicate docs %.*s",
+		     (int) docno_results[i].docno_len, docno_results[i].docno);
 	    return (UNDEF);
 	}
     }
@@ -871,14 +1104,18 @@ static int form_prefs_and_ranks (const EPI*epi,
     end_ranks = &prefs_and_ranks[num_prefs];
     for (i = 0; i < num_results && ranks_ptr < end_ranks; i++) {
         while (ranks_ptr < end_ranks &&
-               strcmp (ranks_ptr->docno, docno_results[i].docno) < 0)
+               te_docno_strcmp (ranks_ptr->docno, docno_results[i].docno,
+				docno_results[i].docno_len) < 0)
             ranks_ptr++;
         if (ranks_ptr < end_ranks &&
-	    strcmp (ranks_ptr->docno, docno_results[i].docno) == 0) {
+	    te_docno_strcmp (ranks_ptr->docno, docno_results[i].docno,
+			     docno_results[i].docno_len) == 0) {
 	    do {
 		ranks_ptr++;
 	    } while (ranks_ptr < end_ranks &&
-		     strcmp (ranks_ptr->docno, docno_results[i].docno) == 0);
+		     te_docno_strcmp (ranks_ptr->docno,
+				      docno_results[i].docno,
+				      docno_results[i].docno_len) == 0);
 	}
 	else
 	    /* dpcno_results[i] not judged */
@@ -900,6 +1137,8 @@ static int form_prefs_and_ranks (const EPI*epi,
     for (i = 0; i < num_results; i ++) {
 	if (docno_results[i].rank > -1) {
 	    docno_results[lnum_judged_ret].docno = docno_results[i].docno;
+	    docno_results[lnum_judged_ret].docno_len =
+		docno_results[i].docno_len;
 	    docno_results[lnum_judged_ret].rank = lnum_judged_ret;
 	    lnum_judged_ret++;
 	}
@@ -921,7 +1160,8 @@ static int form_prefs_and_ranks (const EPI*epi,
     end_ranks = &prefs_and_ranks[num_prefs];
     next_unretrieved_rank = num_results;
     for (i = 0; i < num_results; i++) {
-	while (strcmp (ranks_ptr->docno, docno_results[i].docno) < 0) {
+	while (te_docno_strcmp (ranks_ptr->docno, docno_results[i].docno,
+				docno_results[i].docno_len) < 0) {
 	    ranks_ptr->rank = next_unretrieved_rank++;
 	    start_ptr = ranks_ptr++;
 	    while (strcmp (ranks_ptr->docno, start_ptr->docno) == 0) {
@@ -968,34 +1208,17 @@ static int form_prefs_and_ranks (const EPI*epi,
 static void
 init_prefs_array (PREFS_ARRAY *pa)
 {
-    unsigned char *row_ptr;
+    uint64_t *row_ptr;
     long i;
     (void) memset ((void *) pa->full_array, 0,
-		   pa->num_judged * pa->num_judged *
-		   sizeof (unsigned char));
+		   pa->num_judged * pa->num_words * sizeof (uint64_t));
     row_ptr = pa->full_array;
     for (i = 0; i < pa->num_judged; i++) {
 	pa->array[i] = row_ptr;
-	row_ptr += pa->num_judged;
-    }
-}
-
-static void
-init_counts_array (COUNTS_ARRAY *ca)
-{
-    unsigned short *row_ptr;
-    long i;
-    (void) memset ((void *) ca->full_array, 0,
-		   ca->num_judged * ca->num_judged *
-		   sizeof (unsigned short));
-    row_ptr = ca->full_array;
-    for (i = 0; i < ca->num_judged; i++) {
-	ca->array[i] = row_ptr;
-	row_ptr += ca->num_judged;
+	row_ptr += pa->num_words;
     }
 }
 
-
 static int 
 comp_prefs_and_ranks_docno (PREFS_AND_RANKS *ptr1, PREFS_AND_RANKS *ptr2)
 {
@@ -1023,13 +1246,15 @@ DOCNO_RESULTS *ptr2;
         return (-1);
     if (ptr1->sim < ptr2->sim)
         return (1);
-    return (strcmp (ptr1->docno, ptr2->docno));
+    return (te_docno_cmp (ptr1->docno, ptr1->docno_len,
+			  ptr2->docno, ptr2->docno_len));
 }
 
 static int 
 comp_docno (DOCNO_RESULTS *ptr1, DOCNO_RESULTS *ptr2)
 {
-    return (strcmp (ptr1->docno, ptr2->docno));
+    return (te_docno_cmp (ptr1->docno, ptr1->docno_len,
+			  ptr2->docno, ptr2->docno_len));
 }
 
 static int 
@@ -1062,8 +1287,8 @@ debug_print_docno_results (DOCNO_RESULTS *dr, long num_results,
     printf ("Docno_results Dump.  num_results %ld, %s\n",
 	    num_results, location);
     for (i = 0; i < num_results; i++) {
-	printf ("  %s\t%4.2f\t%3ld\n",
-		dr[i].docno, dr[i].sim, dr[i].rank);
+	printf ("  %.*s\t%4.2f\t%3ld\n",
+		(int) dr[i].docno_len, dr[i].docno, dr[i].sim, dr[i].rank);
     }
     fflush (stdout);
 }
@@ -1091,7 +1316,7 @@ debug_print_prefs_array (PREFS_ARRAY *pa) {
 	for (j = 0; j < pa->num_judged; j++) {
 	    if (j && 0 == (j % 20))
 		printf ("    (%ld)\n     ", j);
-	    printf ("%2hhd", pa->array[i][j]);
+	    printf ("%2d", (int) PA_TEST (pa, i, j));
 	}
     }
     putchar ('\n');
@@ -1100,17 +1325,14 @@ debug_print_prefs_array (PREFS_ARRAY *pa) {
 
 static void
 debug_print_counts_array (COUNTS_ARRAY *ca) {
-    long i,j;
-    printf ("  Counts_Array Dump. Num_judged %ld", ca->num_judged);
-    for (i = 0; i < ca->num_judged; i++) {
-	printf ("\n    Row %3ld\n    ", i);
-	for (j = 0; j < ca->num_judged; j++) {
-	    if (j && 0 == (j % 20))
-		printf ("    (%ld)\n   ", j);
-	    printf ("%2hd ", ca->array[i][j]);
-	}
+    long i;
+    printf ("  Counts_Array Dump. Num_judged %ld, Num_pairs %ld\n",
+	    ca->num_judged, ca->num_pairs);
+    for (i = 0; i < ca->num_pairs; i++) {
+	printf ("    %3u %3u  %3u %3u\n",
+		ca->pairs[i].docid_rank1, ca->pairs[i].docid_rank2,
+		ca->pairs[i].count12, ca->pairs[i].count21);
     }
-    putchar ('\n');
     fflush (stdout);
 }
 
@@ -1157,7 +1379,18 @@ debug_print_results_prefs (RESULTS_PREFS *rp) {
 	    rp->num_judged_ret, rp->num_judged);
     for (i = 0; i < rp->num_jgs; i++)
 	debug_print_jg (&rp->jgs[i]);
-    debug_print_counts_array (&rp->pref_counts);
+}
+
+/* Forget the query cached, keeping the space formed for the next query */
+int
+te_form_pref_counts_reset ()
+{
+    if (max_current_query > 0) {
+	Free (current_query);
+	max_current_query = 0;
+	current_query = "no_query";
+    }
+    return (1);
 }
 
 int 
@@ -1180,13 +1413,9 @@ te_form_pref_counts_cleanup ()
 	Free (ec_pool);
 	max_ec_pool = 0;
     }
-    if (max_ca_pool > 0) {
-	Free (ca_pool);
-	max_ca_pool = 0;
-    }
-    if (max_ca_ptr_pool > 0) {
-	Free (ca_ptr_pool);
-	max_ca_ptr_pool = 0;
+    if (max_pair_pool > 0) {
+	Free (pair_pool);
+	max_pair_pool = 0;
     }
     if (max_pa_pool > 0) {
 	Free (pa_pool);
@@ -1208,13 +1437,25 @@ te_form_pref_counts_cleanup ()
 	Free (docno_results);
 	max_docno_results = 0;
     }
-    if (max_temp_pa_pool > 0) {
-	Free (temp_pa_pool);
-	max_temp_pa_pool = 0;
+    if (max_doc_ec > 0) {
+	Free (doc_ec);
+	max_doc_ec = 0;
+    }
+    if (max_merge_pool > 0) {
+	Free (merge_pool);
+	max_merge_pool = 0;
+    }
+    if (max_run_bounds > 0) {
+	Free (run_bounds);
+	max_run_bounds = 0;
+    }
+    if (max_temp_pair_pool > 0) {
+	Free (temp_pair_pool);
+	max_temp_pair_pool = 0;
     }
-    if (max_temp_pa_ptr_pool > 0) {
-	Free (temp_pa_ptr_pool);
-	max_temp_pa_ptr_pool = 0;
+    if (max_pair_offsets > 0) {
+	Free (pair_offsets);
+	max_pair_offsets = 0;
     }
     return (1);
 }
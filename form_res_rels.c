@@ -24,33 +24,66 @@
    results and rel_info formats must be "trec_results" and "qrels"
    respectively.  
 
+   Retrieved docs are matched with judgements through the interned docids
+   assigned when the files were read (see docno.c), using a table indexed
+   by docid that holds the relevance of each judged doc of the current
+   query.  The table is reset to RELVALUE_NONPOOL after each query.
+   Rankers normally write results already in rank order; a linear check
+   detects that (including the docno order of ties) and the sort is then
+   skipped.  Duplicate docnos are found through a hash table of the
+   retrieved docnos.  So for ranked input, the work per query is linear.
+
    UNDEF returned if error, 0 if used cache values, 1 if new values.
+
+   te_form_rank_stats extends the RES_RELS of a query with the statistics
+   (RANK_STATS) that the rank-based measures are calculated from, all
+   derived in one pass over results_rel_list and cached along with it, so
+   that each such measure no longer walks the list itself.
 */
 
-static int comp_rank_judged (), comp_sim_docno (), comp_docno ();
+static int comp_sim_docno (), in_rank_order (), check_duplicates ();
 
 /* Definitions used for temporary and cached values */
 typedef struct {
     char *docno;
+    long docno_len;
+    long docid;
     double sim;
-    long rank;
     long rel;
 } DOCNO_INFO;
 
-/* Current cached query */
-static char *current_query = "no query";
-static long max_current_query = 0;
+/* Current cached query (kept separately by each evaluation thread) */
+static TE_THREAD_LOCAL char *current_query = "no query";
+static TE_THREAD_LOCAL long max_current_query = 0;
 
 /* Space reserved for cached returned values */
-static long *rel_levels;
-static long max_rel_levels = 0;
-static RES_RELS saved_res_rels;
-static long *ranked_rel_list;
-static long max_ranked_rel_list = 0;
+static TE_THREAD_LOCAL long *rel_levels;
+static TE_THREAD_LOCAL long max_rel_levels = 0;
+static TE_THREAD_LOCAL RES_RELS saved_res_rels;
+static TE_THREAD_LOCAL long *ranked_rel_list;
+static TE_THREAD_LOCAL long max_ranked_rel_list = 0;
 
 /* Space reserved for intermediate values */
-static DOCNO_INFO *docno_info;
-static long max_docno_info = 0;
+static TE_THREAD_LOCAL DOCNO_INFO *docno_info;
+static TE_THREAD_LOCAL long max_docno_info = 0;
+/* Relevance of each docid for the current query.  RELVALUE_NONPOOL except
+   while a query is being processed */
+static TE_THREAD_LOCAL long *docid_rel;
+static TE_THREAD_LOCAL long max_docid_rel = 0;
+/* Open addressing hash table of docno_info indices (plus 1; 0 is empty),
+   for finding duplicate docnos */
+static TE_THREAD_LOCAL long *docno_table;
+static TE_THREAD_LOCAL long max_docno_table = 0;
+
+/* Cached RANK_STATS of the current query, if rank_stats_valid */
+static TE_THREAD_LOCAL long rank_stats_valid = 0;
+static TE_THREAD_LOCAL RANK_STATS saved_rank_stats;
+static TE_THREAD_LOCAL long *rel_so_far;
+static TE_THREAD_LOCAL long max_rel_so_far = 0;
+static TE_THREAD_LOCAL double *sum_prec;
+static TE_THREAD_LOCAL long max_sum_prec = 0;
+static TE_THREAD_LOCAL double *int_prec;
+static TE_THREAD_LOCAL long max_int_prec = 0;
 
 
 int
@@ -59,18 +92,23 @@ te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
 {
     long i;
     long num_results;
+    long num_docids;
     long max_rel;
 
     TEXT_RESULTS_INFO *text_results_info;
+    TEXT_RESULTS *text_results;
     TEXT_QRELS_INFO *trec_qrels;
 
     TEXT_QRELS *qrels_ptr, *end_qrels;
+    double timing_wall, timing_cpu;
 
     if (0 == strcmp (current_query, results->qid)) {
 	/* Have done this query already. Return cached values */
 	*res_rels = saved_res_rels;
 	return (0);
     }
+    if (epi->timing_flag)
+	te_timing_form_begin (&timing_wall, &timing_cpu);
 
     /* Check that format type of result info and rel info are correct */
     if (strcmp ("qrels", rel_info->rel_format) ||
@@ -86,8 +124,10 @@ te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
 				    i, sizeof (char))))
 	return (UNDEF);
     (void) strncpy (current_query, results->qid, i);
+    rank_stats_valid = 0;
 
     text_results_info = (TEXT_RESULTS_INFO *) results->q_results;
+    text_results = text_results_info->text_results;
     trec_qrels = (TEXT_QRELS_INFO *) rel_info->q_rel_info;
 
     num_results = text_results_info->num_text_results;
@@ -101,53 +141,46 @@ te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
 		 te_chk_and_malloc (docno_info, &max_docno_info,
 				    num_results, sizeof (DOCNO_INFO))))
 	return (UNDEF);
-
     for (i = 0; i < num_results; i++) {
-	docno_info[i].docno = text_results_info->text_results[i].docno;
-	docno_info[i].sim = text_results_info->text_results[i].sim;
+	docno_info[i].docno = text_results[i].docno;
+	docno_info[i].docno_len = text_results[i].docno_len;
+	docno_info[i].docid = text_results[i].docid;
+	docno_info[i].sim = text_results[i].sim;
     }
 
-    /* Sort results by sim, breaking ties lexicographically using docno */
-    qsort ((char *) docno_info,
-	   (int) num_results,
-	   sizeof (DOCNO_INFO),
-	   comp_sim_docno);
+    /* Sort results by sim, breaking ties lexicographically using docno,
+       unless they are already in that order */
+    if (! text_results_info->rank_ordered &&
+	! in_rank_order (docno_info, num_results))
+	qsort ((char *) docno_info,
+	       (int) num_results,
+	       sizeof (DOCNO_INFO),
+	       comp_sim_docno);
 
     /* Only look at epi->max_num_docs_per_topic (not normally an issue) */
     if (num_results > epi->max_num_docs_per_topic)
 	num_results = epi->max_num_docs_per_topic;
 
-    /* Add ranks to docno_info (starting at 1) */
-    for (i = 0; i < num_results; i++) {
-        docno_info[i].rank = i+1;
-    }
-
-    /* Sort trec_top lexicographically */
-    qsort ((char *) docno_info,
-           (int) num_results,
-           sizeof (DOCNO_INFO),
-           comp_docno);
-
-    /* Error checking for duplicates */
-    for (i = 1; i < num_results; i++) {
-	if (0 == strcmp (docno_info[i].docno,
-			 docno_info[i-1].docno)) {
-	    fprintf (stderr, "trec_eval.form_res_qrels: duplicate docs %s",
-		     docno_info[i].docno);
-	    return (UNDEF);
-	}
-    }
+    /* Error checking for duplicates among the retained docs */
+    if (UNDEF == check_duplicates (docno_info, num_results))
+	return (UNDEF);
 
     /* Find max_rel among qid, reserve and zero space for rel_levels */
-    /* Check for duplicate docnos. */
+    /* Check for duplicate docnos (same docid). */
+    /* Find the number of docids needed too.  Docids are normally those of
+       the global docno table, but an evaluation context (trec_eval_lib.c)
+       numbers the judged docs of each query itself */
     qrels_ptr = trec_qrels->text_qrels;
     end_qrels = &trec_qrels->text_qrels [trec_qrels->num_text_qrels];
     max_rel = qrels_ptr->rel;
+    num_docids = MAX (te_docno_num_docids (), qrels_ptr->docid + 1);
     qrels_ptr++;
     while (qrels_ptr < end_qrels) {
 	if (max_rel < qrels_ptr->rel)
 	    max_rel = qrels_ptr->rel;
-	if (0 == strcmp ((qrels_ptr-1)->docno, qrels_ptr->docno)) {
+	if (num_docids <= qrels_ptr->docid)
+	    num_docids = qrels_ptr->docid + 1;
+	if ((qrels_ptr-1)->docid == qrels_ptr->docid) {
 	    fprintf (stderr, "trec_eval.form_res_rels: duplicate docs %s\n",
 		     qrels_ptr->docno);
 	    return (UNDEF);
@@ -160,45 +193,44 @@ te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
 				    sizeof (long))))
 	return (UNDEF);
     (void) memset (rel_levels, 0, (max_rel+1) * sizeof (long));
+
+    /* Reserve space for docid table, all values initially nonpool */
+    if (num_docids > max_docid_rel) {
+	if (NULL == (docid_rel =
+		     te_chk_and_malloc (docid_rel, &max_docid_rel,
+					num_docids, sizeof (long))))
+	    return (UNDEF);
+	for (i = 0; i < max_docid_rel; i++)
+	    docid_rel[i] = RELVALUE_NONPOOL;
+    }
     
-    /* Construct rank_rel array and rel_levels */
-    /* Go through docno_info, trec_qrels in parallel to determine relevance
-       for each doc in docno_info.
-       Note that trec_qrels already sorted by docno with no duplicates */
-    qrels_ptr = trec_qrels->text_qrels;
-    end_qrels = &trec_qrels->text_qrels [trec_qrels->num_text_qrels];
-    for (i = 0; i < num_results; i++) {
-	while (qrels_ptr < end_qrels &&
-	       strcmp (qrels_ptr->docno, docno_info[i].docno) < 0) {
-	    if (qrels_ptr->rel >= 0)
-		rel_levels[qrels_ptr->rel]++;
-	    qrels_ptr++;
-	}
-	if (qrels_ptr >= end_qrels ||
-	    strcmp (qrels_ptr->docno, docno_info[i].docno) > 0) {
-	    /* Doc is non-judged */
-	    docno_info[i].rel = RELVALUE_NONPOOL;
-	}
-	else {
-	    /* Doc is in pool, assign relevance */
-	    if (qrels_ptr->rel < 0)
-		/* In pool, but unjudged (eg, infAP uses a sample of pool)*/
-		docno_info[i].rel = RELVALUE_UNJUDGED;
-	    else {
-		docno_info[i].rel = qrels_ptr->rel;
-	    }
-	    if (qrels_ptr->rel >= 0)
-		rel_levels[qrels_ptr->rel]++;
-	    qrels_ptr++;
+    /* Count rel_levels and enter the relevance of each judged doc into
+       docid_rel */
+    for (qrels_ptr = trec_qrels->text_qrels; qrels_ptr < end_qrels;
+	 qrels_ptr++) {
+	if (qrels_ptr->rel >= 0) {
+	    rel_levels[qrels_ptr->rel]++;
+	    docid_rel[qrels_ptr->docid] = qrels_ptr->rel;
 	}
+	else
+	    /* In pool, but unjudged (eg, infAP uses a sample of pool)*/
+	    docid_rel[qrels_ptr->docid] = RELVALUE_UNJUDGED;
     }
-    /* Finish counting rels */
-    while (qrels_ptr < end_qrels) {
-	if (qrels_ptr->rel >= 0)
-	    rel_levels[qrels_ptr->rel]++;
-	qrels_ptr++;
+
+    /* Determine relevance of each retrieved doc (non-judged if its docno
+       does not occur in any judgements) */
+    for (i = 0; i < num_results; i++) {
+	if (docno_info[i].docid == DOCID_NONPOOL)
+	    docno_info[i].rel = RELVALUE_NONPOOL;
+	else
+	    docno_info[i].rel = docid_rel[docno_info[i].docid];
     }
 
+    /* Reset docid_rel for next query */
+    for (qrels_ptr = trec_qrels->text_qrels; qrels_ptr < end_qrels;
+	 qrels_ptr++)
+	docid_rel[qrels_ptr->docid] = RELVALUE_NONPOOL;
+
     /* Construct ranked_rel_list and associated counts */
     saved_res_rels.num_rel_ret = 0;
     saved_res_rels.num_nonpool = 0;
@@ -206,28 +238,22 @@ te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
     saved_res_rels.results_rel_list = ranked_rel_list;
     saved_res_rels.rel_levels = rel_levels;
     if (epi->judged_docs_only_flag) {
-	/* If judged_docs_only_flag, then must fix up ranks to
-	   reflect unjudged docs being thrown out. Note: done this way
-	   to preserve original tie-breaking based on text docno */
-	long rrl;
-	/* Sort tuples by increasing rank among judged docs*/
-	qsort ((char *) docno_info,
-	       (int) num_results,
-	       sizeof (DOCNO_INFO),
-	       comp_rank_judged);
-	rrl = 0; i = 0;
-	while (i < num_results && docno_info[i].rel >= 0) {
+	/* If judged_docs_only_flag, then throw out unjudged docs, keeping
+	   the original rank order (and thus tie-breaking) of the rest */
+	long rrl = 0;
+	for (i = 0; i < num_results; i++) {
+	    if (docno_info[i].rel < 0)
+		continue;
 	    if (docno_info[i].rel >= epi->relevance_level)
 		saved_res_rels.num_rel_ret++;
-	    saved_res_rels.results_rel_list[rrl++] = docno_info[i++].rel;
+	    saved_res_rels.results_rel_list[rrl++] = docno_info[i].rel;
 	}
 	saved_res_rels.num_ret = rrl;
     }
     else {
-	/* Normal path.  Assign rel value to appropriate rank */
+	/* Normal path.  docno_info is in rank order */
 	for (i = 0; i < num_results; i++) {
-	    saved_res_rels.results_rel_list[docno_info[i].rank - 1] =
-		docno_info[i].rel;
+	    saved_res_rels.results_rel_list[i] = docno_info[i].rel;
 	    if (RELVALUE_NONPOOL == docno_info[i].rel)
 		saved_res_rels.num_nonpool++;
 	    else if (RELVALUE_UNJUDGED == docno_info[i].rel)
@@ -240,6 +266,7 @@ te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
 	saved_res_rels.num_ret = num_results;
     }
     saved_res_rels.num_rel = 0;
+    saved_res_rels.num_rel_levels = 0;
     for (i = 0; i <= max_rel; i++) {
 	if (saved_res_rels.rel_levels[i]) {
 	    saved_res_rels.num_rel_levels = i + 1;
@@ -250,26 +277,185 @@ te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
     
     *res_rels = saved_res_rels;
 
+    if (epi->timing_flag)
+	te_timing_form_end (timing_wall, timing_cpu);
     return (1);
 }
 
-static int 
-comp_rank_judged (ptr1, ptr2)
-DOCNO_INFO *ptr1;
-DOCNO_INFO *ptr2;
+int
+te_form_rank_stats (const EPI *epi, const REL_INFO *rel_info,
+		    const RESULTS *results, RANK_STATS *rank_stats)
 {
-    if (ptr1->rel >= 0 && ptr2->rel >= 0) {
-	if (ptr1->rank < ptr2->rank)
-	    return (-1);
-	if (ptr1->rank > ptr2->rank)
-	    return (1);
+    RES_RELS *rr = &saved_rank_stats.res_rels;
+    long i, rel, num_nonrel, num_rel_ranked, rel_offset;
+    long judged_rel, nonrel_so_far, pool_unjudged_so_far;
+    double precis, bpref, inf_ap;
+
+    if (UNDEF == te_form_res_rels (epi, rel_info, results, rr))
+	return (UNDEF);
+    if (rank_stats_valid) {
+	*rank_stats = saved_rank_stats;
 	return (0);
     }
-    if (ptr1->rel >= 0)
-	return (-1);
-    if (ptr2->rel >= 0)
-	return (1);
-    return(0);
+
+    /* Relevant docs are those with value >= epi->relevance_level, which
+       includes nonpool and unjudged docs if it is negative */
+    num_rel_ranked = rr->num_rel_ret;
+    if (epi->relevance_level <= RELVALUE_NONPOOL)
+	num_rel_ranked += rr->num_nonpool;
+    if (epi->relevance_level <= RELVALUE_UNJUDGED)
+	num_rel_ranked += rr->num_unjudged_in_pool;
+    rel_offset = rr->num_rel_ret - num_rel_ranked;
+
+    if (NULL == (rel_so_far =
+		 te_chk_and_malloc (rel_so_far, &max_rel_so_far,
+				    rr->num_ret + 1, sizeof (long))) ||
+	NULL == (sum_prec =
+		 te_chk_and_malloc (sum_prec, &max_sum_prec,
+				    num_rel_ranked + 1, sizeof (double))) ||
+	NULL == (int_prec =
+		 te_chk_and_malloc (int_prec, &max_int_prec,
+				    rr->num_rel_ret + 1, sizeof (double))))
+	return (UNDEF);
+
+    num_nonrel = 0;
+    for (i = 0; i < MIN (epi->relevance_level, rr->num_rel_levels); i++)
+	num_nonrel += rr->rel_levels[i];
+
+    /* The single pass.  int_prec[rel] is first just the precision at the
+       rel'th relevant doc, where (as the interpolated measures always
+       have) relevant docs are counted down from num_rel_ret at the last
+       one, which only differs from counting up if relevance_level is
+       negative */
+    saved_rank_stats.first_rel_rank = 0;
+    rel = 0;
+    judged_rel = 0;
+    nonrel_so_far = 0;
+    pool_unjudged_so_far = 0;
+    bpref = 0.0;
+    inf_ap = 0.0;
+    rel_so_far[0] = 0;
+    sum_prec[0] = 0.0;
+    for (i = 0; i < rr->num_ret; i++) {
+	if (rr->results_rel_list[i] >= epi->relevance_level) {
+	    rel++;
+	    if (1 == rel)
+		saved_rank_stats.first_rel_rank = i + 1;
+	    precis = (double) rel / (double) (i + 1);
+	    sum_prec[rel] = sum_prec[rel-1] + precis;
+	    if (rel + rel_offset >= 1)
+		int_prec[rel + rel_offset] =
+		    (double) (rel + rel_offset) / (double) (i + 1);
+	}
+
+	/* bpref and infAP only look at judged docs */
+	if (RELVALUE_NONPOOL == rr->results_rel_list[i])
+	    ;
+	else if (RELVALUE_UNJUDGED == rr->results_rel_list[i])
+	    pool_unjudged_so_far++;
+	else if (rr->results_rel_list[i] < epi->relevance_level)
+	    nonrel_so_far++;
+	else {
+	    judged_rel++;
+	    /* bpref: fraction of judged nonrel docs (up to num_rel of them)
+	       ranked after this rel doc */
+	    if (nonrel_so_far > 0) {
+		bpref += 1.0 - 
+		    (((double) MIN (nonrel_so_far, rr->num_rel)) /
+		     (double) MIN (num_nonrel, rr->num_rel));
+	    }
+	    else
+		bpref += 1.0;
+
+	    /* infAP: expected precision at this rel doc, estimated from the
+	       judged docs above it */
+	    if (0 == i)
+		inf_ap += 1.0;
+	    else {
+		double fj = (double) i;
+		inf_ap += 1.0 / (fj+1.0) +
+		    (fj / (fj+1.0)) *
+		    ((judged_rel-1+nonrel_so_far+pool_unjudged_so_far) / fj) *
+		    ((judged_rel-1 + INFAP_EPSILON) / 
+		     (judged_rel-1 + nonrel_so_far + 2 * INFAP_EPSILON));
+	    }
+	}
+	rel_so_far[i+1] = rel;
+    }
+
+    /* Interpolate: max precision at any rank at or below.  Precision only
+       decreases between relevant docs, so only they need be considered */
+    for (i = rr->num_rel_ret - 1; i > 0; i--) {
+	if (int_prec[i] < int_prec[i+1])
+	    int_prec[i] = int_prec[i+1];
+    }
+    if (rr->num_rel_ret > 0)
+	int_prec[0] = int_prec[1];
+    else
+	int_prec[0] = (double) rr->num_rel_ret / (double) rr->num_ret;
+
+    saved_rank_stats.num_rel_ranked = num_rel_ranked;
+    saved_rank_stats.rel_so_far = rel_so_far;
+    saved_rank_stats.sum_prec = sum_prec;
+    saved_rank_stats.int_prec = int_prec;
+    saved_rank_stats.bpref = bpref;
+    saved_rank_stats.inf_ap = inf_ap;
+    rank_stats_valid = 1;
+
+    *rank_stats = saved_rank_stats;
+    return (1);
+}
+
+/* Return 1 if docno_info is already sorted by comp_sim_docno (decreasing
+   sim, ties by decreasing docno), else 0.  Only ties need docno compares */
+static int
+in_rank_order (DOCNO_INFO *docno_info, const long num_results)
+{
+    long i;
+
+    for (i = 1; i < num_results; i++) {
+	if (docno_info[i-1].sim < docno_info[i].sim ||
+	    (docno_info[i-1].sim == docno_info[i].sim &&
+	     te_docno_cmp (docno_info[i-1].docno, docno_info[i-1].docno_len,
+			   docno_info[i].docno, docno_info[i].docno_len) <= 0))
+	    return (0);
+    }
+    return (1);
+}
+
+/* Check docno_info for duplicate docnos, by entering each docno into
+   docno_table (sized to the next power of 2 at least twice num_results) */
+static int
+check_duplicates (DOCNO_INFO *docno_info, const long num_results)
+{
+    long i;
+    long table_size, slot, j;
+
+    for (table_size = 2; table_size < 2 * num_results; table_size *= 2)
+	;
+    if (NULL == (docno_table =
+		 te_chk_and_malloc (docno_table, &max_docno_table,
+				    table_size, sizeof (long))))
+	return (UNDEF);
+    (void) memset (docno_table, 0, table_size * sizeof (long));
+
+    for (i = 0; i < num_results; i++) {
+	slot = te_docno_hash (docno_info[i].docno, docno_info[i].docno_len) &
+	    (table_size - 1);
+	while (0 != (j = docno_table[slot])) {
+	    if (0 == te_docno_cmp (docno_info[i].docno,
+				   docno_info[i].docno_len,
+				   docno_info[j-1].docno,
+				   docno_info[j-1].docno_len)) {
+		fprintf (stderr, "trec_eval.form_res_qrels: duplicate docs %.*s",
+			 (int) docno_info[i].docno_len, docno_info[i].docno);
+		return (UNDEF);
+	    }
+	    slot = (slot + 1) & (table_size - 1);
+	}
+	docno_table[slot] = i + 1;
+    }
+    return (1);
 }
 
 static int 
@@ -281,18 +467,24 @@ DOCNO_INFO *ptr2;
         return (-1);
     if (ptr1->sim < ptr2->sim)
         return (1);
-    return (strcmp (ptr2->docno, ptr1->docno));
+    return (te_docno_cmp (ptr2->docno, ptr2->docno_len,
+			  ptr1->docno, ptr1->docno_len));
 }
 
-static int 
-comp_docno (ptr1, ptr2)
-DOCNO_INFO *ptr1;
-DOCNO_INFO *ptr2;
+
+/* Forget the query cached, keeping the space formed for the next query */
+int
+te_form_res_rels_reset ()
 {
-    return (strcmp (ptr1->docno, ptr2->docno));
+    if (max_current_query > 0) {
+	Free (current_query);
+	max_current_query = 0;
+	current_query = "no_query";
+    }
+    rank_stats_valid = 0;
+    return (1);
 }
 
-
 int 
 te_form_res_rels_cleanup ()
 {
@@ -313,5 +505,26 @@ te_form_res_rels_cleanup ()
 	Free (docno_info);
 	max_docno_info = 0;
     }
+    if (max_docid_rel > 0) {
+	Free (docid_rel);
+	max_docid_rel = 0;
+    }
+    if (max_docno_table > 0) {
+	Free (docno_table);
+	max_docno_table = 0;
+    }
+    if (max_rel_so_far > 0) {
+	Free (rel_so_far);
+	max_rel_so_far = 0;
+    }
+    if (max_sum_prec > 0) {
+	Free (sum_prec);
+	max_sum_prec = 0;
+    }
+    if (max_int_prec > 0) {
+	Free (int_prec);
+	max_int_prec = 0;
+    }
+    rank_stats_valid = 0;
     return (1);
 }
@@ -33,25 +33,26 @@ static int comp_rank_judged (), comp_sim_docno (), comp_docno ();
 /* Definitions used for temporary and cached values */
 typedef struct {
     char *docno;
+    long docno_len;
     double sim;
     long rank;
     long rel;
 } DOCNO_INFO;
 
-/* Current cached query */
-static char *current_query = "no query";
-static long max_current_query = 0;
+/* Current cached query (kept separately by each evaluation thread) */
+static TE_THREAD_LOCAL char *current_query = "no query";
+static TE_THREAD_LOCAL long max_current_query = 0;
 
 /* Space reserved for cached returned values */
-static long *rel_levels;
-static long max_rel_levels = 0;
-static RES_RELS *jgs;
-static long num_jgs;
-static long max_num_jgs = 0;
-static long *ranked_rel_list;
-static long max_ranked_rel_list = 0;
-static DOCNO_INFO *docno_info;
-static long max_docno_info = 0;
+static TE_THREAD_LOCAL long *rel_levels;
+static TE_THREAD_LOCAL long max_rel_levels = 0;
+static TE_THREAD_LOCAL RES_RELS *jgs;
+static TE_THREAD_LOCAL long num_jgs;
+static TE_THREAD_LOCAL long max_num_jgs = 0;
+static TE_THREAD_LOCAL long *ranked_rel_list;
+static TE_THREAD_LOCAL long max_ranked_rel_list = 0;
+static TE_THREAD_LOCAL DOCNO_INFO *docno_info;
+static TE_THREAD_LOCAL long max_docno_info = 0;
 
 int
 te_form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
@@ -113,6 +114,7 @@ te_form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
 
     for (i = 0; i < num_results; i++) {
 	docno_info[i].docno = text_results_info->text_results[i].docno;
+	docno_info[i].docno_len = text_results_info->text_results[i].docno_len;
 	docno_info[i].sim = text_results_info->text_results[i].sim;
     }
 
@@ -139,10 +141,11 @@ te_form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
 
     /* Error checking for duplicates */
     for (i = 1; i < num_results; i++) {
-	if (0 == strcmp (docno_info[i].docno,
-			 docno_info[i-1].docno)) {
-	    fprintf (stderr, "trec_eval.form_res_qrels: duplicate docs %s",
-		     docno_info[i].docno);
+	if (0 == te_docno_cmp (docno_info[i].docno, docno_info[i].docno_len,
+			       docno_info[i-1].docno,
+			       docno_info[i-1].docno_len)) {
+	    fprintf (stderr, "trec_eval.form_res_qrels: duplicate docs %.*s",
+		     (int) docno_info[i].docno_len, docno_info[i].docno);
 	    return (UNDEF);
 	}
     }
@@ -177,13 +180,15 @@ te_form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
 	    [trec_qrels->text_qrels_jg[jg].num_text_qrels];
 	for (i = 0; i < num_results; i++) {
 	    while (qrels_ptr < end_qrels &&
-		   strcmp (qrels_ptr->docno, docno_info[i].docno) < 0) {
+		   te_docno_strcmp (qrels_ptr->docno, docno_info[i].docno,
+				    docno_info[i].docno_len) < 0) {
 		if (qrels_ptr->rel >= 0)
 		    rel_level_ptr[qrels_ptr->rel]++;
 		qrels_ptr++;
 	    }
 	    if (qrels_ptr >= end_qrels ||
-		strcmp (qrels_ptr->docno, docno_info[i].docno) > 0) {
+		te_docno_strcmp (qrels_ptr->docno, docno_info[i].docno,
+				 docno_info[i].docno_len) > 0) {
 		/* Doc is non-judged */
 		docno_info[i].rel = RELVALUE_NONPOOL;
 	    }
@@ -298,7 +303,8 @@ DOCNO_INFO *ptr2;
         return (-1);
     if (ptr1->sim < ptr2->sim)
         return (1);
-    return (strcmp (ptr2->docno, ptr1->docno));
+    return (te_docno_cmp (ptr2->docno, ptr2->docno_len,
+			  ptr1->docno, ptr1->docno_len));
 }
 
 static int 
@@ -306,7 +312,20 @@ comp_docno (ptr1, ptr2)
 DOCNO_INFO *ptr1;
 DOCNO_INFO *ptr2;
 {
-    return (strcmp (ptr1->docno, ptr2->docno));
+    return (te_docno_cmp (ptr1->docno, ptr1->docno_len,
+			  ptr2->docno, ptr2->docno_len));
+}
+
+/* Forget the query cached, keeping the space formed for the next query */
+int
+te_form_res_rels_jg_reset ()
+{
+    if (max_current_query > 0) {
+	Free (current_query);
+	max_current_query = 0;
+	current_query = "no_query";
+    }
+    return (1);
 }
 
 int 
@@ -14,16 +14,22 @@
 int te_get_qrels (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info);
 int te_get_qrels_jg (EPI *epi, char *text_qrels_file,
 		     ALL_REL_INFO *all_rel_info);
+int te_get_qrels_bin (EPI *epi, char *qrels_bin_file,
+		      ALL_REL_INFO *all_rel_info);
 int te_get_prefs (EPI *epi, char *text_prefs_file, ALL_REL_INFO *all_rel_info);
 int te_get_qrels_prefs (EPI *epi, char *text_prefs_file,
 			ALL_REL_INFO *all_rel_info);
 int te_get_trec_results (EPI *epi, char *trec_results_file,
 			 ALL_RESULTS *all_results);
+int te_get_trec_results_bin (EPI *epi, char *results_bin_file,
+			     ALL_RESULTS *all_results);
 int te_get_qrels_cleanup ();
 int te_get_qrels_jg_cleanup ();
+int te_get_qrels_bin_cleanup ();
 int te_get_prefs_cleanup ();
 int te_get_qrels_prefs_cleanup ();
 int te_get_trec_results_cleanup ();
+int te_get_trec_results_bin_cleanup ();
 
 REL_INFO_FILE_FORMAT te_rel_info_format[] = {
     {"qrels",
@@ -56,6 +62,19 @@ File may contain no NULL characters. \n\
      te_get_qrels_jg, te_get_qrels_jg_cleanup},
 
 
+    {"qrels_bin",
+"Rel_info_file format: Binary 'qrels_bin'\n\
+A standard 'qrels' rel_info_file compiled into binary form by\n\
+   trec_eval --compile_qrels qrels_bin_file qrels_file\n\
+Evaluation is identical to using qrels_file with '-R qrels', but the\n\
+compiled file is mapped directly into memory without any parsing, so\n\
+startup time no longer depends on the size of the qrels.\n\
+Files contain native binary values, and can only be used on machines\n\
+with the same word size and byte order as the one that compiled them.\n\
+",
+     te_get_qrels_bin, te_get_qrels_bin_cleanup},
+
+
     {"prefs", 
 "Rel_info_file format: Non-standard 'prefs'\n\
 Preferences of user(s) for docs for a given qid is determined from\n\
@@ -249,26 +268,48 @@ File may contain no NULL characters. \n\
 Lines may contain fields after the run_id; they are ignored. \n\
 ",
      te_get_trec_results, te_get_trec_results_cleanup},
+
+
+    {"trec_results_bin",
+"Results_file format: Binary 'trec_results_bin'\n\
+A standard 'trec_results' results_file converted into binary columnar\n\
+form by\n\
+   trec_eval --compile_results results_bin_file results_file\n\
+(or written directly by a ranker in the same layout).  Evaluation is\n\
+identical to using results_file with '-T trec_results', but the file is\n\
+mapped directly into memory without any parsing, and each query's results\n\
+are stored in rank order so they need not be sorted.\n\
+Files contain native binary values, and can only be used on machines\n\
+with the same word size and byte order as the one that wrote them.\n\
+",
+     te_get_trec_results_bin, te_get_trec_results_bin_cleanup},
 };
 int te_num_results_format =
     sizeof (te_results_format)/sizeof (te_results_format[0]);
 
 int te_form_res_rels_cleanup (), te_form_res_rels_jg_cleanup (),
-    te_form_pref_counts_cleanup (), te_form_pref_counts_cleanup ();
+    te_form_pref_counts_cleanup (), te_form_pref_counts_cleanup (),
+    te_form_gains_cleanup ();
+int te_form_res_rels_reset (), te_form_res_rels_jg_reset (),
+    te_form_pref_counts_reset (), te_form_gains_reset ();
 
 FORM_INTER_PROCS te_form_inter_procs[] = {
     {"qrels", "trec_results",
      "Process for evaluating qrels and trec_results",
      /* te_form_res_rels, */
-     te_form_res_rels_cleanup},
+     te_form_res_rels_cleanup, te_form_res_rels_reset},
+    {"qrels", "trec_results",
+     "Process for the gains of the ndcg measures on qrels and trec_results",
+     /* te_form_gains, */
+     te_form_gains_cleanup, te_form_gains_reset},
     {"qrels_jg", "trec_results",
      "Process for evaluating qrels_jg and trec_results",
      /* te_form_res_rels_jg, */
-     te_form_res_rels_jg_cleanup},
+     te_form_res_rels_jg_cleanup, te_form_res_rels_jg_reset},
     {"prefs", "trec_results",
      "Process for evaluating prefs and trec_results",
      /* te_form_prefs_counts, */
-     te_form_pref_counts_cleanup},
+     te_form_pref_counts_cleanup, te_form_pref_counts_reset},
     {"qrels_prefs", "trec_results",
      "   Copyright (c) 2008 - Chris Buckley. \n\
 \n\
@@ -277,7 +318,7 @@ FORM_INTER_PROCS te_form_inter_procs[] = {
 \n\
    Process for evaluating qrels_prefs and trec_results",
      /* te_form_prefs_counts, */
-     te_form_pref_counts_cleanup},
+     te_form_pref_counts_cleanup, te_form_pref_counts_reset},
 };
 
 int te_num_form_inter_procs =
@@ -13,6 +13,78 @@ void * te_chk_and_malloc (void *ptr, long *current_bound,
 			  const long needed, const size_t size);
 void * te_chk_and_realloc (void *ptr, long *current_bound,
 			   const long needed, const int size);
+/* Docno comparisons (docnos from results files are not NULL terminated) */
+int te_docno_cmp (const char *docno1, const long len1,
+		  const char *docno2, const long len2);
+int te_docno_strcmp (const char *str, const char *docno, const long len);
+/* Docno interning (docids shared between rel_info and results) */
+long te_docno_intern (char *docno);
+long te_docno_lookup (const char *docno, const long len);
+long te_docno_num_docids ();
+int te_docno_intern_cleanup ();
+#define TE_DOCNO_HASH_BITS 32
+uint32_t te_docno_hash (const char *docno, const long len);
+int te_docno_attach (const long num, const long *offsets, const char *strtab,
+		     const long *index, const long index_size);
+/* Splitting input buffers at line boundaries and parsing them in threads */
+long te_split_buf (char *buf, char *end_ptr, long max_chunks,
+		   char **chunk_starts);
+int te_run_threads (int (*proc) (void *), void *args, const size_t arg_size,
+		    const long num_args);
+long te_atomic_next (volatile long *counter);
+void te_shared_lock ();
+void te_shared_unlock ();
+/* Reading trec_results one query at a time (--stream) */
+int te_get_trec_results_stream_open (EPI *epi, char *text_results_file);
+int te_get_trec_results_stream_next (EPI *epi, RESULTS *results);
+int te_get_trec_results_stream_cleanup ();
+/* Compiling qrels into the binary qrels_bin rel_info format */
+int te_compile_qrels_bin (const ALL_REL_INFO *all_rel_info,
+			  const char *bin_file);
+/* Converting trec_results into the binary trec_results_bin results format */
+int te_compile_results_bin (const ALL_RESULTS *all_results,
+			    const char *bin_file);
+/* Caching the values of queries between invocations (--cache) */
+int te_eval_cache_open (const EPI *epi, const char *file,
+			const char *version_id, const TREC_EVAL *q_eval);
+int te_eval_cache_get (const EPI *epi, const REL_INFO *rel_info,
+		       const RESULTS *results, uint64_t *key,
+		       TREC_EVAL *q_eval);
+int te_eval_cache_put (const uint64_t key, const TREC_EVAL *q_eval);
+int te_eval_cache_close ();
+/* Timing the phases of an evaluation (--timing) */
+#define TE_PHASE_NONE -1
+#define TE_PHASE_REL_INFO 0
+#define TE_PHASE_RESULTS 1
+#define TE_PHASE_ZSCORES 2
+#define TE_PHASE_INIT 3
+#define TE_PHASE_EVAL 4
+#define TE_PHASE_ACC 5
+#define TE_PHASE_PRINT 6
+#define TE_NUM_PHASES 7
+void te_timing_phase (int phase);
+void te_timing_form_begin (double *wall, double *cpu);
+void te_timing_form_end (const double wall, const double cpu);
+void te_timing_rel_info (const ALL_REL_INFO *all_rel_info);
+void te_timing_results (const RESULTS *results, const long num_q_results);
+void te_timing_queries (const long num);
+void te_timing_report ();
+/* Hardware counter profile of the phases and measures (--profile) */
+int te_profile_open (const long num_measures);
+void te_profile_phase (int phase);
+void te_profile_meas_begin ();
+void te_profile_meas_end (const long m);
+void te_profile_form_begin ();
+void te_profile_form_end ();
+void te_profile_report (TREC_MEAS **measures, const long num_measures);
+/* Paired significance tests between two runs (--compare) */
+void te_compare_start_run (const long run);
+int te_compare_add_query (const TREC_EVAL *q_eval);
+int te_compare_print (const EPI *epi);
+/* Resolving the rel_level=gain params of the ndcg measures (form_gains.c) */
+int te_form_gains_init (TREC_MEAS *tm);
+int te_form_gains_release (TREC_MEAS *tm);
+int te_form_gains_tables_cleanup ();
 /* Functions for dealing with zscores */
 int te_get_zscores (const EPI *epi, const char *zscores_file,
 		    ALL_ZSCORES *zscores);
@@ -37,6 +109,8 @@ int te_init_meas_a_double_cut_double(EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval
 int te_init_meas_s_double_p_double(EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval);
 /* Measure is a single double with paired name=double params */
 int te_init_meas_s_double_p_pair(EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval);
+/* Measure is a single double with paired rel_level=gain params */
+int te_init_meas_s_double_p_gains(EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval);
 
 
 /* -------- Accumulate Measure -------- */
@@ -99,5 +173,7 @@ int te_print_final_meas_a_cut(const EPI * epi, TREC_MEAS * tm,
 /* Measure is a single double with double params */
 int te_print_final_meas_s_double_p(const EPI * epi, TREC_MEAS * tm,
                                   TREC_EVAL * eval);
+/* Measure only prints its values (no per query state of its own) */
+int te_meas_values_only (const TREC_MEAS *tm);
 
 #endif /* FUNCTIONSH */
@@ -125,6 +125,7 @@ static char *trec_prefs_buf = NULL;
 static TEXT_PREFS_INFO *text_info_pool = NULL;
 static TEXT_PREFS *text_prefs_pool = NULL;
 static REL_INFO *rel_info_pool = NULL;
+static map_t rel_qid_map = NULL;
 
 /* Temp structure for values in input line */
 typedef struct {
@@ -211,7 +212,8 @@ te_get_prefs (EPI *epi, char *text_prefs_file, ALL_REL_INFO *all_rel_info)
     /* Allocate space for queries */
     if (NULL == (rel_info_pool = Malloc (num_qid, REL_INFO)) ||
 	NULL == (text_info_pool = Malloc (num_qid, TEXT_PREFS_INFO)) ||
-	NULL == (text_prefs_pool = Malloc (num_lines, TEXT_PREFS)))
+	NULL == (text_prefs_pool = Malloc (num_lines, TEXT_PREFS)) ||
+        NULL == (rel_qid_map = hashmap_new_size (num_qid)))
 	return (UNDEF);
 
     rel_info_ptr = rel_info_pool;
@@ -233,6 +235,7 @@ te_get_prefs (EPI *epi, char *text_prefs_file, ALL_REL_INFO *all_rel_info)
 	    text_info_ptr->text_prefs = text_prefs_ptr;
 	    *rel_info_ptr =
 		(REL_INFO) {current_qid, "prefs", text_info_ptr};
+            hashmap_put(rel_qid_map, rel_info_ptr->qid, rel_info_ptr);
 	}
 	text_prefs_ptr->jg = lines[i].jg;
 	text_prefs_ptr->jsg = lines[i].jsg;
@@ -245,6 +248,7 @@ te_get_prefs (EPI *epi, char *text_prefs_file, ALL_REL_INFO *all_rel_info)
 
     all_rel_info->num_q_rels = num_qid;
     all_rel_info->rel_info = rel_info_pool;
+    all_rel_info->map = rel_qid_map;
 
     Free (lines);
     return (1);
@@ -307,6 +311,10 @@ parse_prefs_line (char **start_ptr, char **qid_ptr, char**jg_ptr,
 int 
 te_get_prefs_cleanup ()
 {
+    if (rel_qid_map != NULL) {
+      hashmap_free(rel_qid_map);
+      rel_qid_map = NULL;
+    }
     if (trec_prefs_buf != NULL) {
 	Free (trec_prefs_buf);
 	trec_prefs_buf = NULL;
@@ -10,6 +10,7 @@
 #include "sysfunc.h"
 #include "trec_eval.h"
 #include "trec_format.h"
+#include "functions.h"
 #include <ctype.h>
 
 /* Read all relevance information from text_qrels_file.
@@ -30,6 +31,7 @@ Each list of query judgments is sorted lexicographically by docno.
 /*
     typedef struct {                    * For each relevance judgement *
         char *docno;                       * document id *
+        long docid;                        * interned docid of docno *
         long rel;                          * document judgement *
     } TEXT_QRELS;
 
@@ -58,6 +60,17 @@ typedef struct {
     char *rel;
 } LINES;
 
+/* A chunk of whole lines of the file, tokenized independently of the
+   other chunks (possibly in its own thread) */
+typedef struct {
+    char *start_ptr;              /* Start of chunk within buffer */
+    char *end_ptr;                /* End of chunk */
+    LINES *lines;                 /* Malloc'd lines parsed from chunk */
+    long num_lines;
+    long error_line;              /* Index in chunk of malformed line, or -1 */
+} CHUNK;
+
+static int parse_qrels_chunk (void *arg);
 static int parse_qrels_line (char **start_ptr, char **qid_ptr,
 			     char **docno_ptr, char **rel_ptr);
 
@@ -79,13 +92,15 @@ te_get_qrels (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
 {
     FILE *fd;
     int size = 0;
-    char *ptr;
     char *current_qid;
     long i;
     LINES *lines;
     LINES *line_ptr;
     long num_lines;
     long num_qid;
+    CHUNK *chunks;
+    char **chunk_starts;
+    long num_chunks;
     /* current pointers into static pools above */
     REL_INFO *rel_info_ptr;
     TEXT_QRELS_INFO *text_info_ptr;
@@ -112,26 +127,51 @@ te_get_qrels (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
     }
     trec_qrels_buf[size] = '\0';
 
-    /* Count number of lines in file */
-    num_lines = 0;
-    for (ptr = trec_qrels_buf; *ptr; ptr = index(ptr,'\n')+1)
-	num_lines++;
-
-    /* Get all lines */
-    if (NULL == (lines = Malloc (num_lines, LINES)))
+    /* Tokenize the buffer, in epi->num_threads chunks of whole lines
+       parsed concurrently if requested, then merge in chunk order */
+    if (NULL == (chunks = Malloc (epi->num_threads, CHUNK)) ||
+	NULL == (chunk_starts = Malloc (epi->num_threads + 1, char *)))
 	return (UNDEF);
-    line_ptr = lines;
-    ptr = trec_qrels_buf;
-    while (*ptr) {
-	if (UNDEF == parse_qrels_line (&ptr, &line_ptr->qid,
-				       &line_ptr->docno, &line_ptr->rel)) {
-	    fprintf (stderr, "trec_eval.get_qrels: Malformed line %ld\n",
-		     (long) (line_ptr - lines + 1));
+    num_chunks = te_split_buf (trec_qrels_buf, trec_qrels_buf + size,
+			       epi->num_threads, chunk_starts);
+    for (i = 0; i < num_chunks; i++) {
+	chunks[i].start_ptr = chunk_starts[i];
+	chunks[i].end_ptr = chunk_starts[i+1];
+    }
+    if (UNDEF == te_run_threads (parse_qrels_chunk, chunks, sizeof (CHUNK),
+				 num_chunks)) {
+	num_lines = 0;
+	for (i = 0; i < num_chunks; i++) {
+	    if (chunks[i].error_line >= 0) {
+		fprintf (stderr, "trec_eval.get_qrels: Malformed line %ld\n",
+			 (long) (num_lines + chunks[i].error_line + 1));
+		break;
+	    }
+	    num_lines += chunks[i].num_lines;
+	}
+	return (UNDEF);
+    }
+
+    num_lines = 0;
+    for (i = 0; i < num_chunks; i++)
+	num_lines += chunks[i].num_lines;
+    if (num_chunks == 1)
+	lines = chunks[0].lines;
+    else {
+	if (NULL == (lines = Malloc (num_lines, LINES)))
 	    return (UNDEF);
+	line_ptr = lines;
+	for (i = 0; i < num_chunks; i++) {
+	    if (chunks[i].num_lines == 0)
+		continue;
+	    (void) memcpy (line_ptr, chunks[i].lines,
+			   chunks[i].num_lines * sizeof (LINES));
+	    line_ptr += chunks[i].num_lines;
+	    Free (chunks[i].lines);
 	}
-	line_ptr++;
     }
-    num_lines = line_ptr-lines;
+    Free (chunks);
+    Free (chunk_starts);
 
     /* Sort all lines by qid, then docno */
     qsort ((char *) lines,
@@ -151,7 +191,7 @@ te_get_qrels (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
     if (NULL == (rel_info_pool = Malloc (num_qid, REL_INFO)) ||
 	NULL == (text_info_pool = Malloc (num_qid, TEXT_QRELS_INFO)) ||
 	NULL == (text_qrels_pool = Malloc (num_lines, TEXT_QRELS)) ||
-        NULL == (rel_qid_map = hashmap_new()))
+        NULL == (rel_qid_map = hashmap_new_size (num_qid)))
 	return (UNDEF);
 
     rel_info_ptr = rel_info_pool;
@@ -177,6 +217,8 @@ te_get_qrels (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
             hashmap_put(map_ptr, rel_info_ptr->qid, rel_info_ptr);
 	}
 	text_qrels_ptr->docno = lines[i].docno;
+	if (UNDEF == (text_qrels_ptr->docid = te_docno_intern (lines[i].docno)))
+	    return (UNDEF);
 	text_qrels_ptr->rel = atol (lines[i].rel);
 	text_qrels_ptr++;
     }
@@ -198,6 +240,47 @@ static int comp_lines_qid_docno (LINES *ptr1, LINES *ptr2)
     return (strcmp (ptr1->docno, ptr2->docno));
 }
 
+/* Tokenize all lines of a single CHUNK.  Every line ends in a newline */
+static int
+parse_qrels_chunk (void *arg)
+{
+    CHUNK *chunk = (CHUNK *) arg;
+    char *ptr;
+    LINES *line_ptr;
+    long num_lines;
+
+    chunk->lines = NULL;
+    chunk->num_lines = 0;
+    chunk->error_line = -1;
+
+    /* Count number of lines in chunk */
+    num_lines = 0;
+    for (ptr = chunk->start_ptr; ptr < chunk->end_ptr; ptr++) {
+	if (NULL == (ptr = memchr (ptr, '\n', chunk->end_ptr - ptr)))
+	    break;
+	num_lines++;
+    }
+    if (num_lines == 0)
+	return (1);
+
+    /* Get all lines */
+    if (NULL == (chunk->lines = Malloc (num_lines, LINES)))
+	return (UNDEF);
+    line_ptr = chunk->lines;
+    ptr = chunk->start_ptr;
+    while (ptr < chunk->end_ptr) {
+	if (UNDEF == parse_qrels_line (&ptr, &line_ptr->qid,
+				       &line_ptr->docno, &line_ptr->rel)) {
+	    chunk->error_line = line_ptr - chunk->lines;
+	    chunk->num_lines = line_ptr - chunk->lines;
+	    return (UNDEF);
+	}
+	line_ptr++;
+    }
+    chunk->num_lines = line_ptr - chunk->lines;
+    return (1);
+}
+
 static int
 parse_qrels_line (char **start_ptr, char **qid_ptr,
 		  char **docno_ptr, char **rel_ptr)
@@ -240,6 +323,7 @@ parse_qrels_line (char **start_ptr, char **qid_ptr,
 int
 te_get_qrels_cleanup ()
 {
+    (void) te_docno_intern_cleanup ();
     if (rel_qid_map != NULL) {
       hashmap_free(rel_qid_map);
       rel_qid_map = NULL;
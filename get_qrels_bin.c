@@ -0,0 +1,383 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "trec_format.h"
+#include "functions.h"
+
+/* Read all relevance information from a qrels_bin file, a binary form of
+a standard qrels file compiled by te_compile_qrels_bin (trec_eval
+--compile_qrels).  The result is identical to reading the original qrels
+file with te_get_qrels, but the file is simply mapped into memory: there is
+no parsing, sorting, or hashing of docnos.
+
+The file consists of a QRELS_BIN_HEADER followed by the sections
+   QRELS_BIN_QID   qids[num_qids]       sorted by qid
+   QRELS_BIN_QREL  qrels[num_qrels]     per query, sorted by docid
+   long            docnos[num_docids]   offset of docid's docno in strtab
+   long            index[index_size]    docno hash index (see docno.c)
+   char            strtab[strtab_size]  NULL terminated qids and docnos
+Docids are assigned in docno order, so each query's qrels are sorted by
+docno as te_get_qrels would sort them.
+Values are stored in the native long size and byte order; a file can only
+be read on machines matching the one it was compiled on.  The docno index
+slots are computed with te_docno_hash, whose width (TE_DOCNO_HASH_BITS) is
+also recorded and checked.
+*/
+
+#define QRELS_BIN_MAGIC "TEQRELSB"
+#define QRELS_BIN_VERSION 2
+#define QRELS_BIN_BYTE_ORDER 0x01020304L
+
+typedef struct {
+    char magic[8];              /* QRELS_BIN_MAGIC (not NULL terminated) */
+    long version;               /* QRELS_BIN_VERSION */
+    long sizeof_long;           /* sizeof (long) of compiling machine */
+    long byte_order;            /* QRELS_BIN_BYTE_ORDER as stored */
+    long hash_bits;             /* TE_DOCNO_HASH_BITS of compiling trec_eval */
+    long num_qids;
+    long num_qrels;
+    long num_docids;
+    long index_size;            /* Power of 2 */
+    long strtab_size;
+} QRELS_BIN_HEADER;
+
+typedef struct {
+    long qid;                   /* Offset of qid in strtab */
+    long start;                 /* Index in qrels of first qrel of qid */
+    long num_qrels;
+} QRELS_BIN_QID;
+
+typedef struct {
+    long docid;
+    long rel;
+} QRELS_BIN_QREL;
+
+typedef struct {                /* Temp for assigning docids in docno order */
+    char *docno;
+    long docid;
+} DOCNO_ID;
+
+static int comp_docno_id ();
+
+/* static pools of memory, allocated here and never changed.
+   Declared static so one day I can write a cleanup procedure to free them */
+static char *qrels_bin_map = NULL;
+static size_t qrels_bin_map_size = 0;
+static TEXT_QRELS_INFO *text_info_pool = NULL;
+static TEXT_QRELS *text_qrels_pool = NULL;
+static REL_INFO *rel_info_pool = NULL;
+static map_t rel_qid_map = NULL;
+
+int
+te_get_qrels_bin (EPI *epi, char *qrels_bin_file, ALL_REL_INFO *all_rel_info)
+{
+    int fd;
+    size_t size = 0;
+    QRELS_BIN_HEADER *header;
+    QRELS_BIN_QID *qids;
+    QRELS_BIN_QREL *qrels;
+    long *docnos;
+    long *index;
+    char *strtab;
+    long i, j;
+    /* current pointers into static pools above */
+    TEXT_QRELS *text_qrels_ptr;
+
+    if (-1 == (fd = open (qrels_bin_file, 0)) ||
+	0 >= (size = lseek (fd, 0L, 2)) ||
+	(char *) -1 == (qrels_bin_map = (char *) mmap (0,
+						       (size_t) size,
+						       PROT_READ,
+						       MAP_PRIVATE,
+						       fd,
+						       (off_t) 0))) {
+	fprintf (stderr,
+		 "trec_eval.get_qrels_bin: Cannot read qrels_bin file '%s'\n",
+		 qrels_bin_file);
+	qrels_bin_map = NULL;
+	return (UNDEF);
+    }
+    qrels_bin_map_size = size;
+    if (-1 == close (fd)) {
+	fprintf (stderr,
+		 "trec_eval.get_qrels_bin: Cannot close qrels_bin file '%s'\n",
+		 qrels_bin_file);
+	return (UNDEF);
+    }
+
+    /* Check header, and that the sections exactly fill the file */
+    header = (QRELS_BIN_HEADER *) qrels_bin_map;
+    if (size < sizeof (QRELS_BIN_HEADER) ||
+	memcmp (header->magic, QRELS_BIN_MAGIC, sizeof (header->magic)) ||
+	header->version != QRELS_BIN_VERSION ||
+	header->sizeof_long != sizeof (long) ||
+	header->byte_order != QRELS_BIN_BYTE_ORDER ||
+	header->hash_bits != TE_DOCNO_HASH_BITS) {
+	fprintf (stderr,
+		 "trec_eval.get_qrels_bin: '%s' is not a qrels_bin file compiled on this machine type\n",
+		 qrels_bin_file);
+	return (UNDEF);
+    }
+    if (header->num_qids <= 0 || header->num_qrels < 0 ||
+	header->num_docids < 0 || header->strtab_size <= 0 ||
+	header->index_size <= header->num_docids ||
+	(header->index_size & (header->index_size - 1)) ||
+	size != sizeof (QRELS_BIN_HEADER) +
+	header->num_qids * sizeof (QRELS_BIN_QID) +
+	header->num_qrels * sizeof (QRELS_BIN_QREL) +
+	(header->num_docids + header->index_size) * sizeof (long) +
+	header->strtab_size) {
+	fprintf (stderr,
+		 "trec_eval.get_qrels_bin: Corrupt qrels_bin file '%s'\n",
+		 qrels_bin_file);
+	return (UNDEF);
+    }
+    qids = (QRELS_BIN_QID *) (header + 1);
+    qrels = (QRELS_BIN_QREL *) (qids + header->num_qids);
+    docnos = (long *) (qrels + header->num_qrels);
+    index = docnos + header->num_docids;
+    strtab = (char *) (index + header->index_size);
+    if (strtab[header->strtab_size - 1] != '\0') {
+	fprintf (stderr,
+		 "trec_eval.get_qrels_bin: Corrupt qrels_bin file '%s'\n",
+		 qrels_bin_file);
+	return (UNDEF);
+    }
+    for (i = 0; i < header->num_docids; i++) {
+	if (docnos[i] < 0 || docnos[i] >= header->strtab_size) {
+	    fprintf (stderr,
+		     "trec_eval.get_qrels_bin: Corrupt qrels_bin file '%s'\n",
+		     qrels_bin_file);
+	    return (UNDEF);
+	}
+    }
+
+    /* Allocate space for queries */
+    if (NULL == (rel_info_pool = Malloc (header->num_qids, REL_INFO)) ||
+	NULL == (text_info_pool = Malloc (header->num_qids,
+					  TEXT_QRELS_INFO)) ||
+	(header->num_qrels > 0 &&
+	 NULL == (text_qrels_pool = Malloc (header->num_qrels,
+					    TEXT_QRELS))) ||
+	NULL == (rel_qid_map = hashmap_new_size ((size_t) header->num_qids)))
+	return (UNDEF);
+
+    /* Go through queries and store all info, pointing at qids and docnos
+       in the mapped strtab */
+    text_qrels_ptr = text_qrels_pool;
+    for (i = 0; i < header->num_qids; i++) {
+	if (qids[i].qid < 0 || qids[i].qid >= header->strtab_size ||
+	    qids[i].start != text_qrels_ptr - text_qrels_pool ||
+	    qids[i].num_qrels < 0 ||
+	    qids[i].start + qids[i].num_qrels > header->num_qrels) {
+	    fprintf (stderr,
+		     "trec_eval.get_qrels_bin: Corrupt qrels_bin file '%s'\n",
+		     qrels_bin_file);
+	    return (UNDEF);
+	}
+	text_info_pool[i].num_text_qrels = qids[i].num_qrels;
+	text_info_pool[i].max_num_text_qrels = qids[i].num_qrels;
+	text_info_pool[i].text_qrels = text_qrels_ptr;
+	rel_info_pool[i] = (REL_INFO) {strtab + qids[i].qid, "qrels",
+				       &text_info_pool[i]};
+	if (MAP_OK != hashmap_put (rel_qid_map, rel_info_pool[i].qid,
+				   &rel_info_pool[i]))
+	    return (UNDEF);
+	for (j = qids[i].start; j < qids[i].start + qids[i].num_qrels; j++) {
+	    if (qrels[j].docid < 0 || qrels[j].docid >= header->num_docids) {
+		fprintf (stderr,
+			 "trec_eval.get_qrels_bin: Corrupt qrels_bin file '%s'\n",
+			 qrels_bin_file);
+		return (UNDEF);
+	    }
+	    text_qrels_ptr->docno = strtab + docnos[qrels[j].docid];
+	    text_qrels_ptr->docid = qrels[j].docid;
+	    text_qrels_ptr->rel = qrels[j].rel;
+	    text_qrels_ptr++;
+	}
+    }
+
+    if (UNDEF == te_docno_attach (header->num_docids, docnos, strtab,
+				  index, header->index_size))
+	return (UNDEF);
+
+    all_rel_info->num_q_rels = header->num_qids;
+    all_rel_info->rel_info = rel_info_pool;
+    all_rel_info->map = rel_qid_map;
+    return (1);
+}
+
+int
+te_get_qrels_bin_cleanup ()
+{
+    (void) te_docno_intern_cleanup ();
+    if (rel_qid_map != NULL) {
+	hashmap_free (rel_qid_map);
+	rel_qid_map = NULL;
+    }
+    if (qrels_bin_map != NULL) {
+	(void) munmap (qrels_bin_map, qrels_bin_map_size);
+	qrels_bin_map = NULL;
+	qrels_bin_map_size = 0;
+    }
+    if (text_info_pool != NULL) {
+	Free (text_info_pool);
+	text_info_pool = NULL;
+    }
+    if (text_qrels_pool != NULL) {
+	Free (text_qrels_pool);
+	text_qrels_pool = NULL;
+    }
+    if (rel_info_pool != NULL) {
+	Free (rel_info_pool);
+	rel_info_pool = NULL;
+    }
+    return (1);
+}
+
+/* Write all_rel_info, as read from a standard qrels file by te_get_qrels,
+   to bin_file in qrels_bin format. */
+int
+te_compile_qrels_bin (const ALL_REL_INFO *all_rel_info, const char *bin_file)
+{
+    FILE *fd;
+    QRELS_BIN_HEADER header;
+    QRELS_BIN_QID *qids;
+    QRELS_BIN_QREL *qrels;
+    long *docnos;
+    long *index;
+    char *strtab;
+    DOCNO_ID *docno_ids;
+    long *new_docid;
+    long num_docids = te_docno_num_docids ();
+    TEXT_QRELS_INFO *text_info;
+    unsigned long slot;
+    long i, j, num_qrels;
+    long strtab_size;
+
+    for (i = 0; i < all_rel_info->num_q_rels; i++) {
+	if (strcmp (all_rel_info->rel_info[i].rel_format, "qrels")) {
+	    fprintf (stderr, "trec_eval.compile_qrels_bin: rel_info must be in 'qrels' format\n");
+	    return (UNDEF);
+	}
+    }
+
+    /* Find the docno of each docid, and renumber docids in docno order */
+    if (NULL == (docno_ids = Malloc (num_docids + 1, DOCNO_ID)) ||
+	NULL == (new_docid = Malloc (num_docids + 1, long)))
+	return (UNDEF);
+    num_qrels = 0;
+    for (i = 0; i < all_rel_info->num_q_rels; i++) {
+	text_info = (TEXT_QRELS_INFO *) all_rel_info->rel_info[i].q_rel_info;
+	for (j = 0; j < text_info->num_text_qrels; j++) {
+	    docno_ids[text_info->text_qrels[j].docid] = (DOCNO_ID)
+		{text_info->text_qrels[j].docno,
+		 text_info->text_qrels[j].docid};
+	}
+	num_qrels += text_info->num_text_qrels;
+    }
+    qsort ((char *) docno_ids,
+	   (int) num_docids,
+	   sizeof (DOCNO_ID),
+	   comp_docno_id);
+    for (i = 0; i < num_docids; i++)
+	new_docid[docno_ids[i].docid] = i;
+
+    /* Lay out string table: qids, then docnos in docid order */
+    strtab_size = 0;
+    for (i = 0; i < all_rel_info->num_q_rels; i++)
+	strtab_size += strlen (all_rel_info->rel_info[i].qid) + 1;
+    for (i = 0; i < num_docids; i++)
+	strtab_size += strlen (docno_ids[i].docno) + 1;
+
+    header.num_qids = all_rel_info->num_q_rels;
+    header.num_qrels = num_qrels;
+    header.num_docids = num_docids;
+    header.index_size = 2;
+    while (header.index_size < 2 * num_docids)
+	header.index_size *= 2;
+    header.strtab_size = strtab_size;
+    if (NULL == (qids = Malloc (header.num_qids, QRELS_BIN_QID)) ||
+	NULL == (qrels = Malloc (num_qrels + 1, QRELS_BIN_QREL)) ||
+	NULL == (docnos = Malloc (num_docids + 1, long)) ||
+	NULL == (index = Malloc (header.index_size, long)) ||
+	NULL == (strtab = Malloc (strtab_size, char)))
+	return (UNDEF);
+
+    strtab_size = 0;
+    num_qrels = 0;
+    for (i = 0; i < all_rel_info->num_q_rels; i++) {
+	text_info = (TEXT_QRELS_INFO *) all_rel_info->rel_info[i].q_rel_info;
+	qids[i].qid = strtab_size;
+	qids[i].start = num_qrels;
+	qids[i].num_qrels = text_info->num_text_qrels;
+	(void) strcpy (strtab + strtab_size, all_rel_info->rel_info[i].qid);
+	strtab_size += strlen (all_rel_info->rel_info[i].qid) + 1;
+	for (j = 0; j < text_info->num_text_qrels; j++) {
+	    qrels[num_qrels].docid =
+		new_docid[text_info->text_qrels[j].docid];
+	    qrels[num_qrels].rel = text_info->text_qrels[j].rel;
+	    num_qrels++;
+	}
+    }
+    (void) memset (index, 0, header.index_size * sizeof (long));
+    for (i = 0; i < num_docids; i++) {
+	docnos[i] = strtab_size;
+	(void) strcpy (strtab + strtab_size, docno_ids[i].docno);
+	strtab_size += strlen (docno_ids[i].docno) + 1;
+	slot = te_docno_hash (docno_ids[i].docno, strlen (docno_ids[i].docno))
+	    & (header.index_size - 1);
+	while (index[slot])
+	    slot = (slot + 1) & (header.index_size - 1);
+	index[slot] = i + 1;
+    }
+
+    (void) memcpy (header.magic, QRELS_BIN_MAGIC, sizeof (header.magic));
+    header.version = QRELS_BIN_VERSION;
+    header.sizeof_long = sizeof (long);
+    header.byte_order = QRELS_BIN_BYTE_ORDER;
+    header.hash_bits = TE_DOCNO_HASH_BITS;
+
+    if (NULL == (fd = fopen (bin_file, "wb")) ||
+	1 != fwrite (&header, sizeof (QRELS_BIN_HEADER), 1, fd) ||
+	header.num_qids != fwrite (qids, sizeof (QRELS_BIN_QID),
+				   header.num_qids, fd) ||
+	header.num_qrels != fwrite (qrels, sizeof (QRELS_BIN_QREL),
+				    header.num_qrels, fd) ||
+	header.num_docids != fwrite (docnos, sizeof (long),
+				     header.num_docids, fd) ||
+	header.index_size != fwrite (index, sizeof (long),
+				     header.index_size, fd) ||
+	header.strtab_size != fwrite (strtab, 1, header.strtab_size, fd) ||
+	0 != fclose (fd)) {
+	fprintf (stderr,
+		 "trec_eval.compile_qrels_bin: Cannot write qrels_bin file '%s'\n",
+		 bin_file);
+	return (UNDEF);
+    }
+
+    Free (docno_ids);
+    Free (new_docid);
+    Free (qids);
+    Free (qrels);
+    Free (docnos);
+    Free (index);
+    Free (strtab);
+    return (1);
+}
+
+static int
+comp_docno_id (ptr1, ptr2)
+DOCNO_ID *ptr1;
+DOCNO_ID *ptr2;
+{
+    return (strcmp (ptr1->docno, ptr2->docno));
+}
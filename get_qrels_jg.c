@@ -9,6 +9,7 @@
 #include "sysfunc.h"
 #include "trec_eval.h"
 #include "trec_format.h"
+#include "functions.h"
 #include <ctype.h>
 
 
@@ -32,6 +33,7 @@ and checked for duplicates (error if any).
 /*
     typedef struct {                    * For each relevance judgement *
         char *docno;                       * document id *
+        long docid;                        * interned docid of docno *
         long rel;                          * document judgement *
     } TEXT_QRELS;
 
@@ -79,6 +81,7 @@ static TEXT_QRELS_JG_INFO *text_jg_info_pool = NULL;
 static TEXT_QRELS_JG *text_jg_pool = NULL;
 static TEXT_QRELS *text_qrels_pool = NULL;
 static REL_INFO *rel_info_pool = NULL;
+static map_t rel_qid_map = NULL;
 
 int
 te_get_qrels_jg (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
@@ -168,7 +171,8 @@ te_get_qrels_jg (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
     if (NULL == (rel_info_pool = Malloc (num_qid, REL_INFO)) ||
 	NULL == (text_jg_info_pool = Malloc (num_qid, TEXT_QRELS_JG_INFO)) ||
 	NULL == (text_jg_pool = Malloc (num_jg, TEXT_QRELS_JG)) ||
-	NULL == (text_qrels_pool = Malloc (num_lines, TEXT_QRELS)))
+	NULL == (text_qrels_pool = Malloc (num_lines, TEXT_QRELS)) ||
+        NULL == (rel_qid_map = hashmap_new_size (num_qid)))
 	return (UNDEF);
 
     rel_info_ptr = rel_info_pool;
@@ -194,6 +198,7 @@ te_get_qrels_jg (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
 	    text_jg_info_ptr->text_qrels_jg = text_jg_ptr;
 	    *rel_info_ptr =
 		(REL_INFO) {current_qid, "qrels_jg", text_jg_info_ptr};
+            hashmap_put(rel_qid_map, rel_info_ptr->qid, rel_info_ptr);
 	    current_jg = lines[i].jg;
 	    text_jg_ptr->text_qrels = text_qrels_ptr;
 	}
@@ -208,6 +213,8 @@ te_get_qrels_jg (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
 	    text_jg_ptr->text_qrels = text_qrels_ptr;
 	}
 	text_qrels_ptr->docno = lines[i].docno;
+	if (UNDEF == (text_qrels_ptr->docid = te_docno_intern (lines[i].docno)))
+	    return (UNDEF);
 	text_qrels_ptr->rel = atol (lines[i].rel);
 	text_qrels_ptr++;
     }
@@ -218,6 +225,7 @@ te_get_qrels_jg (EPI *epi, char *text_qrels_file, ALL_REL_INFO *all_rel_info)
 
     all_rel_info->num_q_rels = num_qid;
     all_rel_info->rel_info = rel_info_pool;
+    all_rel_info->map = rel_qid_map;
     Free (lines);
     return (1);
 }
@@ -273,6 +281,11 @@ parse_qrels_line (char **start_ptr, char **qid_ptr, char **jg_ptr,
 int 
 te_get_qrels_jg_cleanup ()
 {
+    if (rel_qid_map != NULL) {
+      hashmap_free(rel_qid_map);
+      rel_qid_map = NULL;
+    }
+    (void) te_docno_intern_cleanup ();
     if (trec_qrels_buf != NULL) {
 	Free (trec_qrels_buf);
 	trec_qrels_buf = NULL;
@@ -9,6 +9,7 @@
 #include "sysfunc.h"
 #include "trec_eval.h"
 #include "trec_format.h"
+#include "functions.h"
 #include <ctype.h>
 #include <sys/types.h>
 
@@ -33,24 +34,66 @@ The runid is stored, but only from the last content line of the file (no
 check is made that it is consistent throughout).
 */
 
+/* The results file is mmap'd read-only and is never copied or modified.
+   Docnos are kept as (pointer, length) spans into the mapping (see
+   TEXT_RESULTS in trec_format.h); only the qids and the run_id, which are
+   needed as strings elsewhere, are copied out (once per query).  Peak memory
+   is thus roughly the size of the file plus one LINES and one TEXT_RESULTS
+   entry per line; the LINES of each chunk are freed as soon as all of them
+   have been stored.
+   Each docno is also resolved to its interned docid from the rel_info file
+   (see docno.c), which must therefore be read first. */
+
 /* Temp structure for values in input line */
 typedef struct {
     char *qid;
     char *docno;
-    char *sim;
+    double sim;
+    int qid_len;
+    int docno_len;
+    long docid;
 } LINES;
 
-static int parse_results_line (char **start_ptr, char **qid_ptr,
-			       char **docno_ptr, char **sim_ptr,
-			       char **run_id_ptr, int *run_type);
+/* A chunk of whole lines of the file, tokenized independently of the
+   other chunks (possibly in its own thread) */
+typedef struct {
+    char *start_ptr;              /* Start of chunk within buffer */
+    char *end_ptr;                /* End of chunk */
+    LINES *lines;                 /* Malloc'd lines parsed from chunk */
+    long num_lines;
+    char *run_id_ptr;             /* run_id of last 6 field line in chunk */
+    long run_id_len;
+    int run_type;                 /* Format of last line in chunk */
+    long error_line;              /* Index in chunk of malformed line, or -1 */
+    long num_blocks;              /* QID_BLOCKs of chunk not yet stored */
+} CHUNK;
+
+static int parse_results_chunk (void *arg);
+static int parse_results_line (char **start_ptr, char *end_ptr,
+			       LINES *line, char **run_id_ptr,
+			       long *run_id_len, int *run_type);
+
+/* A maximal run of consecutive lines of a chunk with the same qid */
+typedef struct {
+    char *qid;
+    int qid_len;
+    long start;                   /* Index in file of first line in block */
+    long chunk;                   /* Chunk holding the lines of block */
+    LINES *lines;                 /* First line of block */
+    long num_lines;
+} QID_BLOCK;
 
-static int comp_lines_qid_docno ();
+static int comp_blocks_qid ();
 
 int read_stdin(char **ptr, size_t *size);
 
 /* static pools of memory, allocated here and never changed.  
    Declared static so one day I can write a cleanup procedure to free them */
-static char *trec_results_buf = NULL;
+static char *trec_results_buf = NULL;     /* malloc'd buffer (stdin only) */
+static char *trec_results_map = NULL;     /* read-only mmap of results file */
+static size_t trec_results_map_size = 0;
+static char *qid_pool = NULL;
+static char *run_id_buf = NULL;
 static TEXT_RESULTS_INFO *text_info_pool = NULL;
 static TEXT_RESULTS *text_results_pool = NULL;
 static RESULTS *q_results_pool = NULL;
@@ -60,142 +103,242 @@ te_get_trec_results (EPI *epi, char *text_results_file,
 		     ALL_RESULTS *all_results)
 {
     int fd;
-    char *orig_buf;
     size_t size = 0;
-    char *ptr;
+    char *buf;
+    char *end_ptr;
     char *current_qid;
     long i;
     LINES *lines;
     LINES *line_ptr;
     size_t num_lines;
+    long j;
+    CHUNK *chunks;
+    char **chunk_starts;
+    long num_chunks;
+    QID_BLOCK *blocks;
+    QID_BLOCK *block_ptr;
+    long num_blocks;
     long num_qid;
+    size_t qid_pool_size;
     char *run_id_ptr = NULL;
+    long run_id_len = 0;
     int run_type = FMT_TREC;
     /* current pointers into static pools above */
     RESULTS *q_results_ptr;
     TEXT_RESULTS_INFO *text_info_ptr;
     TEXT_RESULTS *text_results_ptr;
+    char *qid_pool_ptr;
 
     if (0 == strcmp(text_results_file, "-")) {
-      if (UNDEF == read_stdin(&trec_results_buf, &size)) {
+      if (UNDEF == read_stdin(&trec_results_buf, &size) || 0 == size) {
  	fprintf (stderr, "trec_eval.get_results: Cannot copy results file stdin\n");
         return (UNDEF);
       }
+      buf = trec_results_buf;
     } else {
-      /* mmap entire file into memory and copy it into writable memory */
+      /* mmap entire file into memory.  The mapping stays read-only and
+	 is used in place until cleanup */
       if (-1 == (fd = open (text_results_file, 0)) ||
           0 >= (size = lseek (fd, 0L, 2)) ||
-          (char *) -1 == (orig_buf = (char *) mmap (0,
+          (char *) -1 == (trec_results_map = (char *) mmap (0,
                                                     (size_t) size,
                                                     PROT_READ,
-                                                    MAP_SHARED,
+                                                    MAP_PRIVATE,
                                                     fd,
                                                     (off_t) 0))) {
 	fprintf (stderr,
 		 "trec_eval.get_results: Cannot read results file '%s'\n",
 		 text_results_file);
+	trec_results_map = NULL;
 	return (UNDEF);
       }
-      if (NULL == (trec_results_buf = malloc ((size_t) size+2))) {
-	fprintf (stderr,
-		 "trec_eval.get_results: Cannot copy results file '%s'\n",
-		 text_results_file);
-	return (UNDEF);
-      }
-      (void) memcpy (trec_results_buf, orig_buf, size);
-      if (-1 == munmap (orig_buf, size) ||
-          -1 == close (fd)) {
+      trec_results_map_size = size;
+      if (-1 == close (fd)) {
 	fprintf (stderr,
 		 "trec_eval.get_results: Cannot close results file '%s'\n",
 		 text_results_file);
 	return (UNDEF);
       }
+      buf = trec_results_map;
     }
+    end_ptr = buf + size;
 
-    /* Append ending newline if not present, Append NULL terminator */
-    if (trec_results_buf[size-1] != '\n') {
-	trec_results_buf[size] = '\n';
-	size++;
+    /* Tokenize the buffer, in epi->num_threads chunks of whole lines
+       parsed concurrently if requested, then merge in chunk order */
+    if (NULL == (chunks = Malloc (epi->num_threads, CHUNK)) ||
+	NULL == (chunk_starts = Malloc (epi->num_threads + 1, char *)))
+	return (UNDEF);
+    num_chunks = te_split_buf (buf, end_ptr, epi->num_threads, chunk_starts);
+    for (i = 0; i < num_chunks; i++) {
+	chunks[i].start_ptr = chunk_starts[i];
+	chunks[i].end_ptr = chunk_starts[i+1];
+	chunks[i].lines = NULL;
+	chunks[i].num_lines = 0;
+	chunks[i].error_line = -1;
+    }
+    if (UNDEF == te_run_threads (parse_results_chunk, chunks, sizeof (CHUNK),
+				 num_chunks)) {
+	num_lines = 0;
+	for (i = 0; i < num_chunks; i++) {
+	    if (chunks[i].error_line >= 0) {
+		fprintf (stderr, "trec_eval.get_results: Malformed line %ld\n",
+			 (long) (num_lines + chunks[i].error_line + 1));
+		break;
+	    }
+	    num_lines += chunks[i].num_lines;
+	}
+	for (i = 0; i < num_chunks; i++) {
+	    if (chunks[i].lines != NULL)
+		Free (chunks[i].lines);
+	}
+	Free (chunks);
+	Free (chunk_starts);
+	return (UNDEF);
     }
-    trec_results_buf[size] = '\0';
 
-    /* Count number of lines in file */
     num_lines = 0;
-    for (ptr = trec_results_buf; *ptr; ptr = index(ptr,'\n')+1)
-	num_lines++;
+    for (i = 0; i < num_chunks; i++) {
+	num_lines += chunks[i].num_lines;
+	if (chunks[i].num_lines > 0)
+	    run_type = chunks[i].run_type;
+	if (chunks[i].run_id_ptr) {
+	    run_id_ptr = chunks[i].run_id_ptr;
+	    run_id_len = chunks[i].run_id_len;
+	}
+    }
+    if (num_lines == 0) {
+	all_results->num_q_results = 0;
+	all_results->results = NULL;
+	Free (chunks);
+	Free (chunk_starts);
+	return (1);
+    }
 
-    /* Get all lines */
-    if (NULL == (lines = Malloc (num_lines, LINES)))
-	return (UNDEF);
-    line_ptr = lines;
-    ptr = trec_results_buf;
-    while (*ptr) {
-	/* Get current line */
-	/* Ignore blank lines (people seem to insist on them!) */
-	while (*ptr && *ptr != '\n' && isspace (*ptr)) ptr++;
-	if (*ptr == '\n') {
-	    ptr++;
-	    continue;
+    /* Find the blocks of consecutive lines with the same qid within each
+       chunk.  Runs are almost always already grouped by qid, giving one
+       block per query (and per chunk boundary), so only the blocks (not
+       all lines) need to be ordered by qid.  The lines stay in the
+       chunks' LINES arrays, which are not merged */
+    num_blocks = 0;
+    for (i = 0; i < num_chunks; i++) {
+	lines = chunks[i].lines;
+	for (j = 0; j < chunks[i].num_lines; j++) {
+	    if (j == 0 || te_docno_cmp (lines[j-1].qid, lines[j-1].qid_len,
+					lines[j].qid, lines[j].qid_len))
+		num_blocks++;
 	}
-	if (UNDEF == parse_results_line (&ptr, &line_ptr->qid,&line_ptr->docno,
-					 &line_ptr->sim, &run_id_ptr, &run_type)) {
-	    fprintf (stderr, "trec_eval.get_results: Malformed line %ld\n",
-		     (long) (line_ptr - lines + 1));
-	    return (UNDEF);
+    }
+    if (NULL == (blocks = Malloc (num_blocks, QID_BLOCK)))
+	return (UNDEF);
+    block_ptr = blocks;
+    num_lines = 0;
+    for (i = 0; i < num_chunks; i++) {
+	lines = chunks[i].lines;
+	chunks[i].num_blocks = 0;
+	for (j = 0; j < chunks[i].num_lines; j++) {
+	    if (j == 0 || te_docno_cmp (lines[j-1].qid, lines[j-1].qid_len,
+					lines[j].qid, lines[j].qid_len)) {
+		block_ptr->qid = lines[j].qid;
+		block_ptr->qid_len = lines[j].qid_len;
+		block_ptr->start = num_lines + j;
+		block_ptr->chunk = i;
+		block_ptr->lines = &lines[j];
+		block_ptr->num_lines = 0;
+		block_ptr++;
+		chunks[i].num_blocks++;
+	    }
+	    block_ptr[-1].num_lines++;
 	}
-	line_ptr++;
+	num_lines += chunks[i].num_lines;
     }
-    num_lines = line_ptr-lines;
 
-    /* Sort all lines by qid, then docno */
-    qsort ((char *) lines,
-	   (int) num_lines,
-	   sizeof (LINES),
-	   comp_lines_qid_docno);
-
-    /* Go through lines and count number of qid */
+    /* Sort blocks by qid (then file position, so lines of a query split
+       across several blocks stay in file order), unless already sorted */
+    for (i = 1; i < num_blocks; i++) {
+	if (comp_blocks_qid (&blocks[i-1], &blocks[i]) > 0)
+	    break;
+    }
+    if (i < num_blocks)
+	qsort ((char *) blocks,
+	       (int) num_blocks,
+	       sizeof (QID_BLOCK),
+	       comp_blocks_qid);
+
+    /* Go through blocks and count number of qid, and space needed to
+       hold copies of the qid strings */
     num_qid = 1;
-    for (i = 1; i < num_lines; i++) {
-	if (strcmp (lines[i-1].qid, lines[i].qid))
+    qid_pool_size = blocks[0].qid_len + 1;
+    for (i = 1; i < num_blocks; i++) {
+	if (te_docno_cmp (blocks[i-1].qid, blocks[i-1].qid_len,
+			  blocks[i].qid, blocks[i].qid_len)) {
 	    /* New query */
 	    num_qid++;
+	    qid_pool_size += blocks[i].qid_len + 1;
+	}
     }
 
     /* Allocate space for queries */
     if (NULL == (q_results_pool = Malloc (num_qid, RESULTS)) ||
 	NULL == (text_info_pool = Malloc (num_qid, TEXT_RESULTS_INFO)) ||
-	NULL == (text_results_pool = Malloc (num_lines, TEXT_RESULTS)))
+	NULL == (text_results_pool = Malloc (num_lines, TEXT_RESULTS)) ||
+	NULL == (qid_pool = Malloc (qid_pool_size, char)))
 	return (UNDEF);
 
+    /* run_id is only kept from the last line (copied since not NULL
+       terminated in the file) */
+    if (run_id_ptr) {
+	if (NULL == (run_id_buf = Malloc (run_id_len + 1, char)))
+	    return (UNDEF);
+	(void) memcpy (run_id_buf, run_id_ptr, run_id_len);
+	run_id_buf[run_id_len] = '\0';
+    }
+
     q_results_ptr = q_results_pool;
     text_info_ptr = text_info_pool;
     text_results_ptr = text_results_pool;
+    qid_pool_ptr = qid_pool;
     
-    /* Go through lines and store all info */
-    current_qid = "";
-    for (i = 0; i < num_lines; i++) {
-	if (strcmp (current_qid, lines[i].qid)) {
+    /* Go through blocks in qid order and store all info */
+    for (block_ptr = blocks; block_ptr < &blocks[num_blocks]; block_ptr++) {
+	if (block_ptr == blocks ||
+	    te_docno_cmp (block_ptr[-1].qid, block_ptr[-1].qid_len,
+			  block_ptr->qid, block_ptr->qid_len)) {
 	    /* New query.  End old query and start new one */
-	    if (i != 0) {
+	    if (block_ptr != blocks) {
 		text_info_ptr->num_text_results =
 		    text_results_ptr - text_info_ptr->text_results;
 		text_info_ptr++;
 		q_results_ptr++;
 	    }
-	    current_qid = lines[i].qid;
+	    current_qid = qid_pool_ptr;
+	    (void) memcpy (qid_pool_ptr, block_ptr->qid, block_ptr->qid_len);
+	    qid_pool_ptr += block_ptr->qid_len;
+	    *qid_pool_ptr++ = '\0';
 	    text_info_ptr->text_results = text_results_ptr;
+	    text_info_ptr->rank_ordered = 0;
 	    *q_results_ptr =
-		(RESULTS) {current_qid, run_id_ptr, "trec_results",
+		(RESULTS) {current_qid, run_id_buf, "trec_results",
 			   text_info_ptr};
 	}
-	text_results_ptr->docno = lines[i].docno;
-        if (run_type == FMT_TREC) {
-          text_results_ptr->sim = atof (lines[i].sim);
-        } else {
-          /* Actually rank */
-          text_results_ptr->sim = -atof (lines[i].sim);
-        }
-	text_results_ptr++;
+	for (line_ptr = block_ptr->lines;
+	     line_ptr < &block_ptr->lines[block_ptr->num_lines];
+	     line_ptr++) {
+	    text_results_ptr->docno = line_ptr->docno;
+	    text_results_ptr->docno_len = line_ptr->docno_len;
+	    text_results_ptr->docid = line_ptr->docid;
+	    if (run_type == FMT_TREC) {
+		text_results_ptr->sim = line_ptr->sim;
+	    } else {
+		/* Actually rank */
+		text_results_ptr->sim = -line_ptr->sim;
+	    }
+	    text_results_ptr++;
+	}
+	/* Free the chunk's lines once all its blocks are stored */
+	if (0 == --chunks[block_ptr->chunk].num_blocks) {
+	    Free (chunks[block_ptr->chunk].lines);
+	    chunks[block_ptr->chunk].lines = NULL;
+	}
     }
     /* End last qid */
     text_info_ptr->num_text_results =
@@ -204,15 +347,349 @@ te_get_trec_results (EPI *epi, char *text_results_file,
     all_results->num_q_results = num_qid;
     all_results->results = q_results_pool;
 
-    Free (lines);
+    Free (blocks);
+    Free (chunks);
+    Free (chunk_starts);
+    return (1);
+}
+
+/* ---------------------------------------------------------------------- */
+/* Streaming interface (--stream).
+   Instead of reading the whole results file, te_get_trec_results_stream_next
+   returns the results of one query at a time, reading the file (or stdin)
+   only as far as the end of that query's block of lines.  The results file
+   must be grouped by qid (each query's lines contiguous); queries are
+   returned in file order.  The RESULTS returned (and everything it points
+   to) is valid only until the next call, so memory use is bounded by the
+   largest query rather than the whole file.
+*/
+#define STREAM_READ_SIZE (1 << 20)
+
+static FILE *stream_fd = NULL;
+static int stream_eof = 0;
+static char *stream_buf = NULL;       /* Unprocessed input.  Block being */
+static long max_stream_buf = 0;       /* returned always starts at 0 */
+static long stream_data_len = 0;      /* Bytes of input in stream_buf */
+static long stream_next_block = 0;    /* Offset of next block's first line */
+static long stream_num_lines = 0;     /* Lines parsed so far (for errors) */
+static LINES *stream_lines = NULL;
+static long max_stream_lines = 0;
+static TEXT_RESULTS *stream_text_results = NULL;
+static long max_stream_text_results = 0;
+static TEXT_RESULTS_INFO stream_text_info;
+static char *stream_run_id = NULL;
+static long max_stream_run_id = 0;
+static map_t stream_seen_qids = NULL; /* Copies of all qids returned */
+
+static int free_seen_qid (any_t item, any_t data);
+
+int
+te_get_trec_results_stream_open (EPI *epi, char *text_results_file)
+{
+    if (0 == strcmp (text_results_file, "-"))
+	stream_fd = stdin;
+    else if (NULL == (stream_fd = fopen (text_results_file, "rb"))) {
+	fprintf (stderr,
+		 "trec_eval.get_results: Cannot read results file '%s'\n",
+		 text_results_file);
+	return (UNDEF);
+    }
+    stream_eof = 0;
+    stream_data_len = 0;
+    stream_next_block = 0;
+    stream_num_lines = 0;
+    if (NULL == (stream_buf = te_chk_and_realloc (stream_buf, &max_stream_buf,
+						   STREAM_READ_SIZE,
+						   sizeof (char))) ||
+	NULL == (stream_seen_qids = hashmap_new ()))
+	return (UNDEF);
     return (1);
 }
 
-static int comp_lines_qid_docno (LINES *ptr1, LINES *ptr2)
+/* Length of the first whitespace delimited token of line ptr..end_ptr
+   (ptr is at the start of the token) */
+static long
+token_len (const char *ptr, const char *end_ptr)
 {
-    int cmp = strcmp (ptr1->qid, ptr2->qid);
+    const char *start = ptr;
+    while (ptr < end_ptr && ! isspace (*ptr)) ptr++;
+    return (ptr - start);
+}
+
+/* Get the next query's results into *results.  Returns 1 if a query was
+   found, 0 at end of input, UNDEF on error */
+int
+te_get_trec_results_stream_next (EPI *epi, RESULTS *results)
+{
+    long scan;                  /* Offset of next line to examine */
+    long block_end = -1;        /* Offset just past last line of block */
+    long qid_off = -1;          /* Offset of block's qid */
+    long qid_len = 0;
+    long i, nl;
+    char *ptr, *end_ptr;
+    char *qid;
+    char *run_id_ptr = NULL;
+    long run_id_len = 0;
+    int run_type = FMT_TREC;
+    LINES *line_ptr;
+    any_t seen;
+
+    /* Discard the previous block */
+    stream_data_len -= stream_next_block;
+    (void) memmove (stream_buf, stream_buf + stream_next_block,
+		    stream_data_len);
+    stream_next_block = 0;
+
+    /* Find the end of the block of lines with the same qid as the first
+       non-blank line, reading more input as needed */
+    scan = 0;
+    while (block_end < 0) {
+	ptr = memchr (stream_buf + scan, '\n', stream_data_len - scan);
+	if (NULL == ptr && ! stream_eof) {
+	    /* Need more input.  Grow buffer if it is full */
+	    if (NULL == (stream_buf = te_chk_and_realloc (stream_buf,
+							   &max_stream_buf,
+							   stream_data_len +
+							   STREAM_READ_SIZE,
+							   sizeof (char))))
+		return (UNDEF);
+	    i = fread (stream_buf + stream_data_len, 1,
+		       max_stream_buf - stream_data_len, stream_fd);
+	    if (i == 0) {
+		if (ferror (stream_fd)) {
+		    fprintf (stderr, "trec_eval.get_results: Cannot read results file\n");
+		    return (UNDEF);
+		}
+		stream_eof = 1;
+	    }
+	    stream_data_len += i;
+	    continue;
+	}
+	nl = (NULL == ptr) ? stream_data_len : ptr - stream_buf;
+	/* Line is scan .. nl.  Skip leading white space and blank lines */
+	ptr = stream_buf + scan;
+	while (ptr < stream_buf + nl && isspace (*ptr)) ptr++;
+	if (ptr < stream_buf + nl) {
+	    i = token_len (ptr, stream_buf + nl);
+	    if (qid_off < 0) {
+		qid_off = ptr - stream_buf;
+		qid_len = i;
+	    }
+	    else if (i != qid_len ||
+		     memcmp (ptr, stream_buf + qid_off, qid_len)) {
+		/* New query starts with this line */
+		block_end = scan;
+		break;
+	    }
+	}
+	if (nl >= stream_data_len) {
+	    /* End of input */
+	    block_end = stream_data_len;
+	    break;
+	}
+	scan = nl + 1;
+    }
+    if (qid_off < 0)
+	/* No more queries */
+	return (0);
+    stream_next_block = block_end;
+
+    /* Queries must not be split over several blocks */
+    if (MAP_OK == hashmap_get_len (stream_seen_qids, stream_buf + qid_off,
+				   (int) qid_len, &seen)) {
+	fprintf (stderr, "trec_eval.get_results: Results for query '%s' are not contiguous; --stream requires results grouped by qid\n",
+		 (char *) seen);
+	return (UNDEF);
+    }
+    if (NULL == (qid = Malloc (qid_len + 1, char)))
+	return (UNDEF);
+    (void) memcpy (qid, stream_buf + qid_off, qid_len);
+    qid[qid_len] = '\0';
+    if (MAP_OK != hashmap_put (stream_seen_qids, qid, qid))
+	return (UNDEF);
+
+    /* Count and parse all lines of block */
+    nl = 1;
+    for (i = 0; i < block_end; i++)
+	if (stream_buf[i] == '\n')
+	    nl++;
+    if (NULL == (stream_lines =
+		 te_chk_and_malloc (stream_lines, &max_stream_lines,
+				    nl, sizeof (LINES))))
+	return (UNDEF);
+    line_ptr = stream_lines;
+    ptr = stream_buf;
+    end_ptr = stream_buf + block_end;
+    while (ptr < end_ptr) {
+	/* Ignore blank lines */
+	while (ptr < end_ptr && *ptr != '\n' && isspace (*ptr)) ptr++;
+	if (ptr >= end_ptr)
+	    break;
+	if (*ptr == '\n') {
+	    ptr++;
+	    continue;
+	}
+	if (UNDEF == parse_results_line (&ptr, end_ptr, line_ptr,
+					 &run_id_ptr, &run_id_len,
+					 &run_type)) {
+	    fprintf (stderr, "trec_eval.get_results: Malformed line %ld\n",
+		     stream_num_lines + (long) (line_ptr - stream_lines) + 1);
+	    return (UNDEF);
+	}
+	line_ptr->docid = te_docno_lookup (line_ptr->docno,
+					   line_ptr->docno_len);
+	line_ptr++;
+    }
+    stream_num_lines += line_ptr - stream_lines;
+
+    /* Store results, in file order as in te_get_trec_results */
+    if (NULL == (stream_text_results =
+		 te_chk_and_malloc (stream_text_results,
+				    &max_stream_text_results,
+				    line_ptr - stream_lines,
+				    sizeof (TEXT_RESULTS))))
+	return (UNDEF);
+    stream_text_info.num_text_results = line_ptr - stream_lines;
+    stream_text_info.max_num_text_results = max_stream_text_results;
+    stream_text_info.text_results = stream_text_results;
+    stream_text_info.rank_ordered = 0;
+    for (i = 0; i < stream_text_info.num_text_results; i++) {
+	stream_text_results[i].docno = stream_lines[i].docno;
+	stream_text_results[i].docno_len = stream_lines[i].docno_len;
+	stream_text_results[i].docid = stream_lines[i].docid;
+	if (run_type == FMT_TREC)
+	    stream_text_results[i].sim = stream_lines[i].sim;
+	else
+	    /* Actually rank */
+	    stream_text_results[i].sim = -stream_lines[i].sim;
+    }
+
+    /* run_id is kept from the last line seen so far */
+    if (run_id_ptr) {
+	if (NULL == (stream_run_id =
+		     te_chk_and_realloc (stream_run_id, &max_stream_run_id,
+					 run_id_len + 1, sizeof (char))))
+	    return (UNDEF);
+	(void) memcpy (stream_run_id, run_id_ptr, run_id_len);
+	stream_run_id[run_id_len] = '\0';
+    }
+
+    *results = (RESULTS) {qid, stream_run_id, "trec_results",
+			  &stream_text_info};
+    return (1);
+}
+
+static int
+free_seen_qid (any_t item, any_t data)
+{
+    Free (data);
+    return (MAP_OK);
+}
+
+int
+te_get_trec_results_stream_cleanup ()
+{
+    if (stream_fd != NULL) {
+	if (stream_fd != stdin)
+	    (void) fclose (stream_fd);
+	stream_fd = NULL;
+    }
+    if (stream_seen_qids != NULL) {
+	(void) hashmap_iterate (stream_seen_qids, free_seen_qid, NULL);
+	hashmap_free (stream_seen_qids);
+	stream_seen_qids = NULL;
+    }
+    if (max_stream_buf > 0) {
+	Free (stream_buf);
+	max_stream_buf = 0;
+    }
+    if (max_stream_lines > 0) {
+	Free (stream_lines);
+	max_stream_lines = 0;
+    }
+    if (max_stream_text_results > 0) {
+	Free (stream_text_results);
+	max_stream_text_results = 0;
+    }
+    if (max_stream_run_id > 0) {
+	Free (stream_run_id);
+	max_stream_run_id = 0;
+    }
+    return (1);
+}
+
+/* Tokenize all lines of a single CHUNK */
+static int
+parse_results_chunk (void *arg)
+{
+    CHUNK *chunk = (CHUNK *) arg;
+    char *ptr;
+    char *end_ptr = chunk->end_ptr;
+    LINES *line_ptr;
+    long num_lines;
+
+    chunk->lines = NULL;
+    chunk->num_lines = 0;
+    chunk->run_id_ptr = NULL;
+    chunk->run_id_len = 0;
+    chunk->run_type = FMT_TREC;
+    chunk->error_line = -1;
+
+    /* Count number of lines in chunk (last line need not end in newline) */
+    num_lines = 0;
+    for (ptr = chunk->start_ptr; ptr < end_ptr; ptr++) {
+	if (NULL == (ptr = memchr (ptr, '\n', end_ptr - ptr)))
+	    break;
+	num_lines++;
+    }
+    if (end_ptr > chunk->start_ptr && end_ptr[-1] != '\n')
+	num_lines++;
+    if (num_lines == 0)
+	return (1);
+
+    /* Get all lines */
+    if (NULL == (chunk->lines = Malloc (num_lines, LINES)))
+	return (UNDEF);
+    line_ptr = chunk->lines;
+    ptr = chunk->start_ptr;
+    while (ptr < end_ptr) {
+	/* Get current line */
+	/* Ignore blank lines (people seem to insist on them!) */
+	while (ptr < end_ptr && *ptr != '\n' && isspace (*ptr)) ptr++;
+	if (ptr >= end_ptr)
+	    break;
+	if (*ptr == '\n') {
+	    ptr++;
+	    continue;
+	}
+	if (UNDEF == parse_results_line (&ptr, end_ptr, line_ptr,
+					 &chunk->run_id_ptr,
+					 &chunk->run_id_len,
+					 &chunk->run_type)) {
+	    chunk->error_line = line_ptr - chunk->lines;
+	    chunk->num_lines = line_ptr - chunk->lines;
+	    return (UNDEF);
+	}
+	/* Resolve docno against the rel_info docnos once, here */
+	line_ptr->docid = te_docno_lookup (line_ptr->docno,
+					   line_ptr->docno_len);
+	line_ptr++;
+    }
+    chunk->num_lines = line_ptr - chunk->lines;
+    if (chunk->num_lines == 0) {
+	Free (chunk->lines);
+	chunk->lines = NULL;
+    }
+    return (1);
+}
+
+static int comp_blocks_qid (QID_BLOCK *ptr1, QID_BLOCK *ptr2)
+{
+    int cmp = te_docno_cmp (ptr1->qid, ptr1->qid_len,
+			    ptr2->qid, ptr2->qid_len);
     if (cmp) return (cmp);
-    return (strcmp (ptr1->docno, ptr2->docno));
+    if (ptr1->start < ptr2->start) return (-1);
+    return (ptr1->start > ptr2->start);
 }
 
 static int iseol(char c)
@@ -220,58 +697,80 @@ static int iseol(char c)
   return c == '\n' || c == '\r';
 }
 
+/* Convert sim field.  The field is bounded by whitespace unless it is the
+   very last thing in the buffer, in which case it must be copied since the
+   mapping cannot be NULL terminated */
+static double
+get_sim (const char *sim_ptr, const long len, const char *end_ptr)
+{
+    char temp_buf[64];
+    long temp_len;
+
+    if (sim_ptr + len < end_ptr)
+	return (atof (sim_ptr));
+    temp_len = MIN (len, (long) sizeof (temp_buf) - 1);
+    (void) memcpy (temp_buf, sim_ptr, temp_len);
+    temp_buf[temp_len] = '\0';
+    return (atof (temp_buf));
+}
+
 static int
-parse_results_line (char **start_ptr, char **qid_ptr, char **docno_ptr,
-		    char **sim_ptr, char **run_id_ptr, int *run_type)
+parse_results_line (char **start_ptr, char *end_ptr, LINES *line,
+		    char **run_id_ptr, long *run_id_len, int *run_type)
 {
     char *ptr = *start_ptr;
     char *ptrs[6] = {NULL, NULL, NULL, NULL, NULL, NULL};
+    long lens[6] = {0, 0, 0, 0, 0, 0};
     int i;
 
     /* skip empty lines */
-    while (iseol(*ptr)) {
+    while (ptr < end_ptr && iseol(*ptr)) {
       ptr++;
     }
 
     for (i = 0; i < sizeof(ptrs) / sizeof(ptrs[0]); i++) {
-      while (isblank(*ptr)) {
+      while (ptr < end_ptr && isblank(*ptr)) {
         ptr++;
       }
-      if (iseol(*ptr)) {
+      if (ptr >= end_ptr || iseol(*ptr)) {
         break;
       }
 
       ptrs[i] = ptr;
 
-      while (!isspace(*ptr)) {
+      while (ptr < end_ptr && !isspace(*ptr)) {
         ptr++;
       }
+      lens[i] = ptr - ptrs[i];
 
       /* Non eol space */
-      if (isblank(*ptr)) {
-        *ptr++ = '\0';
-        continue;
-      } else {
+      if (ptr >= end_ptr || !isblank(*ptr)) {
         break;
       }
     }
 
     /* There are more fields following, ignore. */
-    while (*ptr != '\n') {
+    if (NULL == (ptr = memchr (ptr, '\n', end_ptr - ptr)))
+      ptr = end_ptr;
+    else
       ptr++;
-    }
-    *ptr++ = '\0';
     *start_ptr = ptr;
 
     if (ptrs[2] != NULL && ptrs[3] == NULL) {
-      *qid_ptr = ptrs[0];
-      *docno_ptr = ptrs[1];
-      *sim_ptr = ptrs[2];
+      line->qid = ptrs[0];
+      line->qid_len = lens[0];
+      line->docno = ptrs[1];
+      line->docno_len = lens[1];
+      line->sim = get_sim (ptrs[2], lens[2], end_ptr);
       *run_type = FMT_ANS;
     } else if (ptrs[5] != NULL) {
-      *qid_ptr = ptrs[0];
-      *docno_ptr = ptrs[2];
-      *sim_ptr = ptrs[4];
+      line->qid = ptrs[0];
+      line->qid_len = lens[0];
+      line->docno = ptrs[2];
+      line->docno_len = lens[2];
+      line->sim = get_sim (ptrs[4], lens[4], end_ptr);
+      *run_id_ptr = ptrs[5];
+      *run_id_len = lens[5];
       *run_type = FMT_TREC;
     } else {
       return UNDEF;
@@ -283,10 +782,24 @@ parse_results_line (char **start_ptr, char **qid_ptr, char **docno_ptr,
 int 
 te_get_trec_results_cleanup ()
 {
+    (void) te_get_trec_results_stream_cleanup ();
     if (trec_results_buf != NULL) {
 	Free (trec_results_buf);
 	trec_results_buf = NULL;
     }
+    if (trec_results_map != NULL) {
+	(void) munmap (trec_results_map, trec_results_map_size);
+	trec_results_map = NULL;
+	trec_results_map_size = 0;
+    }
+    if (qid_pool != NULL) {
+	Free (qid_pool);
+	qid_pool = NULL;
+    }
+    if (run_id_buf != NULL) {
+	Free (run_id_buf);
+	run_id_buf = NULL;
+    }
     if (text_info_pool != NULL) {
 	Free (text_info_pool);
 	text_info_pool = NULL;
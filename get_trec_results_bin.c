@@ -0,0 +1,423 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "trec_format.h"
+#include "functions.h"
+
+/* Read all retrieved results information from a trec_results_bin file, a
+binary columnar form of a trec_results file written by
+te_compile_results_bin (trec_eval --compile_results), or directly by a
+ranker.  Evaluation gives results identical to the original text file, but
+the file is mapped into memory with no parsing, and each query's results
+are already in rank order, so te_form_res_rels does not sort them.
+
+The file consists of a RESULTS_BIN_HEADER followed by the sections
+   double          sims[num_results]       sim of each result
+   long            docnos[num_results]     offset of its docno in strtab
+   long            docno_lens[num_results] length of its docno
+   RESULTS_BIN_QID qids[num_qids]          sorted by qid
+   char            strtab[strtab_size]     NULL terminated qids, docnos
+                                           and run_id
+The results of each query are contiguous and in rank order: decreasing
+sim, with ties broken by decreasing docno (as trec_eval itself breaks
+them).  A query's results must not contain duplicate docnos.  For runs in
+the Anserini 3 field format (which give ranks rather than sims), sims are
+the negated ranks.
+Values are stored in the native long size, double format and byte order;
+a file can only be read on machines matching the one that wrote it.
+*/
+
+/* Declarations in trec_eval.h (generic results info) and trec_format.h
+   (trec_results specific info) for the output format, as for
+   te_get_trec_results.  The results info of every query is rank_ordered. */
+
+#define RESULTS_BIN_MAGIC "TERESBIN"
+#define RESULTS_BIN_VERSION 1
+#define RESULTS_BIN_BYTE_ORDER 0x01020304L
+
+typedef struct {
+    char magic[8];              /* RESULTS_BIN_MAGIC (not NULL terminated) */
+    long version;               /* RESULTS_BIN_VERSION */
+    long sizeof_long;           /* sizeof (long) of writing machine */
+    long byte_order;            /* RESULTS_BIN_BYTE_ORDER as stored */
+    long num_qids;
+    long num_results;
+    long run_id;                /* Offset of run_id in strtab, or -1 */
+    long strtab_size;
+    long reserved;              /* 0.  Keeps sims 8 byte aligned */
+} RESULTS_BIN_HEADER;
+
+typedef struct {
+    long qid;                   /* Offset of qid in strtab */
+    long start;                 /* Index of first result of qid */
+    long num_results;
+} RESULTS_BIN_QID;
+
+/* A range of results whose docids are looked up (possibly in its own
+   thread) */
+typedef struct {
+    long start;
+    long end;
+} CHUNK;
+
+static int lookup_docids_chunk (void *arg);
+static int comp_sim_docno (), comp_docno ();
+
+/* static pools of memory, allocated here and never changed.
+   Declared static so one day I can write a cleanup procedure to free them */
+static char *results_bin_map = NULL;
+static size_t results_bin_map_size = 0;
+static TEXT_RESULTS_INFO *text_info_pool = NULL;
+static TEXT_RESULTS *text_results_pool = NULL;
+static RESULTS *q_results_pool = NULL;
+
+/* Columns of the mapped file, for lookup_docids_chunk */
+static double *bin_sims;
+static long *bin_docnos;
+static long *bin_docno_lens;
+static char *bin_strtab;
+
+int
+te_get_trec_results_bin (EPI *epi, char *results_bin_file,
+			 ALL_RESULTS *all_results)
+{
+    int fd;
+    size_t size = 0;
+    RESULTS_BIN_HEADER *header;
+    RESULTS_BIN_QID *qids;
+    char *run_id;
+    CHUNK *chunks;
+    long num_chunks;
+    long i;
+
+    if (-1 == (fd = open (results_bin_file, 0)) ||
+	0 >= (size = lseek (fd, 0L, 2)) ||
+	(char *) -1 == (results_bin_map = (char *) mmap (0,
+							 (size_t) size,
+							 PROT_READ,
+							 MAP_PRIVATE,
+							 fd,
+							 (off_t) 0))) {
+	fprintf (stderr,
+		 "trec_eval.get_results_bin: Cannot read results file '%s'\n",
+		 results_bin_file);
+	results_bin_map = NULL;
+	return (UNDEF);
+    }
+    results_bin_map_size = size;
+    if (-1 == close (fd)) {
+	fprintf (stderr,
+		 "trec_eval.get_results_bin: Cannot close results file '%s'\n",
+		 results_bin_file);
+	return (UNDEF);
+    }
+
+    /* Check header, and that the sections exactly fill the file */
+    header = (RESULTS_BIN_HEADER *) results_bin_map;
+    if (size < sizeof (RESULTS_BIN_HEADER) ||
+	memcmp (header->magic, RESULTS_BIN_MAGIC, sizeof (header->magic)) ||
+	header->version != RESULTS_BIN_VERSION ||
+	header->sizeof_long != sizeof (long) ||
+	header->byte_order != RESULTS_BIN_BYTE_ORDER) {
+	fprintf (stderr,
+		 "trec_eval.get_results_bin: '%s' is not a trec_results_bin file written on this machine type\n",
+		 results_bin_file);
+	return (UNDEF);
+    }
+    if (header->num_qids < 0 || header->num_results < 0 ||
+	header->strtab_size <= 0 ||
+	header->run_id < -1 || header->run_id >= header->strtab_size ||
+	size != sizeof (RESULTS_BIN_HEADER) +
+	header->num_results * (sizeof (double) + 2 * sizeof (long)) +
+	header->num_qids * sizeof (RESULTS_BIN_QID) +
+	header->strtab_size) {
+	fprintf (stderr,
+		 "trec_eval.get_results_bin: Corrupt results file '%s'\n",
+		 results_bin_file);
+	return (UNDEF);
+    }
+    bin_sims = (double *) (header + 1);
+    bin_docnos = (long *) (bin_sims + header->num_results);
+    bin_docno_lens = bin_docnos + header->num_results;
+    qids = (RESULTS_BIN_QID *) (bin_docno_lens + header->num_results);
+    bin_strtab = (char *) (qids + header->num_qids);
+    if (bin_strtab[header->strtab_size - 1] != '\0') {
+	fprintf (stderr,
+		 "trec_eval.get_results_bin: Corrupt results file '%s'\n",
+		 results_bin_file);
+	return (UNDEF);
+    }
+    for (i = 0; i < header->num_results; i++) {
+	if (bin_docnos[i] < 0 || bin_docno_lens[i] <= 0 ||
+	    bin_docnos[i] + bin_docno_lens[i] >= header->strtab_size) {
+	    fprintf (stderr,
+		     "trec_eval.get_results_bin: Corrupt results file '%s'\n",
+		     results_bin_file);
+	    return (UNDEF);
+	}
+    }
+    run_id = header->run_id >= 0 ? bin_strtab + header->run_id : NULL;
+
+    if (header->num_qids == 0) {
+	all_results->num_q_results = 0;
+	all_results->results = NULL;
+	return (1);
+    }
+
+    /* Allocate space for queries */
+    if (NULL == (q_results_pool = Malloc (header->num_qids, RESULTS)) ||
+	NULL == (text_info_pool = Malloc (header->num_qids,
+					  TEXT_RESULTS_INFO)) ||
+	NULL == (text_results_pool = Malloc (header->num_results + 1,
+					     TEXT_RESULTS)))
+	return (UNDEF);
+
+    /* Fill in the results (text_results_pool[i] is result i of the file),
+       looking up the docid of each docno, in epi->num_threads chunks */
+    num_chunks = MIN (epi->num_threads, header->num_results / (1 << 16));
+    if (num_chunks < 1)
+	num_chunks = 1;
+    if (NULL == (chunks = Malloc (num_chunks, CHUNK)))
+	return (UNDEF);
+    for (i = 0; i < num_chunks; i++) {
+	chunks[i].start = header->num_results * i / num_chunks;
+	chunks[i].end = header->num_results * (i + 1) / num_chunks;
+    }
+    if (UNDEF == te_run_threads (lookup_docids_chunk, chunks, sizeof (CHUNK),
+				 num_chunks))
+	return (UNDEF);
+    Free (chunks);
+
+    /* Go through queries and store all info */
+    for (i = 0; i < header->num_qids; i++) {
+	if (qids[i].qid < 0 || qids[i].qid >= header->strtab_size ||
+	    qids[i].start < 0 || qids[i].num_results < 0 ||
+	    qids[i].start + qids[i].num_results > header->num_results ||
+	    (i > 0 && strcmp (bin_strtab + qids[i-1].qid,
+			      bin_strtab + qids[i].qid) >= 0)) {
+	    fprintf (stderr,
+		     "trec_eval.get_results_bin: Corrupt results file '%s'\n",
+		     results_bin_file);
+	    return (UNDEF);
+	}
+	text_info_pool[i].num_text_results = qids[i].num_results;
+	text_info_pool[i].max_num_text_results = qids[i].num_results;
+	text_info_pool[i].text_results = &text_results_pool[qids[i].start];
+	text_info_pool[i].rank_ordered = 1;
+	q_results_pool[i] = (RESULTS) {bin_strtab + qids[i].qid, run_id,
+				       "trec_results", &text_info_pool[i]};
+    }
+
+    all_results->num_q_results = header->num_qids;
+    all_results->results = q_results_pool;
+    return (1);
+}
+
+static int
+lookup_docids_chunk (void *arg)
+{
+    CHUNK *chunk = (CHUNK *) arg;
+    TEXT_RESULTS *text_results_ptr = &text_results_pool[chunk->start];
+    long i;
+
+    for (i = chunk->start; i < chunk->end; i++) {
+	text_results_ptr->docno = bin_strtab + bin_docnos[i];
+	text_results_ptr->docno_len = bin_docno_lens[i];
+	text_results_ptr->docid = te_docno_lookup (text_results_ptr->docno,
+						   text_results_ptr->docno_len);
+	text_results_ptr->sim = bin_sims[i];
+	text_results_ptr++;
+    }
+    return (1);
+}
+
+int
+te_get_trec_results_bin_cleanup ()
+{
+    if (results_bin_map != NULL) {
+	(void) munmap (results_bin_map, results_bin_map_size);
+	results_bin_map = NULL;
+	results_bin_map_size = 0;
+    }
+    if (text_info_pool != NULL) {
+	Free (text_info_pool);
+	text_info_pool = NULL;
+    }
+    if (text_results_pool != NULL) {
+	Free (text_results_pool);
+	text_results_pool = NULL;
+    }
+    if (q_results_pool != NULL) {
+	Free (q_results_pool);
+	q_results_pool = NULL;
+    }
+    return (1);
+}
+
+/* Write all_results, as read from a trec_results file (standard or
+   Anserini format) by te_get_trec_results, to bin_file in
+   trec_results_bin format.  Each query's results are put in rank order;
+   it is an error for a query to retrieve the same docno twice. */
+int
+te_compile_results_bin (const ALL_RESULTS *all_results, const char *bin_file)
+{
+    FILE *fd;
+    RESULTS_BIN_HEADER header;
+    RESULTS_BIN_QID *qids;
+    TEXT_RESULTS *ranked;
+    long max_ranked = 0;
+    TEXT_RESULTS_INFO *text_info;
+    double *sims;
+    long *docnos;
+    long *docno_lens;
+    char *strtab;
+    char *run_id = NULL;
+    long num_results, strtab_size;
+    long i, j;
+
+    /* Size sections */
+    num_results = 0;
+    strtab_size = 0;
+    for (i = 0; i < all_results->num_q_results; i++) {
+	text_info = (TEXT_RESULTS_INFO *) all_results->results[i].q_results;
+	strtab_size += strlen (all_results->results[i].qid) + 1;
+	for (j = 0; j < text_info->num_text_results; j++)
+	    strtab_size += text_info->text_results[j].docno_len + 1;
+	num_results += text_info->num_text_results;
+	if (all_results->results[i].run_id)
+	    run_id = all_results->results[i].run_id;
+    }
+    if (run_id)
+	strtab_size += strlen (run_id) + 1;
+    if (strtab_size == 0)
+	strtab_size = 1;
+
+    header.num_qids = all_results->num_q_results;
+    header.num_results = num_results;
+    header.strtab_size = strtab_size;
+    if (NULL == (qids = Malloc (header.num_qids + 1, RESULTS_BIN_QID)) ||
+	NULL == (sims = Malloc (num_results + 1, double)) ||
+	NULL == (docnos = Malloc (num_results + 1, long)) ||
+	NULL == (docno_lens = Malloc (num_results + 1, long)) ||
+	NULL == (strtab = Malloc (strtab_size, char)))
+	return (UNDEF);
+    strtab[0] = '\0';
+
+    /* Lay out each query (in qid order) in rank order */
+    strtab_size = 0;
+    num_results = 0;
+    for (i = 0; i < all_results->num_q_results; i++) {
+	text_info = (TEXT_RESULTS_INFO *) all_results->results[i].q_results;
+	qids[i].qid = strtab_size;
+	qids[i].start = num_results;
+	qids[i].num_results = text_info->num_text_results;
+	(void) strcpy (strtab + strtab_size, all_results->results[i].qid);
+	strtab_size += strlen (all_results->results[i].qid) + 1;
+
+	if (NULL == (ranked = te_chk_and_malloc (ranked, &max_ranked,
+						 text_info->num_text_results,
+						 sizeof (TEXT_RESULTS))))
+	    return (UNDEF);
+	(void) memcpy (ranked, text_info->text_results,
+		       text_info->num_text_results * sizeof (TEXT_RESULTS));
+
+	/* Sorted by docno, duplicates are adjacent */
+	qsort ((char *) ranked,
+	       (int) text_info->num_text_results,
+	       sizeof (TEXT_RESULTS),
+	       comp_docno);
+	for (j = 1; j < text_info->num_text_results; j++) {
+	    if (0 == te_docno_cmp (ranked[j-1].docno, ranked[j-1].docno_len,
+				   ranked[j].docno, ranked[j].docno_len)) {
+		fprintf (stderr, "trec_eval.compile_results_bin: duplicate docs %.*s in query %s\n",
+			 (int) ranked[j].docno_len, ranked[j].docno,
+			 all_results->results[i].qid);
+		return (UNDEF);
+	    }
+	}
+	qsort ((char *) ranked,
+	       (int) text_info->num_text_results,
+	       sizeof (TEXT_RESULTS),
+	       comp_sim_docno);
+
+	for (j = 0; j < text_info->num_text_results; j++) {
+	    sims[num_results] = ranked[j].sim;
+	    docnos[num_results] = strtab_size;
+	    docno_lens[num_results] = ranked[j].docno_len;
+	    (void) memcpy (strtab + strtab_size, ranked[j].docno,
+			   ranked[j].docno_len);
+	    strtab_size += ranked[j].docno_len;
+	    strtab[strtab_size++] = '\0';
+	    num_results++;
+	}
+    }
+    header.run_id = -1;
+    if (run_id) {
+	header.run_id = strtab_size;
+	(void) strcpy (strtab + strtab_size, run_id);
+    }
+
+    (void) memcpy (header.magic, RESULTS_BIN_MAGIC, sizeof (header.magic));
+    header.version = RESULTS_BIN_VERSION;
+    header.sizeof_long = sizeof (long);
+    header.byte_order = RESULTS_BIN_BYTE_ORDER;
+    header.reserved = 0;
+
+    if (NULL == (fd = fopen (bin_file, "wb")) ||
+	1 != fwrite (&header, sizeof (RESULTS_BIN_HEADER), 1, fd) ||
+	header.num_results != fwrite (sims, sizeof (double),
+				      header.num_results, fd) ||
+	header.num_results != fwrite (docnos, sizeof (long),
+				      header.num_results, fd) ||
+	header.num_results != fwrite (docno_lens, sizeof (long),
+				      header.num_results, fd) ||
+	header.num_qids != fwrite (qids, sizeof (RESULTS_BIN_QID),
+				   header.num_qids, fd) ||
+	header.strtab_size != fwrite (strtab, 1, header.strtab_size, fd) ||
+	0 != fclose (fd)) {
+	fprintf (stderr,
+		 "trec_eval.compile_results_bin: Cannot write results file '%s'\n",
+		 bin_file);
+	return (UNDEF);
+    }
+
+    if (max_ranked > 0)
+	Free (ranked);
+    Free (qids);
+    Free (sims);
+    Free (docnos);
+    Free (docno_lens);
+    Free (strtab);
+    return (1);
+}
+
+/* Rank order, as in te_form_res_rels: decreasing sim, ties broken by
+   decreasing docno */
+static int
+comp_sim_docno (ptr1, ptr2)
+TEXT_RESULTS *ptr1;
+TEXT_RESULTS *ptr2;
+{
+    if (ptr1->sim > ptr2->sim)
+	return (-1);
+    if (ptr1->sim < ptr2->sim)
+	return (1);
+    return (te_docno_cmp (ptr2->docno, ptr2->docno_len,
+			  ptr1->docno, ptr1->docno_len));
+}
+
+static int
+comp_docno (ptr1, ptr2)
+TEXT_RESULTS *ptr1;
+TEXT_RESULTS *ptr2;
+{
+    return (te_docno_cmp (ptr1->docno, ptr1->docno_len,
+			  ptr2->docno, ptr2->docno_len));
+}
@@ -5,12 +5,16 @@
  *
  * Modified by Pete Warden to fix a serious performance problem, support strings as keys
  * and removed thread synchronization - http://petewarden.typepad.com
+ *
+ * Reimplemented for trec_eval as an open addressing table storing the hash
+ * and length of each key, with no limit on probe length.
  */
 #ifndef __HASHMAP_H__
 #define __HASHMAP_H__
 
+#include <stddef.h>
+
 #define MAP_MISSING -3  /* No such element */
-#define MAP_FULL -2 	/* Hashmap is full */
 #define MAP_OMEM -1 	/* Out of Memory */
 #define MAP_OK 0 	/* OK */
 
@@ -38,6 +42,13 @@ typedef any_t map_t;
 */
 extern map_t hashmap_new();
 
+/*
+ * Return an empty hashmap that can hold num_keys elements without
+ * growing (eg, when building a map from a known number of keys).
+ * Returns NULL on failure.
+ */
+extern map_t hashmap_new_size(size_t num_keys);
+
 /*
  * Iteratively call f with argument (item, data) for
  * each element data in the hashmap. The function must
@@ -48,7 +59,9 @@ extern map_t hashmap_new();
 extern int hashmap_iterate(map_t in, PFany f, any_t item);
 
 /*
- * Add an element to the hashmap. Return MAP_OK or MAP_OMEM.
+ * Add an element to the hashmap, replacing the element of an equal key.
+ * key is not copied and must stay valid while in the map.
+ * Return MAP_OK or MAP_OMEM.
  */
 extern int hashmap_put(map_t in, char* key, any_t value);
 
@@ -57,6 +70,12 @@ extern int hashmap_put(map_t in, char* key, any_t value);
  */
 extern int hashmap_get(map_t in, char* key, any_t *arg);
 
+/*
+ * Get an element from the hashmap using a key of len characters that
+ * need not be NULL terminated. Return MAP_OK or MAP_MISSING.
+ */
+extern int hashmap_get_len(map_t in, const char* key, int len, any_t *arg);
+
 /*
  * Remove an element from the hashmap. Return MAP_OK or MAP_MISSING.
  */
@@ -76,6 +95,6 @@ extern void hashmap_free(map_t in);
 /*
  * Get the current size of a hashmap
  */
-extern int hashmap_length(map_t in);
+extern size_t hashmap_length(map_t in);
 
 #endif // __HASHMAP_H__
@@ -0,0 +1,91 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+#ifndef LIBTRECEVALH
+#define LIBTRECEVALH
+
+/* libtrec_eval: trec_eval measures for a program that produces rankings
+   itself (eg a training loop), without writing runs to files.
+
+   A TE_CTX evaluation context holds a set of relevance judgements (qrels),
+   the measures requested, compiled into a plan on first use, and the
+   values accumulated over the queries evaluated so far.  Rankings are
+   evaluated from memory, one query at a time:
+
+       TE_CTX *ctx = te_ctx_new ();
+       te_ctx_add_measure (ctx, "map");
+       te_ctx_add_measure (ctx, "ndcg_cut.10");
+       te_ctx_load_qrels (ctx, "qrels");
+       num_values = te_ctx_num_values (ctx);
+       for each query:
+           te_ctx_eval_query (ctx, qid, num_docs, docnos, scores, values);
+       te_ctx_summary (ctx, values);
+       te_ctx_free (ctx);
+
+   The values of a query are exactly those trec_eval prints for the same
+   ranking given as a trec_results file (documents are ranked by
+   decreasing score, ties by decreasing docno), and the summary is the
+   trec_eval summary of the queries evaluated.
+
+   Only the measures of the "qrels" rel_info format (eg those of
+   "all_trec") that print nothing of their own are available; runid and
+   relstring are not.  Zscores are not supported.
+
+   Contexts are independent: different threads may each use their own
+   context at the same time.  A single context must only be used by one
+   thread at a time.
+
+   Procedures returning int return -1 on error (after printing a message
+   to stderr).
+*/
+
+typedef struct te_ctx TE_CTX;
+
+/* New context with no judgements or measures, or NULL on error */
+TE_CTX *te_ctx_new ();
+
+/* Set evaluation option, as given on the trec_eval command line:
+     "relevance_level" (-l), "judged_docs_only" (-J),
+     "average_complete" (-c), "num_docs_in_coll" (-N),
+     "max_num_docs_per_topic" (-M) */
+int te_ctx_set_option (TE_CTX *ctx, const char *option, long value);
+
+/* Request a measure, nickname (eg "official") or measure with parameters
+   (eg "P.5,10"), as for trec_eval -m.  Must be done before the plan is
+   compiled */
+int te_ctx_add_measure (TE_CTX *ctx, const char *measure);
+
+/* Add the judgement rel of docno for query qid, or every judgement of a
+   qrels file ("qid iter docno rel" lines).  Must be done before the plan
+   is compiled */
+int te_ctx_add_qrel (TE_CTX *ctx, const char *qid, const char *docno,
+		     long rel);
+int te_ctx_load_qrels (TE_CTX *ctx, const char *qrels_file);
+
+/* Compile the plan (if not yet done) and return the number of values
+   calculated for each query, or -1 on error.  Value i is named
+   te_ctx_value_name (ctx, i) (eg "ndcg_cut_10"), NULL if out of range */
+long te_ctx_num_values (TE_CTX *ctx);
+const char *te_ctx_value_name (TE_CTX *ctx, long i);
+
+/* Evaluate the ranking of query qid given by num_docs docnos and their
+   scores, storing its te_ctx_num_values values in values (if not NULL),
+   and accumulate them into the summary.  Returns 0 if qid has no
+   judgements (the query is then ignored, as by trec_eval), else 1 */
+int te_ctx_eval_query (TE_CTX *ctx, const char *qid, long num_docs,
+		       const char **docnos, const double *scores,
+		       double *values);
+
+/* Store the summary values of the queries evaluated since the context
+   was created or reset.  Returns the number of queries summarized */
+long te_ctx_summary (TE_CTX *ctx, double *values);
+
+/* Forget the queries evaluated, keeping judgements and plan */
+int te_ctx_reset (TE_CTX *ctx);
+
+void te_ctx_free (TE_CTX *ctx);
+
+#endif /* LIBTRECEVALH */
@@ -10,7 +10,6 @@
 #include "trec_eval.h"
 #include "functions.h"
 #include "trec_format.h"
-double log2(double x);
 
 static int 
 te_calc_Rndcg (const EPI *epi, const REL_INFO *rel_info,
@@ -48,7 +47,7 @@ TREC_MEAS te_meas_Rndcg =
     respectively (level 3 remains at the default).\n\
     Gains are allowed to be 0 or negative, and relevance level 0\n\
     can be given a gain.\n",
-    te_init_meas_s_double_p_pair,
+    te_init_meas_s_double_p_gains,
     te_calc_Rndcg,
     te_acc_meas_s,
     te_calc_avg_meas_s,
@@ -57,199 +56,71 @@ TREC_MEAS te_meas_Rndcg =
     &default_ndcg_gains, -1
 };
 
-/* Keep track of valid rel_levels and associated gains */
-/* Initialized in setup_gains */
-typedef struct {
-    long rel_level;
-    long num_at_level;
-    double gain;
-} REL_GAIN;
-
-typedef struct {
-    REL_GAIN *rel_gains;
-    long num_gains;
-    long total_num_at_levels;
-} GAINS;
-
-static int setup_gains (const TREC_MEAS *tm, const RES_RELS *res_rels,
-			GAINS *gains);
-static double get_gain (const long rel_level, const GAINS *gains);
-static int comp_rel_gain ();
-
 static int 
 te_calc_Rndcg (const EPI *epi, const REL_INFO *rel_info,
 	       const RESULTS *results, const TREC_MEAS *tm, TREC_EVAL *eval)
 {
-    RES_RELS res_rels;
-    double results_gain, results_dcg;
-    double old_ideal_gain, ideal_gain, ideal_dcg;
+    GAINS gains;
     double sum = 0.0;
     long num_changed_ideal_gain;
-    long cur_level, num_at_level;
-    long i;
-    GAINS gains;
+    long num_ret, num_both, i;
    
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &res_rels))
+    if (UNDEF == te_form_gains (epi, rel_info, results, tm, &gains))
 	return (UNDEF);
 
-    if (UNDEF == setup_gains (tm, &res_rels, &gains))
-	return (UNDEF);
-
-    if (res_rels.num_rel == 0)
+    if (gains.res_rels.num_rel == 0)
 	return (0);
+    num_ret = gains.res_rels.num_ret;
 
-    results_dcg = 0.0;
-    ideal_dcg = 0.0;
-    cur_level = gains.num_gains - 1;
-    ideal_gain = (cur_level >= 0) ? gains.rel_gains[cur_level].gain : 0.0;
-    old_ideal_gain = ideal_gain;
+    /* Ranks at which the ideal ranking is walked along with the retrieved
+       one, through its first doc without a positive gain */
+    num_both = gains.num_ideal > 0 ? MIN (num_ret, gains.num_ideal + 1) : 0;
     num_changed_ideal_gain = 0;
-    num_at_level = 0;
-    
-    for (i = 0; i < res_rels.num_ret && ideal_gain > 0.0; i++) {
-	/* Calculate change in results dcg */
-	results_gain = get_gain (res_rels.results_rel_list[i], &gains);
-	/* Calculate change in ideal dcg */
-	num_at_level++;
-	while (cur_level >= 0 &&
-	       num_at_level > gains.rel_gains[cur_level].num_at_level) {
-	    num_at_level = 1;
-	    cur_level--;
-	    ideal_gain = (cur_level >= 0) ? gains.rel_gains[cur_level].gain:0.0;
-	}
+
+    for (i = 0; i < num_both; i++) {
 	/* See if at boundary for changed ideal gain - if so, calc ndcg at
 	   this point for later averaging */
-	if (old_ideal_gain != ideal_gain) {
-	    if (ideal_dcg > 0.0) {
-		sum += results_dcg / ideal_dcg;
-		num_changed_ideal_gain++;
-	    }
-	    old_ideal_gain = ideal_gain;
+	if (i > 0 && TE_IDEAL_GAIN (&gains, i) != gains.ideal_gain[i-1]) {
+	    sum += gains.results_dcg[i] / gains.ideal_dcg[i];
+	    num_changed_ideal_gain++;
 	}
-	if (results_gain != 0)
-	    /* Note: i+2 since doc i has rank i+1 */
-	    results_dcg += results_gain / log2((double) (i+2));
-	if (ideal_gain > 0.0)
-	    ideal_dcg += ideal_gain / log2((double)(i + 2));
 	if (epi->debug_level > 0) 
 	    printf("Rndcg: %ld %ld %3.1f %6.4f %3.1f %6.4f %6.4f\n",
-		   i, cur_level, results_gain, results_dcg,
-		   ideal_gain, ideal_dcg, sum);
+		   i, TE_IDEAL_LEVEL (&gains, i),
+		   TE_GAIN (&gains, gains.res_rels.results_rel_list[i]),
+		   gains.results_dcg[i+1], TE_IDEAL_GAIN (&gains, i),
+		   gains.ideal_dcg[MIN (i+1, gains.num_ideal)], sum);
     }
-    if (i < res_rels.num_ret) {
-	while (i < res_rels.num_ret) {
-	    /* Calculate change in results dcg */
-	    results_gain = get_gain (res_rels.results_rel_list[i], &gains);
-	    if (results_gain != 0)
-		results_dcg += results_gain / log2((double) (i+2));
-	    if (epi->debug_level > 0) 
+    if (i < num_ret) {
+	/* Rest of the retrieved docs */
+	if (epi->debug_level > 0) {
+	    for (; i < num_ret; i++)
 		printf("Rndcg: %ld %ld %3.1f %6.4f %3.1f %6.4f\n",
-		       i, cur_level, results_gain, results_dcg, 0.0, ideal_dcg);
-	    i++;
+		       i, TE_IDEAL_LEVEL (&gains, i),
+		       TE_GAIN (&gains, gains.res_rels.results_rel_list[i]),
+		       gains.results_dcg[i+1], 0.0,
+		       gains.ideal_dcg[gains.num_ideal]);
 	}
-	if (ideal_dcg > 0.0) {
-	    sum += results_dcg / ideal_dcg;
+	i = num_ret;
+	if (gains.ideal_dcg[gains.num_ideal] > 0.0) {
+	    sum += gains.results_dcg[num_ret] /
+		gains.ideal_dcg[gains.num_ideal];
 	    num_changed_ideal_gain++;
 	}
     }
-    while (ideal_gain > 0.0) {
-	/* Calculate change in ideal dcg */
-	num_at_level++;
-	while (cur_level >= 0 &&
-	       num_at_level > gains.rel_gains[cur_level].num_at_level) {
-	    num_at_level = 1;
-	    cur_level--;
-	    ideal_gain = (cur_level >= 0) ? gains.rel_gains[cur_level].gain:0.0;
-	}
-	/* See if at boundary for changed ideal gain - if so, calc ndcg at
-	   this point for later averaging */
-	if (old_ideal_gain != ideal_gain) {
-	    if (ideal_dcg > 0.0) {
-		sum += results_dcg / ideal_dcg;
-		num_changed_ideal_gain++;
-	    }
-	    old_ideal_gain = ideal_gain;
+    /* Rest of the ideal ranking */
+    for (; gains.num_ideal > 0 && i <= gains.num_ideal; i++) {
+	if (i > 0 && TE_IDEAL_GAIN (&gains, i) != gains.ideal_gain[i-1]) {
+	    sum += gains.results_dcg[num_ret] / gains.ideal_dcg[i];
+	    num_changed_ideal_gain++;
 	}
-	if (ideal_gain > 0.0)
-	    ideal_dcg += ideal_gain / log2((double)(i + 2));
 	if (epi->debug_level > 0) 
 	    printf("Rndcg: %ld %ld %3.1f %6.4f %3.1f %6.4f\n",
-		   i, cur_level, 0.0, results_dcg,
-		   ideal_gain, ideal_dcg);
-	i++;
+		   i, TE_IDEAL_LEVEL (&gains, i), 0.0,
+		   gains.results_dcg[num_ret], TE_IDEAL_GAIN (&gains, i),
+		   gains.ideal_dcg[MIN (i+1, gains.num_ideal)]);
     }
 
     eval->values[tm->eval_index].value = sum / num_changed_ideal_gain;
-
-    Free (gains.rel_gains);
     return (1);
 }
-
-static int
-setup_gains (const TREC_MEAS *tm, const RES_RELS *res_rels, GAINS *gains)
-{
-    DOUBLE_PARAM_PAIR *pairs = NULL;
-    long num_pairs = 0;
-    long i,j;
-    long num_gains;
-
-    if (tm->meas_params) {
-	pairs = (DOUBLE_PARAM_PAIR *) tm->meas_params->param_values;
-	num_pairs = tm->meas_params->num_params;
-    }
-
-    if (NULL == (gains->rel_gains = Malloc(res_rels->num_rel_levels + num_pairs,
-					   REL_GAIN)))
-	return (UNDEF);
-    num_gains = 0;
-    for (i = 0; i < num_pairs; i++) {
-	gains->rel_gains[num_gains].rel_level = atol (pairs[i].name);
-	gains->rel_gains[num_gains].gain = (double) pairs[i].value;
-	gains->rel_gains[num_gains].num_at_level = 0;
-	num_gains++;
-    }
-
-    for (i = 0; i < res_rels->num_rel_levels; i++) {
-	for (j = 0; j < num_gains && gains->rel_gains[j].rel_level != i; j++)
-	    ;
-	if (j < num_gains)
-	    /* Was included in list of parameters. Update occurrence info */
-	    gains->rel_gains[j].num_at_level = res_rels->rel_levels[i];
-	else {
-	    /* Not included in list of parameters. New gain level */
-	    gains->rel_gains[num_gains].rel_level = i;
-	    gains->rel_gains[num_gains].gain = (double) i;
-	    gains->rel_gains[num_gains].num_at_level = res_rels->rel_levels[i];
-	    num_gains++;
-	}
-    }
-
-    /* Sort gains by increasing gain value */
-    qsort ((char *) gains->rel_gains,
-           (int) num_gains,
-           sizeof (REL_GAIN),
-           comp_rel_gain);
-
-    gains->total_num_at_levels = 0;
-    for (i = 0; i < num_gains; i++)
-	gains->total_num_at_levels += gains->rel_gains[i].num_at_level;	
-
-    gains->num_gains = num_gains;
-    return (1);
-}
-
-static int comp_rel_gain (REL_GAIN *ptr1, REL_GAIN *ptr2)
-{
-    return (ptr1->gain - ptr2->gain);
-}
-
-static double
-get_gain (const long rel_level, const GAINS *gains)
-{
-    long i;
-    for (i = 0; i < gains->num_gains; i++)
-	if (rel_level == gains->rel_gains[i].rel_level)
-	    return (gains->rel_gains[i].gain);
-    return (0.0);   /* Print Error ?? */
-}
-
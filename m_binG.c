@@ -10,7 +10,6 @@
 #include "trec_eval.h"
 #include "functions.h"
 #include "trec_format.h"
-double log2(double x);
 
 static int
 te_calc_binG (const EPI *epi, const REL_INFO *rel_info,
@@ -38,20 +37,22 @@ static int
 te_calc_binG (const EPI *epi, const REL_INFO *rel_info, const RESULTS *results,
 	     const TREC_MEAS *tm, TREC_EVAL *eval)
 {
-    RES_RELS res_rels;
+    GAINS gains;
     double sum;
     long rel_so_far;
     long i;
 
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &res_rels))
+    /* Only the rank discounts of the gains are used */
+    if (UNDEF == te_form_gains (epi, rel_info, results, tm, &gains))
 	return (UNDEF);
 
     rel_so_far = 0;
     sum = 0.0;
-    for (i = 0; i < res_rels.num_ret; i++) {
-	if (res_rels.results_rel_list[i] >= epi->relevance_level) {
+    for (i = 0; i < gains.res_rels.num_ret; i++) {
+	if (gains.res_rels.results_rel_list[i] >= epi->relevance_level) {
 	    rel_so_far++;
-	    sum += (double) 1.0 / (double) log2 ((double) (3 + i - rel_so_far));
+	    /* log2 (2 + num_nonrel before doc) */
+	    sum += (double) 1.0 / gains.log2_rank[1 + i - rel_so_far];
 	    if (epi->debug_level > 0) 
 		printf("binG: %ld %ld %6.4f\n",
 		       i, rel_so_far, sum);
@@ -60,7 +61,7 @@ te_calc_binG (const EPI *epi, const REL_INFO *rel_info, const RESULTS *results,
     /* Average over the rel docs */
     if (rel_so_far) {
 	eval->values[tm->eval_index].value = 
-	    sum / (double) res_rels.num_rel;
+	    sum / (double) gains.res_rels.num_rel;
     }
     return (1);
 }
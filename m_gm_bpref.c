@@ -38,55 +38,17 @@ static int
 te_calc_gm_bpref (const EPI *epi, const REL_INFO *rel_info,
 		  const RESULTS *results, const TREC_MEAS *tm, TREC_EVAL *eval)
 {
-    RES_RELS res_rels;
-    long j;
-    long nonrel_so_far, rel_so_far, pool_unjudged_so_far;
-    long num_nonrel = 0;
-    double bpref = 0.0;
+    RANK_STATS rs;
+    double bpref;
 
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &res_rels))
+    if (UNDEF == te_form_rank_stats (epi, rel_info, results, &rs))
 	return (UNDEF);
 
-    for (j = 0; j < epi->relevance_level; j++)
-	num_nonrel += res_rels.rel_levels[j];
-
-    /* Calculate judgement based measures (dependent on only
-       judged docs; no assumption of non-relevance if not judged) */
     /* Binary Preference measures; here expressed as all docs with a higher 
-       value of rel are to be preferred.  Optimize by keeping track of nonrel
-       seen so far */
-    nonrel_so_far = 0;
-    rel_so_far = 0;
-    pool_unjudged_so_far = 0;
-    for (j = 0; j < res_rels.num_ret; j++) {
-	if (res_rels.results_rel_list[j] == RELVALUE_NONPOOL)
-	    /* document not in pool. Skip */
-	    continue;
-	if (res_rels.results_rel_list[j] == RELVALUE_UNJUDGED) {
-	    /* document in pool but unjudged. */
-	    pool_unjudged_so_far++;
-	    continue;
-	}
-
-	if (res_rels.results_rel_list[j] >= 0 &&
-	    res_rels.results_rel_list[j] < epi->relevance_level)
-	    nonrel_so_far++;
-	else {
-	    /* Judged Rel doc */
-	    rel_so_far++;
-	    /* Add fraction of correct preferences. */
-	    /* Special case nonrel_so_far == 0 to avoid division by 0 */
-	    if (nonrel_so_far > 0) {
-		bpref += 1.0 - 
-		    (((double) MIN (nonrel_so_far, res_rels.num_rel)) /
-		     (double) MIN (num_nonrel, res_rels.num_rel));
-	    }
-	    else
-		bpref += 1.0;
-	}
-    }
-    if (res_rels.num_rel)
-	bpref /= res_rels.num_rel;
+       value of rel are to be preferred (see te_form_rank_stats) */
+    bpref = rs.bpref;
+    if (rs.res_rels.num_rel)
+	bpref /= rs.res_rels.num_rel;
 
     /* Original measure value is constrained to be greater than
        MIN_GEO_MEAN (for time being .00001, since trec_eval prints to
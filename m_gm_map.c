@@ -39,25 +39,15 @@ static int
 te_calc_gm_map (const EPI *epi, const REL_INFO *rel_info,
 		const RESULTS *results, const TREC_MEAS *tm, TREC_EVAL *eval)
 {
-    RES_RELS res_rels;
+    RANK_STATS rs;
     double sum;
-    long rel_so_far;
-    long i;
 
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &res_rels))
+    if (UNDEF == te_form_rank_stats (epi, rel_info, results, &rs))
 	return (UNDEF);
 
-    rel_so_far = 0;
-    sum = 0.0;
-    for (i = 0; i < res_rels.num_ret; i++) {
-	if (res_rels.results_rel_list[i] >= epi->relevance_level) {
-	    rel_so_far++;
-	    sum += (double) rel_so_far / (double) (i + 1);
-	}
-    }
-
-    if (rel_so_far) {
-	sum = sum / (double) res_rels.num_rel;
+    sum = rs.sum_prec[rs.num_rel_ranked];
+    if (rs.num_rel_ranked) {
+	sum = sum / (double) rs.res_rels.num_rel;
     }
     eval->values[tm->eval_index].value =
 	(double) log ((double)(MAX (sum, MIN_GEO_MEAN)));
@@ -49,54 +49,24 @@ te_calc_iprec_at_recall (const EPI *epi, const REL_INFO *rel_info,
 			 TREC_EVAL *eval)
 {
     double *cutoff_percents = (double *) tm->meas_params->param_values;
-    long *cutoffs;    /* cutoffs expressed in num rel docs instead of percents*/
-    long current_cut; /* current index into cutoffs */
-    RES_RELS rr;
-    long rel_so_far;
+    long cutoff;      /* cutoff expressed in num rel docs instead of percent*/
+    RANK_STATS rs;
     long i;
-    double precis, int_precis;
 
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &rr))
+    if (UNDEF == te_form_rank_stats (epi, rel_info, results, &rs))
 	return (UNDEF);
 
     /* translate percentage of rels as given in the measure params, to
        an actual cutoff number of docs.  Note addition of 0.9 
        means the default 11 percentages should have same cutoffs as
-       historical MAP implementations (eg, old trec_eval) */
-    if (NULL == (cutoffs = Malloc (tm->meas_params->num_params, long)))
-	return (UNDEF);
-    for (i = 0; i < tm->meas_params->num_params; i++)
-	cutoffs[i] = (long) (cutoff_percents[i] * rr.num_rel+0.9);
-
-    current_cut = tm->meas_params->num_params - 1;
-    while (current_cut >= 0 && cutoffs[current_cut] > rr.num_rel_ret)
-	current_cut--;
-
-    /* Loop over all retrieved docs in reverse order.  Needs to be
-       reverse order since are calcualting interpolated precision.
+       historical MAP implementations (eg, old trec_eval).
        Int_Prec (X) defined to be MAX (Prec (Y)) for all Y >= X. */
-    precis = (double) rr.num_rel_ret / (double) rr.num_ret;
-    int_precis = precis;
-    rel_so_far = rr.num_rel_ret;
-    for (i = rr.num_ret; i > 0 && rel_so_far > 0; i--) {
-	precis = (double) rel_so_far / (double) i;
-	if (int_precis < precis)
-	    int_precis = precis;
-	if (rr.results_rel_list[i-1] >= epi->relevance_level) {
-            while (current_cut >= 0 && rel_so_far == cutoffs[current_cut]) {
-		eval->values[tm->eval_index+current_cut].value = int_precis;
-                current_cut--;
-            }
-            rel_so_far--;
-	}
+    for (i = 0; i < tm->meas_params->num_params; i++) {
+	cutoff = (long) (cutoff_percents[i] * rs.res_rels.num_rel+0.9);
+	if (cutoff <= rs.res_rels.num_rel_ret)
+	    eval->values[tm->eval_index+i].value =
+		rs.int_prec[MAX (cutoff, 0)];
     }
 
-    while (current_cut >= 0) {
-	eval->values[tm->eval_index+current_cut].value = int_precis;
-	current_cut--;
-    }
-
-    (void) Free (cutoffs);
-
     return (1);
 }
@@ -9,11 +9,12 @@
 #include "trec_eval.h"
 #include "functions.h"
 #include "trec_format.h"
-double log2(double x);
 
 static int 
 te_calc_ndcg_cut (const EPI *epi, const REL_INFO *rel_info,
 		  const RESULTS *results, const TREC_MEAS *tm, TREC_EVAL *eval);
+static void print_debug (const EPI *epi, const TREC_MEAS *tm,
+			 const GAINS *gains);
 static long long_cutoff_array[] = {5, 10, 15, 20, 30, 100, 200, 500, 1000};
 static PARAMS default_ndcg_cutoffs = {
     NULL, sizeof (long_cutoff_array) / sizeof (long_cutoff_array[0]),
@@ -45,83 +46,71 @@ te_calc_ndcg_cut (const EPI *epi, const REL_INFO *rel_info,
 		  const RESULTS *results, const TREC_MEAS *tm, TREC_EVAL *eval)
 {
     long  *cutoffs = (long *) tm->meas_params->param_values;
-    long cutoff_index = 0;
-    RES_RELS res_rels;
-    double gain, sum;
-    double ideal_dcg;          /* ideal discounted cumulative gain */
-    long cur_lvl, lvl_count;
-    long i;
+    long cutoff_index;
+    GAINS gains;
+    double dcg, ideal_dcg;
    
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &res_rels))
+    /* Gains are the relevance values (the default gains) */
+    if (UNDEF == te_form_gains (epi, rel_info, results, tm, &gains))
 	return (UNDEF);
 
-    sum = 0.0;
-    for (i = 0; i < res_rels.num_ret; i++) {
-        if (i == cutoffs[cutoff_index]) {
-            /* Calculate previous cutoff threshold.
-             Note i guaranteed to be positive by init_meas */
-            eval->values[tm->eval_index + cutoff_index].value = sum;
-            if (++cutoff_index == tm->meas_params->num_params)
-                break;
-	    if (epi->debug_level > 0) 
-		printf("ndcg_cut: cutoff %ld dcg %6.4f\n", i, sum);
-        }
-	gain = res_rels.results_rel_list[i];
-	if (gain > 0) {
-	    /* Note: i+2 since doc i has rank i+1 */
-	    sum += gain / log2((double) (i+2));
-	    if (epi->debug_level > 1) 
-		printf("ndcg_cut:%ld %3.1f %6.4f\n", i, gain, sum);
-	}
-    }
-    /* calculate values for those cutoffs not achieved */
-    while (cutoff_index < tm->meas_params->num_params) {
-	eval->values[tm->eval_index + cutoff_index].value = sum;
-	if (epi->debug_level > 0) 
-	    printf("ndcg_cut: cutoff %ld dcg %6.4f\n",
-		   cutoffs[cutoff_index], sum);
-        cutoff_index++;
+    /* Normalize the dcg at each cutoff by the ideal dcg at that cutoff.
+       Cutoffs past the end of either ranking get the full dcg */
+    for (cutoff_index = 0; cutoff_index < tm->meas_params->num_params;
+	 cutoff_index++) {
+	dcg = gains.results_dcg[MIN (cutoffs[cutoff_index],
+				     gains.res_rels.num_ret)];
+	ideal_dcg = gains.ideal_dcg[MIN (cutoffs[cutoff_index],
+					 gains.num_ideal)];
+	eval->values[tm->eval_index + cutoff_index].value = dcg;
+	if (ideal_dcg > 0.0) 
+	    eval->values[tm->eval_index + cutoff_index].value /= ideal_dcg;
     }
-    /* Calculate ideal discounted cumulative gain for this topic, and 
-     normalize previous sum by it */
+    if (epi->debug_level > 0)
+	print_debug (epi, tm, &gains);
+    return (1);
+}
+
+/* Debug output: the dcg of the retrieved docs and then the ideal dcg,
+   each walked up to the last cutoff */
+static void
+print_debug (const EPI *epi, const TREC_MEAS *tm, const GAINS *gains)
+{
+    long  *cutoffs = (long *) tm->meas_params->param_values;
+    long num_params = tm->meas_params->num_params;
+    long cutoff_index;
+    double gain;
+    long i;
+
     cutoff_index = 0;
-    cur_lvl = res_rels.num_rel_levels - 1;
-    lvl_count = 0;
-    ideal_dcg = 0.0;
-    for (i = 0; 1; i++) {
-	lvl_count++;
-	while (cur_lvl > 0 && lvl_count > res_rels.rel_levels[cur_lvl]) {
-	    cur_lvl--;
-	    lvl_count = 1;
+    for (i = 0; i < gains->res_rels.num_ret; i++) {
+	if (i == cutoffs[cutoff_index]) {
+	    if (++cutoff_index == num_params)
+		break;
+	    printf("ndcg_cut: cutoff %ld dcg %6.4f\n",
+		   i, gains->results_dcg[i]);
 	}
-	if (cur_lvl == 0)
-	    break;
-
-        if (i == cutoffs[cutoff_index]) {
-            /* Calculate previous cutoff threshold.
-             Note i guaranteed to be positive by init_meas */
-	    if (ideal_dcg > 0.0) 
-		eval->values[tm->eval_index + cutoff_index].value /= ideal_dcg;
-	    if (epi->debug_level > 0)
-		printf("ndcg_cut: cutoff %ld idcg %6.4f\n", i, ideal_dcg);
-            if (++cutoff_index == tm->meas_params->num_params)
-                break;
-        }
-	gain = cur_lvl;
-	ideal_dcg += gain / (double) log2((double)(i + 2));
-	if (epi->debug_level > 0) 
-	    printf("ndcg_cut:%ld %ld %3.1f %6.4f\n",i, cur_lvl, gain,ideal_dcg);
+	gain = TE_GAIN (gains, gains->res_rels.results_rel_list[i]);
+	if (gain > 0.0 && epi->debug_level > 1)
+	    printf("ndcg_cut:%ld %3.1f %6.4f\n",
+		   i, gain, gains->results_dcg[i+1]);
     }
+    for (; cutoff_index < num_params; cutoff_index++)
+	printf("ndcg_cut: cutoff %ld dcg %6.4f\n", cutoffs[cutoff_index],
+	       gains->results_dcg[gains->res_rels.num_ret]);
 
-    /* calculate values for those cutoffs not achieved */
-    while (cutoff_index < tm->meas_params->num_params) {
-	if (ideal_dcg > 0.0) 
-	    eval->values[tm->eval_index + cutoff_index].value /= ideal_dcg;
-	if (epi->debug_level > 0)
+    cutoff_index = 0;
+    for (i = 0; i < gains->num_ideal; i++) {
+	if (i == cutoffs[cutoff_index]) {
 	    printf("ndcg_cut: cutoff %ld idcg %6.4f\n",
-		   cutoffs[cutoff_index], ideal_dcg);
-        cutoff_index++;
+		   i, gains->ideal_dcg[i]);
+	    if (++cutoff_index == num_params)
+		break;
+	}
+	printf("ndcg_cut:%ld %ld %3.1f %6.4f\n", i, gains->ideal_rel[i],
+	       gains->ideal_gain[i], gains->ideal_dcg[i+1]);
     }
-
-    return (1);
+    for (; cutoff_index < num_params; cutoff_index++)
+	printf("ndcg_cut: cutoff %ld idcg %6.4f\n", cutoffs[cutoff_index],
+	       gains->ideal_dcg[gains->num_ideal]);
 }
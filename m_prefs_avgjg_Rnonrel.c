@@ -164,7 +164,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	   to the code in form_prefs_count for now */
 	long i,j;
 	long first_discarded_nonrel;
-	unsigned char **a = jg->prefs_array.array;
+	const PREFS_ARRAY *pa = &jg->prefs_array;
 	long num_nonrel_seen = 0;
 	long num_judged = jg->prefs_array.num_judged;
 
@@ -183,7 +183,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	    for (j = 0; j < i; j++) {
 		if (j >= first_discarded_nonrel && jg->rel_array[j] == 0.0)
 		    continue;
-		if (a[i][j]) {
+		if (PA_TEST (pa, i, j)) {
 		    /* Pref not fulfilled.  Area A2 (see comment at top) */
 		    num_poss++;
 		}
@@ -191,7 +191,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	    for (j = i+1; j < num_judged_ret; j++) {
 		if (j >= first_discarded_nonrel && jg->rel_array[j] == 0.0)
 		    continue;
-		if (a[i][j]) {
+		if (PA_TEST (pa, i, j)) {
 		    /* Pref fulfilled.  Area A1 (see comment at top) */
 		    num_ful++;
 		}
@@ -199,7 +199,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	    for (j = num_judged_ret; j < num_judged; j++) {
 		if (j >= first_discarded_nonrel && jg->rel_array[j] == 0.0)
 		    continue;
-		if (a[i][j]) {
+		if (PA_TEST (pa, i, j)) {
 		    /* Pref fulfilled implied.  Area A3 (see comment at top) */
 		    num_ful++;
 		}
@@ -211,7 +211,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	    for (j = 0; j < num_judged_ret; j++) {
 		if (j >= first_discarded_nonrel && jg->rel_array[j] == 0.0)
 		    continue;
-		if (a[i][j]) {
+		if (PA_TEST (pa, i, j)) {
 		    /* Pref not fulfilled implied.  Area A4 (see comment at top) */
 		    num_poss++;
 		}
@@ -219,7 +219,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	    for (j = num_judged_ret; j < num_judged; j++) {
 		if (j >= first_discarded_nonrel && jg->rel_array[j] == 0.0)
 		    continue;
-		if (a[i][j]) {
+		if (PA_TEST (pa, i, j)) {
 		    /* Pref not occur at all.  Area A5 (see comment at top) */
 		    num_poss++;
 		}
@@ -169,7 +169,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	   to the code in form_prefs_count for now */
 	long i,j;
 	long first_discarded_nonrel;
-	unsigned char **a = jg->prefs_array.array;
+	const PREFS_ARRAY *pa = &jg->prefs_array;
 	long num_nonrel_seen = 0;
 
 	for (i = 0; i < num_judged_ret; i++) {
@@ -187,7 +187,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	    for (j = 0; j < i; j++) {
 		if (j >= first_discarded_nonrel && jg->rel_array[j] == 0.0)
 		    continue;
-		if (a[i][j]) {
+		if (PA_TEST (pa, i, j)) {
 		    /* Pref not fulfilled.  Area A2 (see comment at top) */
 		    num_poss++;
 		}
@@ -195,7 +195,7 @@ recalculate (const JG *jg, const long num_judged_ret, long *ret_num_ful,
 	    for (j = i+1; j < num_judged_ret; j++) {
 		if (j >= first_discarded_nonrel && jg->rel_array[j] == 0.0)
 		    continue;
-		if (a[i][j]) {
+		if (PA_TEST (pa, i, j)) {
 		    /* Pref fulfilled.  Area A1 (see comment at top) */
 		    num_ful++;
 		}
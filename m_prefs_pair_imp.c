@@ -43,33 +43,45 @@ te_calc_prefs_pair_imp (const EPI *epi, const REL_INFO *rel_info,
 			TREC_EVAL *eval)
 {
     RESULTS_PREFS rp;
-    long i, j;
+    JG *jg;
+    PAIR_COUNTS *pc;
     double sum = 0;
     long num_pairs = 0;
 
     if (UNDEF == form_prefs_counts (epi, rel_info, results, &rp))
 	return (UNDEF);
 
-    for (i = 0; i < rp.num_judged_ret; i++) {
-	for (j = i+1; j < rp.num_judged_ret; j++) {
-	    if (rp.pref_counts.array[i][j] ||
-		rp.pref_counts.array[j][i]) {
+    if (rp.num_jgs == 1) {
+	/* Only one JG (eg graded qrels): each doc pair has one preference,
+	   so its ratio is 1 or 0 and the JG counts give the sums directly
+	   without forming the pair counts */
+	jg = rp.jgs;
+	sum = (double) (jg->num_prefs_fulfilled_ret +
+			jg->num_prefs_fulfilled_imp);
+	num_pairs = jg->num_prefs_possible_ret + jg->num_prefs_possible_imp;
+    }
+    else {
+	if (UNDEF == form_prefs_pair_counts (epi, rel_info, results, &rp))
+	    return (UNDEF);
+	/* Pairs are sorted by docid_rank1, docid_rank2 (docid_rank1 <
+	   docid_rank2).  Both retrieved */
+	for (pc = rp.pref_counts.pairs;
+	     pc < &rp.pref_counts.pairs[rp.pref_counts.num_pairs]; pc++) {
+	    if (pc->docid_rank2 < rp.num_judged_ret) {
 		num_pairs++;
-		sum += (double) rp.pref_counts.array[i][j] /
-		    (double) (rp.pref_counts.array[i][j] +
-			     rp.pref_counts.array[j][i]);
+		sum += (double) pc->count12 /
+		    (double) (pc->count12 + pc->count21);
 	    }
 	}
-    }
 
-    for (i = 0; i < rp.num_judged_ret; i++) {
-	for (j = rp.num_judged_ret; j < rp.num_judged; j++) {
-	    if (rp.pref_counts.array[i][j] ||
-		rp.pref_counts.array[j][i]) {
+	/* docid_rank1 retrieved, docid_rank2 not */
+	for (pc = rp.pref_counts.pairs;
+	     pc < &rp.pref_counts.pairs[rp.pref_counts.num_pairs]; pc++) {
+	    if (pc->docid_rank1 < rp.num_judged_ret &&
+		pc->docid_rank2 >= rp.num_judged_ret) {
 		num_pairs++;
-		sum += (double) rp.pref_counts.array[i][j] /
-		    (double) (rp.pref_counts.array[i][j] +
-			     rp.pref_counts.array[j][i]);
+		sum += (double) pc->count12 /
+		    (double) (pc->count12 + pc->count21);
 	    }
 	}
     }
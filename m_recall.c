@@ -43,34 +43,18 @@ te_calc_recall (const EPI *epi, const REL_INFO *rel_info,
 		const RESULTS *results, const TREC_MEAS *tm, TREC_EVAL *eval)
 {
     long *cutoffs = (long *) tm->meas_params->param_values;
-    long cutoff_index = 0;
     long i;
-    RES_RELS res_rels;
-    long rel_so_far = 0;
+    RANK_STATS rs;
 
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &res_rels))
+    if (UNDEF == te_form_rank_stats (epi, rel_info, results, &rs))
 	return (UNDEF);
 
-    if (0 == res_rels.num_rel)
+    if (0 == rs.res_rels.num_rel)
 	return (0);
 
-    for (i = 0; i < res_rels.num_ret; i++) {
-	if (i == cutoffs[cutoff_index]) {
-	    /* Calculate previous cutoff threshold.
-	     Note cutoffs guaranteed to be positive by init_meas */
-	    eval->values[tm->eval_index + cutoff_index].value =
-		(double) rel_so_far / (double) res_rels.num_rel;
-	    if (++cutoff_index == tm->meas_params->num_params)
-		break;
-	}
-	if (res_rels.results_rel_list[i] >= epi->relevance_level)
-	    rel_so_far++;
-    }
-    /* calculate values for those cutoffs not achieved */
-    while (cutoff_index < tm->meas_params->num_params) {
-	eval->values[tm->eval_index + cutoff_index].value =
-	    (double) rel_so_far / (double) res_rels.num_rel;
-	cutoff_index++;
-    }
+    for (i = 0; i < tm->meas_params->num_params; i++)
+	eval->values[tm->eval_index + i].value =
+	    (double) rs.rel_so_far[MIN (cutoffs[i], rs.res_rels.num_ret)] /
+	    (double) rs.res_rels.num_rel;
     return (1);
 }
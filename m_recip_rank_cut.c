@@ -42,34 +42,21 @@ te_calc_recip_rank_cut (const EPI *epi, const REL_INFO *rel_info,
                         TREC_EVAL *eval)
 {
     long *cutoffs = (long *) tm->meas_params->param_values;
-    long cutoff_index = 0;
-    RES_RELS res_rels;
+    RANK_STATS rs;
     long i;
-    double value = 0.0;
 
-    if (UNDEF == te_form_res_rels (epi, rel_info, results, &res_rels))
+    if (UNDEF == te_form_rank_stats (epi, rel_info, results, &rs))
 	return (UNDEF);
 
-    if (res_rels.num_rel == 0)
+    if (rs.res_rels.num_rel == 0)
 	return (0);
 
-    for (i = 0; i < res_rels.num_ret; i++) {
-	if (i == cutoffs[cutoff_index]) {
-	    /* Calculate previous cutoff threshold.
-	       Note all guaranteed to be positive by init_meas */
-            eval->values[tm->eval_index + cutoff_index].value = value;
-            if (++cutoff_index == tm->meas_params->num_params)
-		break;
-	}
-
-	if (value == 0.0 && res_rels.results_rel_list[i] >= epi->relevance_level)
-            value = (double) 1.0 / (double) (i+1);
-    }
-    /* calculate values for those cutoffs not achieved */
-    while (cutoff_index < tm->meas_params->num_params) {
-        eval->values[tm->eval_index+cutoff_index].value = value;
-	cutoff_index++;
+    for (i = 0; i < tm->meas_params->num_params; i++) {
+	if (rs.first_rel_rank && rs.first_rel_rank <= cutoffs[i])
+	    eval->values[tm->eval_index + i].value =
+		(double) 1.0 / (double) rs.first_rel_rank;
+	else
+	    eval->values[tm->eval_index + i].value = 0.0;
     }
-
     return (1);
 }
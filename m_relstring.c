@@ -82,7 +82,8 @@ te_calc_relstring (const EPI *epi, const REL_INFO *rel_info,
 static int
 te_print_q_relstring (const EPI *epi, const TREC_MEAS *tm,const TREC_EVAL *eval)
 {
-    printf ("%-22s\t%s\t'%s'\n",
+    printf ("%s%-22s\t%s\t'%s'\n",
+            epi->run_tag,
             eval->values[tm->eval_index].name,
             eval->qid,
 	    current_string);
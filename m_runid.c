@@ -42,6 +42,6 @@ static int
 te_print_runid (const EPI *epi, TREC_MEAS *tm, TREC_EVAL *eval)
 {
     if (epi->summary_flag)
-	printf ("%-22s\t%s\t%s\n", "runid", eval->qid, runid);
+	printf ("%s%-22s\t%s\t%s\n", epi->run_tag, "runid", eval->qid, runid);
     return (1);
 }
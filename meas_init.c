@@ -247,6 +247,16 @@ int te_init_meas_s_double_p_pair(EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval)
     return (1);
 }
 
+/* Measure is a single double with paired rel_level=gain params (the ndcg
+   measures).  The gains are resolved once here for te_form_gains */
+int te_init_meas_s_double_p_gains(EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval)
+{
+    if (UNDEF == te_init_meas_s_double_p_pair (epi, tm, eval) ||
+	UNDEF == te_form_gains_init (tm))
+	return (UNDEF);
+    return (1);
+}
+
 
 /* ----------------- Utility procedures for initialization -------------- */
 static int
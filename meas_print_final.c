@@ -39,7 +39,8 @@ int
 te_print_final_meas_s_double(const EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval)
 {
     if (epi->summary_flag)
-	printf ("%s%-22s\t%s\t%6.4f\n",
+	printf ("%s%s%-22s\t%s\t%6.4f\n",
+		epi->run_tag,
 		epi->zscore_flag ? "Z": "",
 		eval->values[tm->eval_index].name,
 		eval->qid,
@@ -54,12 +55,14 @@ te_print_final_meas_s_long (const EPI *epi, TREC_MEAS *tm,
 {
     if (epi->summary_flag) {
 	if (epi->zscore_flag)
-	    printf ("Z%-22s\t%s\t%6.4f\n",
+	    printf ("%sZ%-22s\t%s\t%6.4f\n",
+		    epi->run_tag,
 		    eval->values[tm->eval_index].name,
 		    eval->qid,
 		    eval->values[tm->eval_index].value);
 	else 
-	    printf ("%-22s\t%s\t%ld\n",
+	    printf ("%s%-22s\t%s\t%ld\n",
+		    epi->run_tag,
 		    eval->values[tm->eval_index].name,
 		    eval->qid,
 		    (long) eval->values[tm->eval_index].value);
@@ -75,7 +78,8 @@ int te_print_final_meas_a_cut(const EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval)
 
     for (i = 0; i < tm->meas_params->num_params; i++) {
 	if (epi->summary_flag)
-	    printf ("%s%-22s\t%s\t%6.4f\n",
+	    printf ("%s%s%-22s\t%s\t%6.4f\n",
+		    epi->run_tag,
 		    epi->zscore_flag ? "Z": "",
 		    eval->values[tm->eval_index + i].name,
 		    eval->qid,
@@ -95,7 +99,8 @@ int
 te_print_final_meas_s_double_p(const EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval)
 {
     if (epi->summary_flag)
-	printf ("%s%-22s\t%s\t%6.4f\n",
+	printf ("%s%s%-22s\t%s\t%6.4f\n",
+		epi->run_tag,
 		epi->zscore_flag ? "Z": "",
 		eval->values[tm->eval_index].name,
 		eval->qid,
@@ -107,3 +112,21 @@ te_print_final_meas_s_double_p(const EPI * epi, TREC_MEAS * tm, TREC_EVAL * eval
     }
     return (1);
 }
+
+/* Whether the print procedures of tm only print its values.  Measures
+   with print procedures of their own (eg relstring, runid) keep per query
+   state of their own, so are not calculated in several threads at once
+   (-j), nor available in a libtrec_eval context */
+int
+te_meas_values_only (const TREC_MEAS *tm)
+{
+    return ((tm->print_single_meas == te_print_single_meas_empty ||
+	     tm->print_single_meas == te_print_single_meas_s_double ||
+	     tm->print_single_meas == te_print_single_meas_s_long ||
+	     tm->print_single_meas == te_print_single_meas_a_cut) &&
+	    (tm->print_final_and_cleanup_meas == te_print_final_meas_empty ||
+	     tm->print_final_and_cleanup_meas == te_print_final_meas_s_double ||
+	     tm->print_final_and_cleanup_meas == te_print_final_meas_s_long ||
+	     tm->print_final_and_cleanup_meas == te_print_final_meas_a_cut ||
+	     tm->print_final_and_cleanup_meas == te_print_final_meas_s_double_p));
+}
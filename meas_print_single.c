@@ -41,12 +41,14 @@ te_print_single_meas_s_double(const EPI * epi, const TREC_MEAS * tm,
                              const TREC_EVAL * eval)
 {
     if (epi->zscore_flag)
-	printf ("Z%-22s\t%s\t%6.4f\n",
+	printf ("%sZ%-22s\t%s\t%6.4f\n",
+		epi->run_tag,
 		eval->values[tm->eval_index].name,
 		eval->qid,
 		eval->values[tm->eval_index].value);
     else 
-	printf ("%-22s\t%s\t%6.4f\n",
+	printf ("%s%-22s\t%s\t%6.4f\n",
+		epi->run_tag,
 		eval->values[tm->eval_index].name,
 		eval->qid,
 		eval->values[tm->eval_index].value);
@@ -59,12 +61,14 @@ te_print_single_meas_s_long (const EPI *epi, const TREC_MEAS *tm,
 			     const TREC_EVAL *eval)
 {
     if (epi->zscore_flag)
-	printf ("Z%-22s\t%s\t%6.4f\n",
+	printf ("%sZ%-22s\t%s\t%6.4f\n",
+		epi->run_tag,
 		eval->values[tm->eval_index].name,
 		eval->qid,
 		eval->values[tm->eval_index].value);
     else 
-	printf ("%-22s\t%s\t%ld\n",
+	printf ("%s%-22s\t%s\t%ld\n",
+		epi->run_tag,
 		eval->values[tm->eval_index].name,
 		eval->qid,
 		(long) eval->values[tm->eval_index].value);
@@ -79,12 +83,14 @@ te_print_single_meas_a_cut(const EPI * epi, const TREC_MEAS * tm,
     long i;
     for (i = 0; i < tm->meas_params->num_params; i++) {
 	if (epi->zscore_flag)
-	    printf ("Z%-22s\t%s\t%6.4f\n",
+	    printf ("%sZ%-22s\t%s\t%6.4f\n",
+		    epi->run_tag,
 		    eval->values[tm->eval_index+i].name,
 		    eval->qid,
 		    eval->values[tm->eval_index+i].value);
 	else 
-	    printf ("%-22s\t%s\t%6.4f\n",
+	    printf ("%s%-22s\t%s\t%6.4f\n",
+		    epi->run_tag,
 		    eval->values[tm->eval_index+i].name,
 		    eval->qid,
 		    eval->values[tm->eval_index+i].value);
@@ -0,0 +1,276 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#endif
+
+/* Hardware performance counter profile of an evaluation (trec_eval
+   --profile), using perf_event_open (Linux only).
+
+   One group of counters is opened for the main thread: CPU time
+   (task_clock, a software counter that is always available) leading
+   cycles, instructions, cache misses and branch misses.  Hardware
+   counters that cannot be opened (eg in virtual machines without a
+   PMU, or with a restrictive perf_event_paranoid) are reported as
+   unavailable.  Counts are user space only.
+
+   The counters are read at every phase change (te_timing_phase calls
+   te_profile_phase), around each measure's calc_meas (te_profile_meas_
+   begin and end), and around te_form_res_rels.  Forms shared between
+   measures (RES_RELS, RANK_STATS, GAINS) are counted in the first
+   measure forming them for a query; te_form_res_rels is also counted on
+   a line of its own.  Evaluation is serial under --profile, so the main
+   thread's counters see all of it.
+*/
+
+#define NUM_EVENTS 5
+static char *event_names[NUM_EVENTS] = {
+    "task_ms", "cycles", "instructions", "cache_miss", "branch_miss"
+};
+
+/* Counts of a phase, measure or form */
+typedef struct {
+    uint64_t counts[NUM_EVENTS];
+    long calls;
+} PROFILE_COUNTS;
+
+static int profiling = 0;
+#if defined(__linux__)
+static int leader_fd = -1;
+static int event_fds[NUM_EVENTS];
+#endif
+/* Position of each event in a group read, -1 if unavailable */
+static long event_index[NUM_EVENTS];
+static long num_open = 0;
+
+static PROFILE_COUNTS phase_counts[TE_NUM_PHASES];
+static int current_phase = TE_PHASE_NONE;
+static uint64_t phase_start[NUM_EVENTS];
+
+static PROFILE_COUNTS *meas_counts;
+static long num_meas = 0;
+static uint64_t meas_start[NUM_EVENTS];
+
+static PROFILE_COUNTS form_counts;
+static uint64_t form_start[NUM_EVENTS];
+
+static int read_counts (uint64_t *counts);
+static void add_counts (PROFILE_COUNTS *counts, const uint64_t *start,
+			const uint64_t *end);
+static void print_counts (const char *name, const PROFILE_COUNTS *counts);
+
+/* Open the counters of the calling thread, and reserve counts for
+   num_measures measures.  Returns 0 (after a message) if profiling is
+   not possible, so that evaluation goes on without it */
+int
+te_profile_open (const long num_measures)
+{
+#if defined(__linux__)
+    struct perf_event_attr attr;
+    static uint64_t hw_configs[NUM_EVENTS] = {
+	0, PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+	PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    long i;
+
+    if (NULL == (meas_counts = Malloc (num_measures, PROFILE_COUNTS)))
+	return (UNDEF);
+    (void) memset (meas_counts, 0, num_measures * sizeof (PROFILE_COUNTS));
+    num_meas = num_measures;
+
+    for (i = 0; i < NUM_EVENTS; i++) {
+	(void) memset (&attr, 0, sizeof (attr));
+	attr.size = sizeof (attr);
+	if (i == 0) {
+	    attr.type = PERF_TYPE_SOFTWARE;
+	    attr.config = PERF_COUNT_SW_TASK_CLOCK;
+	    attr.disabled = 1;
+	}
+	else {
+	    attr.type = PERF_TYPE_HARDWARE;
+	    attr.config = hw_configs[i];
+	}
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	event_fds[i] = (int) syscall (__NR_perf_event_open, &attr, 0, -1,
+				      leader_fd, 0);
+	if (event_fds[i] < 0) {
+	    if (i == 0) {
+		fprintf (stderr, "trec_eval.profile: perf_event_open failed (%s); no profile\n",
+			 strerror (errno));
+		return (0);
+	    }
+	    event_index[i] = -1;
+	    continue;
+	}
+	if (i == 0)
+	    leader_fd = event_fds[i];
+	event_index[i] = num_open++;
+    }
+    if (0 != ioctl (leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) ||
+	0 != ioctl (leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP)) {
+	fprintf (stderr, "trec_eval.profile: Cannot enable counters; no profile\n");
+	return (0);
+    }
+    profiling = 1;
+    return (1);
+#else
+    fprintf (stderr, "trec_eval.profile: Only supported on Linux; no profile\n");
+    return (0);
+#endif
+}
+
+/* End the current phase (if any) and start phase */
+void
+te_profile_phase (int phase)
+{
+    uint64_t counts[NUM_EVENTS];
+
+    if (! profiling || UNDEF == read_counts (counts))
+	return;
+    if (current_phase != TE_PHASE_NONE)
+	add_counts (&phase_counts[current_phase], phase_start, counts);
+    current_phase = phase;
+    (void) memcpy (phase_start, counts, sizeof (counts));
+}
+
+void
+te_profile_meas_begin ()
+{
+    if (profiling)
+	(void) read_counts (meas_start);
+}
+
+/* End the calc_meas call of te_trec_measures[m] */
+void
+te_profile_meas_end (const long m)
+{
+    uint64_t counts[NUM_EVENTS];
+
+    if (profiling && m < num_meas && UNDEF != read_counts (counts))
+	add_counts (&meas_counts[m], meas_start, counts);
+}
+
+void
+te_profile_form_begin ()
+{
+    if (profiling)
+	(void) read_counts (form_start);
+}
+
+void
+te_profile_form_end ()
+{
+    uint64_t counts[NUM_EVENTS];
+
+    if (profiling && UNDEF != read_counts (counts))
+	add_counts (&form_counts, form_start, counts);
+}
+
+/* Print the counts of each phase, of te_form_res_rels, and of each
+   measure calculated, to stderr; close the counters */
+void
+te_profile_report (TREC_MEAS **measures, const long num_measures)
+{
+    static char *phase_names[TE_NUM_PHASES] = {
+	"rel_info load", "results load", "zscores load", "measure init",
+	"query evaluation", "accumulation", "final print"
+    };
+    long i;
+
+    if (! profiling)
+	return;
+    te_profile_phase (TE_PHASE_NONE);
+
+    fprintf (stderr, "trec_eval: profile %-22s %10s", "", "calls");
+    for (i = 0; i < NUM_EVENTS; i++)
+	fprintf (stderr, " %14s", event_names[i]);
+    fprintf (stderr, " %6s\n", "ipc");
+    for (i = 0; i < TE_NUM_PHASES; i++)
+	print_counts (phase_names[i], &phase_counts[i]);
+    print_counts ("te_form_res_rels", &form_counts);
+    for (i = 0; i < num_measures && i < num_meas; i++) {
+	if (meas_counts[i].calls > 0)
+	    print_counts (measures[i]->name, &meas_counts[i]);
+    }
+    for (i = 0; i < NUM_EVENTS; i++) {
+	if (event_index[i] < 0)
+	    fprintf (stderr, "trec_eval: profile: %s counter unavailable\n",
+		     event_names[i]);
+    }
+
+#if defined(__linux__)
+    for (i = 0; i < NUM_EVENTS; i++) {
+	if (event_index[i] >= 0)
+	    (void) close (event_fds[i]);
+    }
+    leader_fd = -1;
+#endif
+    num_open = 0;
+    Free (meas_counts);
+    num_meas = 0;
+    profiling = 0;
+}
+
+/* Current value of each event (0 if unavailable) */
+static int
+read_counts (uint64_t *counts)
+{
+#if defined(__linux__)
+    uint64_t buf[1 + NUM_EVENTS];
+    long i;
+
+    if ((ssize_t) ((1 + num_open) * sizeof (uint64_t)) !=
+	read (leader_fd, buf, (1 + num_open) * sizeof (uint64_t)))
+	return (UNDEF);
+    for (i = 0; i < NUM_EVENTS; i++)
+	counts[i] = event_index[i] >= 0 ? buf[1 + event_index[i]] : 0;
+    return (1);
+#else
+    return (UNDEF);
+#endif
+}
+
+static void
+add_counts (PROFILE_COUNTS *counts, const uint64_t *start,
+	    const uint64_t *end)
+{
+    long i;
+
+    for (i = 0; i < NUM_EVENTS; i++)
+	counts->counts[i] += end[i] - start[i];
+    counts->calls++;
+}
+
+static void
+print_counts (const char *name, const PROFILE_COUNTS *counts)
+{
+    long i;
+
+    fprintf (stderr, "trec_eval:   %-28s %10ld", name, counts->calls);
+    /* task_clock counts ns */
+    fprintf (stderr, " %14.3f", counts->counts[0] * 1.0e-6);
+    for (i = 1; i < NUM_EVENTS; i++) {
+	if (event_index[i] < 0)
+	    fprintf (stderr, " %14s", "-");
+	else
+	    fprintf (stderr, " %14llu", (unsigned long long) counts->counts[i]);
+    }
+    if (event_index[1] >= 0 && event_index[2] >= 0 && counts->counts[1] > 0)
+	fprintf (stderr, " %6.2f\n",
+		 (double) counts->counts[2] / counts->counts[1]);
+    else
+	fprintf (stderr, " %6s\n", "-");
+}
@@ -22,7 +22,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
+#include <time.h>
 #include <memory.h>
 #include <sys/stat.h>
 #if defined(_WIN32) || defined(_WIN64)
@@ -31,6 +33,32 @@
 #else
 #include <sys/mman.h>
 #include <getopt.h>
+#include <dirent.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#endif
+
+/* Storage class for the per-query caches of the form_* procedures, which
+   are kept separately by each evaluation thread (see -j) */
+#if defined(_WIN32) || defined(_WIN64)
+#define TE_THREAD_LOCAL __declspec(thread)
+#else
+#define TE_THREAD_LOCAL __thread
+#endif
+
+/* Number of bits set in, and index of the lowest bit set in (w != 0), a
+   64 bit word of a PREFS_ARRAY row */
+#if defined(__GNUC__)
+#define TE_POPCOUNT64(w) __builtin_popcountll (w)
+#define TE_CTZ64(w) __builtin_ctzll (w)
+#else
+int te_popcount64 (uint64_t w);
+int te_ctz64 (uint64_t w);
+#define TE_POPCOUNT64(w) te_popcount64 (w)
+#define TE_CTZ64(w) te_ctz64 (w)
 #endif
 
 /* see http://stackoverflow.com/questions/33058014/trec-eval-make-error-using-cygwin/34927338 */
@@ -0,0 +1,153 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libtrec_eval.h"
+
+/* Check of libtrec_eval, for 'make quicktest'.
+   Evaluates the trec_results file results_file against qrels_file with
+   the library, one query at a time, for the measures given (as for
+   trec_eval -m), and prints per query and summary values as
+   'trec_eval -q' does.  Apart from the runid and relstring lines, which
+   the library does not produce, the output is that of trec_eval.
+   The lines of a query must be contiguous in results_file. */
+
+static char *usage = "Usage: lib_check qrels_file results_file measure...\n";
+
+/* Measures trec_eval prints as integers, and those it only prints in the
+   summary */
+static char *long_names[] = {"num_q", "num_ret", "num_rel", "num_rel_ret",
+			     "num_nonrel_judged_ret", NULL};
+static char *summary_names[] = {"num_q", "gm_map", "gm_bpref", NULL};
+
+static int eval_query (TE_CTX *ctx, const char *qid, long num_docs,
+		       const char **docnos, const double *scores,
+		       double *values);
+static void print_values (TE_CTX *ctx, const char *qid, double *values,
+			  int summary);
+static int in_list (const char *name, char **list);
+
+int
+main (int argc, char **argv)
+{
+    TE_CTX *ctx;
+    FILE *fd;
+    char qid[128], iter[128], docno[128], run_id[128];
+    char cur_qid[128];
+    long rank;
+    double score;
+    const char **docnos = NULL;
+    double *scores = NULL;
+    long num_docs = 0;
+    long max_docs = 0;
+    double *values;
+    long i;
+    int num_fields;
+
+    if (argc < 4) {
+	fputs (usage, stderr);
+	exit (1);
+    }
+    if (NULL == (ctx = te_ctx_new ()))
+	exit (2);
+    for (i = 3; i < argc; i++)
+	if (-1 == te_ctx_add_measure (ctx, argv[i]))
+	    exit (2);
+    if (-1 == te_ctx_load_qrels (ctx, argv[1]) ||
+	-1 == te_ctx_num_values (ctx) ||
+	NULL == (values = malloc ((te_ctx_num_values (ctx) + 1) *
+				  sizeof (double))))
+	exit (2);
+    if (NULL == (fd = fopen (argv[2], "r"))) {
+	fprintf (stderr, "lib_check: Cannot open '%s'\n", argv[2]);
+	exit (2);
+    }
+
+    cur_qid[0] = '\0';
+    while (1) {
+	num_fields = fscanf (fd, "%127s %127s %127s %ld %lf %127s",
+			     qid, iter, docno, &rank, &score, run_id);
+	if (num_fields != 6 && num_fields != EOF) {
+	    fprintf (stderr, "lib_check: Malformed line in '%s'\n", argv[2]);
+	    exit (2);
+	}
+	if (num_docs > 0 && (num_fields == EOF || strcmp (qid, cur_qid))) {
+	    if (-1 == eval_query (ctx, cur_qid, num_docs, docnos, scores,
+				  values))
+		exit (2);
+	    for (i = 0; i < num_docs; i++)
+		free ((char *) docnos[i]);
+	    num_docs = 0;
+	}
+	if (num_fields == EOF)
+	    break;
+	if (num_docs == max_docs) {
+	    max_docs = max_docs ? 2 * max_docs : 1024;
+	    if (NULL == (docnos = realloc (docnos,
+					   max_docs * sizeof (char *))) ||
+		NULL == (scores = realloc (scores, max_docs * sizeof (double))))
+		exit (2);
+	}
+	(void) strcpy (cur_qid, qid);
+	if (NULL == (docnos[num_docs] = strdup (docno)))
+	    exit (2);
+	scores[num_docs++] = score;
+    }
+    (void) fclose (fd);
+
+    (void) te_ctx_summary (ctx, values);
+    print_values (ctx, "all", values, 1);
+
+    te_ctx_free (ctx);
+    free (docnos);
+    free (scores);
+    free (values);
+    exit (0);
+}
+
+/* Evaluate and print one query.  Queries without judgements are ignored,
+   as by trec_eval */
+static int
+eval_query (TE_CTX *ctx, const char *qid, long num_docs,
+	    const char **docnos, const double *scores, double *values)
+{
+    int status;
+
+    if (-1 == (status = te_ctx_eval_query (ctx, qid, num_docs, docnos,
+					   scores, values)))
+	return (-1);
+    if (status == 1)
+	print_values (ctx, qid, values, 0);
+    return (status);
+}
+
+static void
+print_values (TE_CTX *ctx, const char *qid, double *values, int summary)
+{
+    const char *name;
+    long i;
+
+    for (i = 0; NULL != (name = te_ctx_value_name (ctx, i)); i++) {
+	if (! summary && in_list (name, summary_names))
+	    continue;
+	if (in_list (name, long_names))
+	    printf ("%-22s\t%s\t%ld\n", name, qid, (long) values[i]);
+	else
+	    printf ("%-22s\t%s\t%6.4f\n", name, qid, values[i]);
+    }
+}
+
+static int
+in_list (const char *name, char **list)
+{
+    for (; *list; list++)
+	if (0 == strcmp (name, *list))
+	    return (1);
+    return (0);
+}
@@ -0,0 +1,71 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Minimal client of 'trec_eval --server', for 'make quicktest'.
+   Connects to the server's socket (retrying for a few seconds while the
+   server starts up), sends all of stdin as the request, closes the
+   writing side and copies the reply to stdout.  Exits 0 if the whole
+   reply was copied. */
+
+static char *usage = "Usage: serve_client socket_file < request\n";
+
+#define MAX_TRIES 100
+
+int
+main (int argc, char **argv)
+{
+    struct sockaddr_un addr;
+    char buf[8192];
+    ssize_t n;
+    int fd;
+    long tries;
+
+    if (argc != 2 || strlen (argv[1]) >= sizeof (addr.sun_path)) {
+	fputs (usage, stderr);
+	exit (1);
+    }
+    (void) memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    (void) strcpy (addr.sun_path, argv[1]);
+
+    for (tries = 0; 1; tries++) {
+	if (-1 == (fd = socket (AF_UNIX, SOCK_STREAM, 0))) {
+	    fprintf (stderr, "serve_client: Cannot create socket\n");
+	    exit (2);
+	}
+	if (0 == connect (fd, (struct sockaddr *) &addr, sizeof (addr)))
+	    break;
+	(void) close (fd);
+	if (tries == MAX_TRIES) {
+	    fprintf (stderr, "serve_client: Cannot connect to '%s'\n",
+		     argv[1]);
+	    exit (2);
+	}
+	(void) usleep (50000);
+    }
+
+    while (0 < (n = read (0, buf, sizeof (buf))))
+	if (n != write (fd, buf, n)) {
+	    fprintf (stderr, "serve_client: Cannot send request\n");
+	    exit (2);
+	}
+    (void) shutdown (fd, SHUT_WR);
+
+    while (0 < (n = read (fd, buf, sizeof (buf))))
+	if (n != write (1, buf, n))
+	    exit (2);
+    if (n < 0) {
+	fprintf (stderr, "serve_client: Cannot read reply\n");
+	exit (2);
+    }
+    exit (0);
+}
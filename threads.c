@@ -0,0 +1,165 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#if ! (defined(_WIN32) || defined(_WIN64))
+#include <pthread.h>
+#endif
+
+/* Support procedures for parsing large input files with several threads
+   (see the -j flag).
+   te_split_buf divides a buffer into chunks ending at newline boundaries,
+   so that each chunk contains only whole lines and can be tokenized
+   independently.  te_run_threads then calls a parse procedure on each
+   chunk's argument structure, one thread per chunk.  The caller is
+   responsible for merging the per-chunk results back together in chunk
+   order, which keeps the merged result identical to a serial parse.
+   On Windows the chunks are simply processed serially.
+   te_atomic_next hands out work items (eg queries) one at a time to
+   threads sharing a counter.
+*/
+
+/* Don't bother splitting buffers into chunks smaller than this */
+#define MIN_CHUNK_SIZE (1 << 20)
+
+/* Split buf (ending at end_ptr) into at most max_chunks chunks.
+   chunk_starts must have room for max_chunks+1 pointers; on return
+   chunk i is chunk_starts[i] .. chunk_starts[i+1] and
+   chunk_starts[num_chunks] == end_ptr.  Every chunk but the last ends
+   just after a newline.  Returns the number of chunks (at least 1). */
+long
+te_split_buf (char *buf, char *end_ptr, long max_chunks, char **chunk_starts)
+{
+    long num_chunks;
+    long i;
+    size_t chunk_size;
+    char *ptr;
+
+    num_chunks = MIN (max_chunks, (long) ((end_ptr - buf) / MIN_CHUNK_SIZE));
+    if (num_chunks < 1)
+	num_chunks = 1;
+    chunk_size = (end_ptr - buf) / num_chunks;
+
+    chunk_starts[0] = buf;
+    for (i = 1; i < num_chunks; i++) {
+	ptr = MAX (buf + i * chunk_size, chunk_starts[i-1]);
+	if (ptr >= end_ptr ||
+	    NULL == (ptr = memchr (ptr, '\n', end_ptr - ptr)))
+	    break;
+	chunk_starts[i] = ptr + 1;
+    }
+    num_chunks = i;
+    chunk_starts[num_chunks] = end_ptr;
+    return (num_chunks);
+}
+
+#if ! (defined(_WIN32) || defined(_WIN64))
+typedef struct {
+    int (*proc) (void *);
+    void *arg;
+    int ret;
+} THREAD_ARG;
+
+static void *
+thread_proc (void *arg)
+{
+    THREAD_ARG *thread_arg = (THREAD_ARG *) arg;
+    thread_arg->ret = thread_arg->proc (thread_arg->arg);
+    return (NULL);
+}
+#endif
+
+/* Call proc on each of the num_args argument structures (each arg_size
+   bytes) in args, concurrently if num_args > 1.  Returns UNDEF if any
+   call returned UNDEF or a thread could not be started. */
+int
+te_run_threads (int (*proc) (void *), void *args, const size_t arg_size,
+		const long num_args)
+{
+    long i;
+    int ret = 1;
+#if ! (defined(_WIN32) || defined(_WIN64))
+    pthread_t *threads;
+    THREAD_ARG *thread_args;
+    long num_started;
+#endif
+
+    if (num_args <= 1) {
+	if (num_args == 1 && UNDEF == proc (args))
+	    return (UNDEF);
+	return (1);
+    }
+
+#if defined(_WIN32) || defined(_WIN64)
+    for (i = 0; i < num_args; i++) {
+	if (UNDEF == proc ((char *) args + i * arg_size))
+	    ret = UNDEF;
+    }
+#else
+    if (NULL == (threads = Malloc (num_args, pthread_t)) ||
+	NULL == (thread_args = Malloc (num_args, THREAD_ARG)))
+	return (UNDEF);
+    for (num_started = 0; num_started < num_args; num_started++) {
+	thread_args[num_started].proc = proc;
+	thread_args[num_started].arg = (char *) args + num_started * arg_size;
+	thread_args[num_started].ret = UNDEF;
+	if (pthread_create (&threads[num_started], NULL, thread_proc,
+			    &thread_args[num_started])) {
+	    fprintf (stderr, "trec_eval.run_threads: Cannot create thread\n");
+	    ret = UNDEF;
+	    break;
+	}
+    }
+    for (i = 0; i < num_started; i++) {
+	(void) pthread_join (threads[i], NULL);
+	if (UNDEF == thread_args[i].ret)
+	    ret = UNDEF;
+    }
+    Free (threads);
+    Free (thread_args);
+#endif
+    return (ret);
+}
+
+/* Return the current value of *counter and increment it, atomically with
+   respect to other threads doing the same.  (Threads are not used on
+   Windows, so a plain increment suffices there.) */
+long
+te_atomic_next (volatile long *counter)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return ((*counter)++);
+#else
+    return (__sync_fetch_and_add (counter, 1));
+#endif
+}
+
+/* Lock held while the tables shared by all the evaluation contexts of a
+   process (see libtrec_eval.h) are changed or searched; currently only
+   the gain tables of form_gains.c. */
+#if ! (defined(_WIN32) || defined(_WIN64))
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void
+te_shared_lock ()
+{
+#if ! (defined(_WIN32) || defined(_WIN64))
+    (void) pthread_mutex_lock (&shared_lock);
+#endif
+}
+
+void
+te_shared_unlock ()
+{
+#if ! (defined(_WIN32) || defined(_WIN64))
+    (void) pthread_mutex_unlock (&shared_lock);
+#endif
+}
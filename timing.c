@@ -0,0 +1,241 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#include "trec_format.h"
+#if ! (defined(_WIN32) || defined(_WIN64))
+#include <sys/resource.h>
+#endif
+
+/* Phase timing of an evaluation (trec_eval --timing).
+
+   The main thread moves from phase to phase with te_timing_phase, which
+   charges the wall clock and process CPU time since the previous call to
+   the phase being left.  Process CPU time includes all threads, so with
+   -j it may exceed wall time.  The time spent in te_form_res_rels (part
+   of query evaluation) is kept apart with te_timing_form_begin and
+   te_timing_form_end, summed over the threads forming queries.  Input
+   lines and evaluated queries are counted, and te_timing_report prints
+   all of it, with throughput and peak RSS, to stderr.
+
+   Measuring adds two clock readings per query (and per formed query), so
+   is only done when requested.  The same points also read the hardware
+   counters of --profile (see profile.c), if open.
+*/
+
+static char *phase_names[TE_NUM_PHASES] = {
+    "rel_info load",
+    "results load",
+    "zscores load",
+    "measure init",
+    "query evaluation",
+    "accumulation (and -q print)",
+    "final print",
+};
+
+static double phase_wall[TE_NUM_PHASES];
+static double phase_cpu[TE_NUM_PHASES];
+static int current_phase = TE_PHASE_NONE;
+static double current_wall, current_cpu;
+static double start_wall, start_cpu;
+static int started = 0;
+
+/* Summed over threads, under te_shared_lock */
+static double form_wall = 0.0;
+static double form_cpu = 0.0;
+
+static long num_rel_info_lines = 0;
+static long num_results_lines = 0;
+static long num_queries = 0;
+
+static double wall_clock ();
+static double process_cpu ();
+static double thread_cpu ();
+static long peak_rss_kb ();
+
+/* End the current phase (if any) and start phase (TE_PHASE_NONE to stop
+   timing until the next call) */
+void
+te_timing_phase (int phase)
+{
+    double wall = wall_clock ();
+    double cpu = process_cpu ();
+
+    if (! started) {
+	start_wall = wall;
+	start_cpu = cpu;
+	started = 1;
+    }
+    if (current_phase != TE_PHASE_NONE) {
+	phase_wall[current_phase] += wall - current_wall;
+	phase_cpu[current_phase] += cpu - current_cpu;
+    }
+    current_phase = phase;
+    current_wall = wall;
+    current_cpu = cpu;
+    te_profile_phase (phase);
+}
+
+/* Time of a te_form_res_rels call, in the calling thread */
+void
+te_timing_form_begin (double *wall, double *cpu)
+{
+    *wall = wall_clock ();
+    *cpu = thread_cpu ();
+    te_profile_form_begin ();
+}
+
+void
+te_timing_form_end (const double wall, const double cpu)
+{
+    double end_wall = wall_clock ();
+    double end_cpu = thread_cpu ();
+
+    te_profile_form_end ();
+    te_shared_lock ();
+    form_wall += end_wall - wall;
+    form_cpu += end_cpu - cpu;
+    te_shared_unlock ();
+}
+
+/* Count the input lines of the queries read (for the formats whose lines
+   are kept), and the queries evaluated */
+void
+te_timing_rel_info (const ALL_REL_INFO *all_rel_info)
+{
+    const REL_INFO *rel_info;
+    const TEXT_QRELS_JG_INFO *jg_info;
+    long i, jg;
+
+    for (i = 0; i < all_rel_info->num_q_rels; i++) {
+	rel_info = &all_rel_info->rel_info[i];
+	if (0 == strcmp (rel_info->rel_format, "qrels"))
+	    num_rel_info_lines +=
+		((TEXT_QRELS_INFO *) rel_info->q_rel_info)->num_text_qrels;
+	else if (0 == strcmp (rel_info->rel_format, "prefs"))
+	    num_rel_info_lines +=
+		((TEXT_PREFS_INFO *) rel_info->q_rel_info)->num_text_prefs;
+	else if (0 == strcmp (rel_info->rel_format, "qrels_jg")) {
+	    jg_info = (TEXT_QRELS_JG_INFO *) rel_info->q_rel_info;
+	    for (jg = 0; jg < jg_info->num_text_qrels_jg; jg++)
+		num_rel_info_lines += jg_info->text_qrels_jg[jg].num_text_qrels;
+	}
+    }
+}
+
+void
+te_timing_results (const RESULTS *results, const long num_q_results)
+{
+    long i;
+
+    for (i = 0; i < num_q_results; i++) {
+	if (0 == strcmp (results[i].ret_format, "trec_results"))
+	    num_results_lines += ((TEXT_RESULTS_INFO *)
+				  results[i].q_results)->num_text_results;
+    }
+}
+
+void
+te_timing_queries (const long num)
+{
+    num_queries += num;
+}
+
+void
+te_timing_report ()
+{
+    double wall, cpu, load_wall, eval_wall;
+    long i;
+
+    te_timing_phase (TE_PHASE_NONE);
+    wall = current_wall - start_wall;
+    cpu = current_cpu - start_cpu;
+
+    fprintf (stderr, "trec_eval: timing %-27s %10s %10s\n", "",
+	     "wall (s)", "cpu (s)");
+    for (i = 0; i < TE_NUM_PHASES; i++) {
+	fprintf (stderr, "trec_eval:   %-32s %10.3f %10.3f\n",
+		 phase_names[i], phase_wall[i], phase_cpu[i]);
+	if (i == TE_PHASE_EVAL)
+	    fprintf (stderr, "trec_eval:     %-30s %10.3f %10.3f\n",
+		     "te_form_res_rels (threads)", form_wall, form_cpu);
+    }
+    fprintf (stderr, "trec_eval:   %-32s %10.3f %10.3f\n", "total",
+	     wall, cpu);
+
+    load_wall = phase_wall[TE_PHASE_REL_INFO] + phase_wall[TE_PHASE_RESULTS];
+    eval_wall = phase_wall[TE_PHASE_EVAL] + phase_wall[TE_PHASE_ACC];
+    fprintf (stderr, "trec_eval: %ld rel_info lines, %ld results lines, %.0f lines/s loaded\n",
+	     num_rel_info_lines, num_results_lines,
+	     load_wall > 0.0 ?
+	     (num_rel_info_lines + num_results_lines) / load_wall : 0.0);
+    fprintf (stderr, "trec_eval: %ld queries, %.0f queries/s evaluated\n",
+	     num_queries, eval_wall > 0.0 ? num_queries / eval_wall : 0.0);
+    fprintf (stderr, "trec_eval: peak RSS %ld KB\n", peak_rss_kb ());
+}
+
+static double
+wall_clock ()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return ((double) clock () / CLOCKS_PER_SEC);
+#else
+    struct timespec ts;
+
+    (void) clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9);
+#endif
+}
+
+/* User plus system time of all threads */
+static double
+process_cpu ()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return ((double) clock () / CLOCKS_PER_SEC);
+#else
+    struct rusage usage;
+
+    (void) getrusage (RUSAGE_SELF, &usage);
+    return ((double) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+	    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1.0e-6);
+#endif
+}
+
+static double
+thread_cpu ()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return ((double) clock () / CLOCKS_PER_SEC);
+#else
+    struct timespec ts;
+
+    (void) clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((double) ts.tv_sec + (double) ts.tv_nsec * 1.0e-9);
+#endif
+}
+
+static long
+peak_rss_kb ()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return (0);
+#else
+    struct rusage usage;
+
+    (void) getrusage (RUSAGE_SELF, &usage);
+    /* ru_maxrss is in KB (Linux), bytes (macOS) */
+#if defined(__APPLE__)
+    return (usage.ru_maxrss / 1024);
+#else
+    return (usage.ru_maxrss);
+#endif
+#endif
+}
@@ -9,11 +9,21 @@ static char *VersionID = VERSIONID;
 static char *help_message = 
 "trec_eval [-h] [-q] [-m measure[.params] [-c] [-n] [-l <num>]\n\
    [-D debug_level] [-N <num>] [-M <num>] [-R rel_format] [-T results_format]\n\
-   rel_info_file  results_file \n\
+   [-j <num>] [--stream]\n\
+   rel_info_file  results_file {results_file}*\n\
+trec_eval [-R rel_format] [-j <num>] --compile_qrels qrels_bin_file\n\
+   rel_info_file\n\
+trec_eval [-j <num>] --compile_results results_bin_file results_file\n\
  \n\
 Calculate and print various evaluation measures, evaluating the results  \n\
 in results_file against the relevance info in rel_info_file. \n\
  \n\
+Several results_files may be given, and a results_file may be a directory,\n\
+standing for all the (non-hidden) files within it in name order.  Then\n\
+rel_info_file is read only once and each run is evaluated in turn, exactly\n\
+as if it were evaluated alone, but with every output line preceded by the\n\
+run's run_id (or file name if it has none) and a tab.\n\
+ \n\
 There are a fair number of options, of which only the lower case options are \n\
 normally ever used.   \n\
  --help:\n\
@@ -86,6 +96,75 @@ normally ever used.   \n\
     If mean is not in Zmeanfile for a measure and query, -1000000 is printed.\n\
     Zmean_file format is ascii lines of form \n\
        qid  measure_name  mean  std_dev\n\
+ --threads num:\n\
+ -j <num>: Use num threads to parse the results_file and rel_info_file (qrels\n\
+    format).  Each file is split into chunks of whole lines which are\n\
+    tokenized concurrently.  Queries are then evaluated concurrently by the\n\
+    same number of threads (not with --stream or -D).  Results are\n\
+    identical to a single threaded run.  Default is 1.\n\
+ --stream:\n\
+    Read the results_file (or stdin if '-') one query at a time and evaluate\n\
+    each query as soon as its results have been read, so memory use depends\n\
+    only on the largest query rather than the whole file.  The results_file\n\
+    must be in trec_results format and grouped by qid (all lines of a query\n\
+    contiguous); it is an error if a qid reappears later in the file.\n\
+    Queries are evaluated and printed in file order rather than sorted.\n\
+    Only a single results_file may be given.\n\
+ --compile_qrels qrels_bin_file:\n\
+    Instead of evaluating, read rel_info_file (which must be in 'qrels'\n\
+    format) and write it to qrels_bin_file in binary 'qrels_bin' format.\n\
+    Later evaluations using '-R qrels_bin qrels_bin_file' give identical\n\
+    results, but map the file into memory instead of parsing it.\n\
+ --compile_results results_bin_file:\n\
+    Instead of evaluating, read the single results_file given (which must be\n\
+    in 'trec_results' format) and write it to results_bin_file in binary\n\
+    columnar 'trec_results_bin' format, each query's results in rank order.\n\
+    No rel_info_file is given.  Later evaluations using\n\
+    '-T trec_results_bin results_bin_file' give identical results, but map\n\
+    the file into memory instead of parsing and sorting it.\n\
+ --timing:\n\
+    Report on stderr the wall clock and CPU time of each phase of the\n\
+    evaluation (loading rel_info, results and zscores, initializing\n\
+    measures, evaluating queries, of which forming the merged\n\
+    results/qrels of each query, accumulating (and -q printing) values,\n\
+    and final printing), lines loaded and queries evaluated per second,\n\
+    and peak resident memory.  Output to stdout is unchanged.\n\
+ --profile:\n\
+    As --timing, and also report on stderr hardware performance counters\n\
+    (cycles, instructions, cache misses, branch misses, with CPU time) of\n\
+    each phase, of forming the merged results/qrels of queries, and of the\n\
+    calculation of each measure over all queries.  Uses perf_event_open\n\
+    (Linux only); counters the machine does not provide are reported as\n\
+    unavailable.  Queries are evaluated in a single thread (-j ignored).\n\
+ --compare num_permutations:\n\
+    Evaluate the two results files given, and instead of their values\n\
+    print, for each measure value and the queries evaluated in both, the\n\
+    mean of each run and of the difference (second minus first), and the\n\
+    two-sided p-values of a paired t-test, a sign test (ties dropped), and\n\
+    a paired randomization test with num_permutations random sign flips of\n\
+    the query differences (0 skips it).  Permutations are shared out to\n\
+    the -j threads; p-values do not depend on their number.\n\
+ --cache cache_file:\n\
+    Keep the values of each evaluated query in cache_file, keyed by a hash\n\
+    of the query's judgements and results, and take the values of queries\n\
+    that did not change since the last evaluation from it instead of\n\
+    calculating them again.  The file is rewritten with the queries of this\n\
+    invocation, and ignored if it was written with other measures or\n\
+    options.  Only queries in 'qrels' and 'trec_results' formats (or their\n\
+    bin forms) are cached.  Output is identical to an uncached run.\n\
+ --server socket_file:\n\
+    Instead of evaluating results files given on the command line, load\n\
+    rel_info_file once and serve evaluations on the Unix domain socket\n\
+    socket_file.  No results_file is given.  A client connects and sends\n\
+    a first line listing the results files (or directories) to evaluate,\n\
+    separated by spaces, or '-' followed by the results themselves, and\n\
+    then closes its writing side.  The output (and any error messages) that\n\
+    'trec_eval [options] rel_info_file results_files' would print is sent\n\
+    back, and the connection closed.  All other options are those the\n\
+    server was started with.  Each request is evaluated by a child process\n\
+    sharing the loaded rel_info.  A server holds a single rel_info_file;\n\
+    start one server (on its own socket) per rel_info_file to be served.\n\
+    Not available on Windows.\n\
  \n\
  \n\
 Standard evaluation procedure:\n\
@@ -116,7 +195,7 @@ it will not be detected.  Use the -c flag to avoid this behavior. \n\
 #endif /* MDEBUG */
 
 
-static char *usage = "Usage: trec_eval [-h] [-q] {-m measure}* trec_rel_file trec_top_file\n\
+static char *usage = "Usage: trec_eval [-h] [-q] {-m measure}* trec_rel_file trec_top_file {trec_top_file}*\n\
    -h: Give full help information, including other options\n\
    -q: In addition to summary evaluation, give evaluation for each query\n\
    -m: calculate and print measures indicated by 'measure'\n\
@@ -131,34 +210,64 @@ extern REL_INFO_FILE_FORMAT te_rel_info_format[];
 extern int te_num_results_format;
 extern RESULTS_FILE_FORMAT te_results_format[];
 extern int te_num_form_inter_procs;
-extern RESULTS_FILE_FORMAT te_form_inter_procs[];
+extern FORM_INTER_PROCS te_form_inter_procs[];
 
 static int mark_measure (EPI *epi, char *optarg);
 static int trec_eval_help(EPI *epi);
 static void get_debug_level_query (EPI *epi, char *optarg);
 static int cleanup (EPI *epi);
-static char *qno_of_vno(const char *vno);
+static int qno_len_of_vno(const char *vno);
+static int eval_query (EPI *epi, ALL_REL_INFO *all_rel_info, RESULTS *results,
+		       long match_prefix, ALL_ZSCORES *all_zscores,
+		       TREC_EVAL *q_eval, TREC_EVAL *accum_eval);
+static int eval_queries_threaded (EPI *epi, ALL_REL_INFO *all_rel_info,
+				  ALL_RESULTS *all_results, long match_prefix,
+				  ALL_ZSCORES *all_zscores,
+				  TREC_EVAL *q_eval, TREC_EVAL *accum_eval);
+static int add_results_files (char *name, char ***files, long *num_files,
+			      long *max_files, long *num_dirs);
+static int eval_run (EPI *epi, char *trec_results_file, long stream_flag,
+		     long tag_run, ALL_REL_INFO *all_rel_info,
+		     long match_prefix, ALL_ZSCORES *all_zscores);
+static int set_run_tag (EPI *epi, char *run_id, char *trec_results_file);
+static int eval_runs (EPI *epi, char **results_files, long num_results_files,
+		      long num_dirs, long stream_flag,
+		      ALL_REL_INFO *all_rel_info, long match_prefix,
+		      ALL_ZSCORES *all_zscores, char **saved_params);
+static int serve (EPI *epi, char *socket_file, long stream_flag,
+		  ALL_REL_INFO *all_rel_info, long match_prefix,
+		  ALL_ZSCORES *all_zscores, char **saved_params);
+#if ! (defined(_WIN32) || defined(_WIN64))
+static void serve_request (EPI *epi, int conn_fd, long stream_flag,
+			   ALL_REL_INFO *all_rel_info, long match_prefix,
+			   ALL_ZSCORES *all_zscores, char **saved_params);
+#endif
 
 int
 main (argc, argv)
 int argc;
 char *argv[];
 {
-    char *trec_results_file;
-    ALL_RESULTS all_results;
+    char **results_files = NULL;
+    long num_results_files = 0;
+    long max_results_files = 0;
+    long num_dirs = 0;
+    char **saved_params;
     char *trec_rel_info_file;
     ALL_REL_INFO all_rel_info;
     char *zscores_file= NULL;
     ALL_ZSCORES all_zscores;
 
     EPI epi;              /* Eval parameter info */
-    TREC_EVAL accum_eval;
-    TREC_EVAL q_eval;
-    long i,m;
+    long i;
     int c;
     long help_wanted = 0;
     long match_prefix = 0;
     long measure_marked_flag = 0;
+    long stream_flag = 0;
+    char *compile_qrels_file = NULL;
+    char *compile_results_file = NULL;
+    char *server_socket = NULL;
 
 #ifdef MDEBUG
     /* Turn on memory debugging if environment variable MALLOC_TRACE is
@@ -182,6 +291,13 @@ char *argv[];
     epi.rel_info_format = "qrels";
     epi.results_format = "trec_results";
     epi.zscore_flag = 0;
+    epi.num_threads = 1;
+    epi.run_tag = "";
+    epi.cache_file = NULL;
+    epi.timing_flag = 0;
+    epi.profile_flag = 0;
+    epi.compare_flag = 0;
+    epi.num_permutations = 0;
     if (NULL == (epi.meas_arg = Malloc (argc+1, MEAS_ARG)))
 	exit (1);
     epi.meas_arg[0].measure_name = NULL;
@@ -206,9 +322,18 @@ char *argv[];
 	    {"Output_old_results_format", 1, 0, 'o'},
 	    {"Zscore", 1, 0, 'Z'},
 	    {"match_prefix", 0, 0, 'p'},
+	    {"threads", 1, 0, 'j'},
+	    {"stream", 0, 0, 'S'},
+	    {"compile_qrels", 1, 0, 'Q'},
+	    {"compile_results", 1, 0, 'B'},
+	    {"server", 1, 0, 'X'},
+	    {"cache", 1, 0, 'C'},
+	    {"timing", 0, 0, 'I'},
+	    {"profile", 0, 0, 'P'},
+	    {"compare", 1, 0, 'K'},
 	    {0, 0, 0, 0},
 	};
-	c = getopt_long (argc, argv, "hvqm:cl:nD:JN:M:R:T:oZ:p",
+	c = getopt_long (argc, argv, "hvqm:cl:nD:JN:M:R:T:oZ:pj:",
 			 long_options, &option_index);
 	if (c == -1)
 	    break;
@@ -268,6 +393,54 @@ char *argv[];
           case 'p':
             match_prefix++;
             break;
+	case 'S':
+	    /* --stream only, no short option */
+	    stream_flag++;
+	    break;
+	case 'Q':
+	    /* --compile_qrels only, no short option */
+	    compile_qrels_file = optarg;
+	    break;
+	case 'B':
+	    /* --compile_results only, no short option */
+	    compile_results_file = optarg;
+	    break;
+	case 'X':
+	    /* --server only, no short option */
+	    server_socket = optarg;
+	    break;
+	case 'C':
+	    /* --cache only, no short option */
+	    epi.cache_file = optarg;
+	    break;
+	case 'I':
+	    /* --timing only, no short option */
+	    epi.timing_flag++;
+	    break;
+	case 'P':
+	    /* --profile only, no short option.  Phases are those of
+	       --timing */
+	    epi.profile_flag++;
+	    epi.timing_flag++;
+	    break;
+	case 'K':
+	    /* --compare only, no short option */
+	    epi.compare_flag++;
+	    epi.num_permutations = atol (optarg);
+	    if (epi.num_permutations < 0) {
+		fprintf (stderr, "trec_eval: illegal number of permutations '%s'\n",
+			 optarg);
+		exit (1);
+	    }
+	    break;
+	case 'j':
+	    epi.num_threads = atol (optarg);
+	    if (epi.num_threads < 1) {
+		fprintf (stderr, "trec_eval: illegal number of threads '%s'\n",
+			 optarg);
+		exit (1);
+	    }
+	    break;
 	case '?':
 	default:
 		(void) fputs (usage,stderr);
@@ -281,16 +454,88 @@ char *argv[];
 	exit (0);
     }
 
-    if (optind + 2 != argc ) {
+    if ((compile_qrels_file != NULL) + (compile_results_file != NULL) +
+	(server_socket != NULL) > 1 ||
+	(compile_qrels_file || compile_results_file || server_socket ?
+	 optind + 1 != argc : optind + 2 > argc)) {
         (void) fputs (usage,stderr);
         exit (1);
     }
 
+    if (compile_results_file) {
+	/* Just convert the results_file to trec_results_bin format.  No
+	   rel_info is read */
+	ALL_RESULTS all_results;
+
+	if (strcmp (epi.results_format, "trec_results")) {
+	    fprintf (stderr, "trec_eval: --compile_results requires results format 'trec_results'\n");
+	    exit (2);
+	}
+	for (i = 0; i < te_num_results_format; i++) {
+	    if (0 == strcmp (epi.results_format, te_results_format[i].name))
+		break;
+	}
+	if (UNDEF == te_results_format[i].get_file (&epi, argv[optind],
+						    &all_results)) {
+	    fprintf (stderr, "trec_eval: Quit in file '%s'\n", argv[optind]);
+	    exit (2);
+	}
+	if (UNDEF == te_compile_results_bin (&all_results,
+					     compile_results_file)) {
+	    fprintf (stderr, "trec_eval: Quit in file '%s'\n",
+		     compile_results_file);
+	    exit (2);
+	}
+	if (UNDEF == te_results_format[i].cleanup ()) {
+	    fprintf (stderr,"trec_eval: cleanup failed\n");
+	    exit (10);
+	}
+	Free (epi.meas_arg);
+	exit (0);
+    }
+
     trec_rel_info_file = argv[optind++];
-    trec_results_file = argv[optind++];
+    /* All remaining arguments are results files (or directories of them) */
+    for (i = optind; i < argc; i++) {
+	if (UNDEF == add_results_files (argv[i], &results_files,
+					&num_results_files,
+					&max_results_files, &num_dirs))
+	    exit (1);
+    }
+    if (0 == num_results_files && NULL == compile_qrels_file &&
+	NULL == server_socket) {
+	fprintf (stderr, "trec_eval: No results files found\n");
+	exit (1);
+    }
+    if (stream_flag && num_results_files > 1) {
+	fprintf (stderr, "trec_eval: --stream evaluates only one results_file\n");
+	exit (1);
+    }
+
+    if (epi.compare_flag) {
+	if (num_results_files != 2 || server_socket || stream_flag) {
+	    fprintf (stderr, "trec_eval: --compare needs exactly two results files\n");
+	    exit (1);
+	}
+	/* Only the comparison is printed */
+	epi.query_flag = 0;
+	epi.summary_flag = 0;
+    }
+    if (server_socket && epi.timing_flag) {
+	fprintf (stderr, "trec_eval: --timing and --profile cannot be used with --server\n");
+	exit (1);
+    }
+    if (epi.profile_flag) {
+	/* Only the main thread is counted */
+	epi.num_threads = 1;
+	if (UNDEF == te_profile_open (te_num_trec_measures))
+	    exit (3);
+    }
 
     /* Find and get qrels and ranked results information for all queries from
        the input text files */
+    if (epi.timing_flag)
+	te_timing_phase (TE_PHASE_REL_INFO);
     for (i = 0; i < te_num_rel_info_format; i++) {
 	if (0 == strcmp (epi.rel_info_format, te_rel_info_format[i].name)) {
 	    if (UNDEF == te_rel_info_format[i].get_file (&epi,
@@ -308,41 +553,309 @@ char *argv[];
 		 epi.rel_info_format);
 	exit (2);
     }
-    for (i = 0; i < te_num_results_format; i++) {
-	if (0 == strcmp (epi.results_format, te_results_format[i].name)) {
-	    if (UNDEF == te_results_format[i].get_file (&epi,
-							trec_results_file,
-							&all_results)) {
-		fprintf (stderr, "trec_eval: Quit in file '%s'\n",
-			 trec_results_file);
-		exit (2);
-	    }
-	    break;
+
+    if (epi.timing_flag)
+	te_timing_rel_info (&all_rel_info);
+
+    if (compile_qrels_file) {
+	/* Just write the rel_info in qrels_bin format */
+	if (UNDEF == te_compile_qrels_bin (&all_rel_info,
+					   compile_qrels_file)) {
+	    fprintf (stderr, "trec_eval: Quit in file '%s'\n",
+		     compile_qrels_file);
+	    exit (2);
 	}
+	if (UNDEF == cleanup (&epi)) {
+	    fprintf (stderr,"trec_eval: cleanup failed\n");
+	    exit (10);
+	}
+	Free (epi.meas_arg);
+	exit (0);
     }
-    if (i >= te_num_results_format) {
-	fprintf (stderr, "trec_eval: Illegal retrieval results format '%s'\n",
-		 epi.results_format);
-	exit (2);
-    }
-
     if (epi.zscore_flag) {
+	if (epi.timing_flag)
+	    te_timing_phase (TE_PHASE_ZSCORES);
 	if (UNDEF == te_get_zscores (&epi, zscores_file, &all_zscores))
 	    return (UNDEF);
     }
 
-    /* Initialize all marked measures (possibly using command line info) */
+    /* If no measures designated on command line, first mark "official" */
     if (0 == measure_marked_flag) {
-	/* If no measures designated on command line, first mark "official" */
 	if (UNDEF == mark_measure (&epi, "official")) {
 	    fprintf (stderr, "trec_eval: illegal measure 'official'\n");
 	    exit (1);
 	}
     }
+
+    /* Initializing a measure modifies its command line parameters, and
+       measures are initialized again for each run.  Keep copies of the
+       parameters to restore before each run after the first. */
+    for (i = 0; epi.meas_arg[i].measure_name; i++)
+	;
+    if (NULL == (saved_params = Malloc (i+1, char *)))
+	exit (3);
+    for (i = 0; epi.meas_arg[i].measure_name; i++) {
+	if (NULL == (saved_params[i] =
+		     Malloc (strlen (epi.meas_arg[i].parameters) + 1, char)))
+	    exit (3);
+	(void) strcpy (saved_params[i], epi.meas_arg[i].parameters);
+    }
+
+    if (server_socket) {
+	/* Returns only on error */
+	(void) serve (&epi, server_socket, stream_flag, &all_rel_info,
+		      match_prefix, &all_zscores, saved_params);
+	exit (2);
+    }
+
+    if (UNDEF == eval_runs (&epi, results_files, num_results_files,
+			    num_dirs, stream_flag, &all_rel_info,
+			    match_prefix, &all_zscores, saved_params) ||
+	UNDEF == te_eval_cache_close ())
+	return (UNDEF);
+    if (epi.compare_flag && UNDEF == te_compare_print (&epi))
+	return (UNDEF);
+    if (epi.timing_flag)
+	te_timing_report ();
+    if (epi.profile_flag)
+	te_profile_report (te_trec_measures, te_num_trec_measures);
+
+    if (UNDEF == cleanup (&epi)) {
+	fprintf (stderr,"trec_eval: cleanup failed\n");
+	exit (10);
+    }
+    for (i = 0; epi.meas_arg[i].measure_name; i++)
+	Free (saved_params[i]);
+    Free (saved_params);
+    for (i = 0; i < num_results_files; i++)
+	Free (results_files[i]);
+    Free (results_files);
+    Free (epi.meas_arg);
+
+    exit (0);
+}
+
+/* Evaluate each run in turn against the same rel_info.  If there is
+   more than one run, each output line starts with the run's id. */
+static int
+eval_runs (EPI *epi, char **results_files, long num_results_files,
+	   long num_dirs, long stream_flag, ALL_REL_INFO *all_rel_info,
+	   long match_prefix, ALL_ZSCORES *all_zscores, char **saved_params)
+{
+    long i, j;
+
+    for (i = 0; i < num_results_files; i++) {
+	if (i > 0) {
+	    for (j = 0; epi->meas_arg[j].measure_name; j++)
+		(void) strcpy (epi->meas_arg[j].parameters, saved_params[j]);
+	}
+	if (epi->compare_flag)
+	    te_compare_start_run (i);
+	if (UNDEF == eval_run (epi, results_files[i], stream_flag,
+			       num_results_files > 1 || num_dirs > 0,
+			       all_rel_info, match_prefix, all_zscores))
+	    return (UNDEF);
+    }
+    return (1);
+}
+
+/* --server: accept connections on the Unix domain socket socket_file,
+   and evaluate the runs each one requests against all_rel_info (see the
+   help message for the protocol).  Each request is handled by a forked
+   child, which shares the loaded rel_info and reads and writes the
+   connection as its stdin, stdout and stderr.  So a request is evaluated
+   (and fails) exactly as a separate trec_eval would, and requests are
+   evaluated concurrently.  Returns only on error. */
+static int
+serve (EPI *epi, char *socket_file, long stream_flag,
+       ALL_REL_INFO *all_rel_info, long match_prefix,
+       ALL_ZSCORES *all_zscores, char **saved_params)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    fprintf (stderr, "trec_eval: --server not supported on Windows\n");
+    return (UNDEF);
+#else
+    struct sockaddr_un addr;
+    int listen_fd, conn_fd;
+    pid_t pid;
+
+    if (strlen (socket_file) >= sizeof (addr.sun_path)) {
+	fprintf (stderr, "trec_eval: socket file name '%s' too long\n",
+		 socket_file);
+	return (UNDEF);
+    }
+    (void) memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    (void) strcpy (addr.sun_path, socket_file);
+    (void) unlink (socket_file);
+    if (-1 == (listen_fd = socket (AF_UNIX, SOCK_STREAM, 0)) ||
+	-1 == bind (listen_fd, (struct sockaddr *) &addr, sizeof (addr)) ||
+	-1 == listen (listen_fd, SOMAXCONN)) {
+	fprintf (stderr, "trec_eval: Cannot listen on socket '%s'\n",
+		 socket_file);
+	return (UNDEF);
+    }
+    /* Children are not waited for */
+    (void) signal (SIGCHLD, SIG_IGN);
+
+    while (1) {
+	if (-1 == (conn_fd = accept (listen_fd, NULL, NULL))) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    fprintf (stderr, "trec_eval: Cannot accept on socket '%s'\n",
+		     socket_file);
+	    return (UNDEF);
+	}
+	(void) fflush (stdout);
+	(void) fflush (stderr);
+	if (-1 == (pid = fork ())) {
+	    fprintf (stderr, "trec_eval: Cannot fork for request\n");
+	    (void) close (conn_fd);
+	    continue;
+	}
+	if (pid == 0) {
+	    (void) close (listen_fd);
+	    serve_request (epi, conn_fd, stream_flag, all_rel_info,
+			   match_prefix, all_zscores, saved_params);
+	}
+	(void) close (conn_fd);
+    }
+#endif
+}
+
+#if ! (defined(_WIN32) || defined(_WIN64))
+/* Evaluate the request of a --server connection conn_fd, in the child
+   process serving it.  Does not return */
+static void
+serve_request (EPI *epi, int conn_fd, long stream_flag,
+	       ALL_REL_INFO *all_rel_info, long match_prefix,
+	       ALL_ZSCORES *all_zscores, char **saved_params)
+{
+    char *line = NULL;
+    long max_line = 0;
+    long len = 0;
+    char *ptr, *name;
+    char **results_files = NULL;
+    long num_results_files = 0;
+    long max_results_files = 0;
+    long num_dirs = 0;
+    char c;
+    ssize_t n;
+
+    /* Read the first line a byte at a time, leaving any results that
+       follow it to be read as stdin */
+    while (1 == (n = read (conn_fd, &c, 1)) && c != '\n') {
+	if (NULL == (line = te_chk_and_realloc (line, &max_line, len + 2,
+						sizeof (char))))
+	    exit (3);
+	line[len++] = c;
+    }
+    if (NULL == (line = te_chk_and_realloc (line, &max_line, len + 1,
+					    sizeof (char))))
+	exit (3);
+    line[len] = '\0';
+
+    if (-1 == dup2 (conn_fd, 0) || -1 == dup2 (conn_fd, 1) ||
+	-1 == dup2 (conn_fd, 2))
+	exit (2);
+    (void) close (conn_fd);
+
+    ptr = line;
+    while (1) {
+	while (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')
+	    ptr++;
+	if (*ptr == '\0')
+	    break;
+	name = ptr;
+	while (*ptr && *ptr != ' ' && *ptr != '\t' && *ptr != '\r')
+	    ptr++;
+	if (*ptr)
+	    *ptr++ = '\0';
+	if (UNDEF == add_results_files (name, &results_files,
+					&num_results_files,
+					&max_results_files, &num_dirs))
+	    exit (1);
+    }
+    if (0 == num_results_files) {
+	fprintf (stderr, "trec_eval: No results files found\n");
+	exit (1);
+    }
+    if (stream_flag && num_results_files > 1) {
+	fprintf (stderr, "trec_eval: --stream evaluates only one results_file\n");
+	exit (1);
+    }
+
+    if (UNDEF == eval_runs (epi, results_files, num_results_files,
+			    num_dirs, stream_flag, all_rel_info,
+			    match_prefix, all_zscores, saved_params) ||
+	UNDEF == te_eval_cache_close ())
+	exit (2);
+    (void) fflush (stdout);
+    exit (0);
+}
+#endif
+
+/* Evaluate one run (results file) against all_rel_info, printing its
+   summary values (and per query values if query_flag).  If tag_run, every
+   output line starts with the run's id.  Measures are initialized at the
+   start of the run and cleaned up at the end, and the run's results are
+   freed, so eval_run can be called again for the next run. */
+static int
+eval_run (EPI *epi, char *trec_results_file, long stream_flag,
+	  long tag_run, ALL_REL_INFO *all_rel_info,
+	  long match_prefix, ALL_ZSCORES *all_zscores)
+{
+    ALL_RESULTS all_results;
+    TREC_EVAL accum_eval;
+    TREC_EVAL q_eval;
+    long i,m;
+
+    if (epi->timing_flag)
+	te_timing_phase (TE_PHASE_RESULTS);
+    if (stream_flag) {
+	/* Results are read one query at a time in the evaluation loop */
+	if (strcmp (epi->results_format, "trec_results")) {
+	    fprintf (stderr, "trec_eval: --stream requires results format 'trec_results'\n");
+	    exit (2);
+	}
+	if (UNDEF == te_get_trec_results_stream_open (epi,
+						      trec_results_file)) {
+	    fprintf (stderr, "trec_eval: Quit in file '%s'\n",
+		     trec_results_file);
+	    exit (2);
+	}
+    }
+    else {
+	for (i = 0; i < te_num_results_format; i++) {
+	    if (0 == strcmp (epi->results_format, te_results_format[i].name)) {
+		if (UNDEF == te_results_format[i].get_file (epi,
+							    trec_results_file,
+							    &all_results)) {
+		    fprintf (stderr, "trec_eval: Quit in file '%s'\n",
+			     trec_results_file);
+		    exit (2);
+		}
+		break;
+	    }
+	}
+	if (i >= te_num_results_format) {
+	    fprintf (stderr, "trec_eval: Illegal retrieval results format '%s'\n",
+		     epi->results_format);
+	    exit (2);
+	}
+	if (epi->timing_flag)
+	    te_timing_results (all_results.results,
+			       all_results.num_q_results);
+    }
+
+
+    /* Initialize all marked measures (possibly using command line info) */
+    if (epi->timing_flag)
+	te_timing_phase (TE_PHASE_INIT);
     accum_eval = (TREC_EVAL) {"all",  0, NULL, 0, 0};
     for (m = 0; m < te_num_trec_measures; m++) {
 	if (MEASURE_MARKED(te_trec_measures[m])) {
-	    if (UNDEF == te_trec_measures[m]->init_meas (&epi,
+	    if (UNDEF == te_trec_measures[m]->init_meas (epi,
 							te_trec_measures[m],
 							&accum_eval)) {
 		fprintf (stderr, "trec_eval: Cannot initialize measure '%s'\n",
@@ -361,97 +874,85 @@ char *argv[];
     q_eval.num_values = accum_eval.num_values;
     q_eval.num_queries  = 0;
 
+    if (epi->cache_file &&
+	UNDEF == te_eval_cache_open (epi, epi->cache_file, VersionID,
+				     &q_eval))
+	return (UNDEF);
+
     /* For each topic which has both qrels and top results information,
        calculate, possibly print (if query_flag), and accumulate
        evaluation measures. */
-    for (i = 0; i < all_results.num_q_results; i++) {
-	/* If debugging a particular query, then skip all others */
-	if (epi.debug_query &&
-	    strcmp (epi.debug_query, all_results.results[i].qid))
-	    continue;
-	/* Find rel info for this query (skip if no rel info) */
-        REL_INFO *rel_info_ptr = NULL;
-        int error;
-        if (match_prefix) {
-          char *qid = qno_of_vno(all_results.results[i].qid);
-          error = hashmap_get(all_rel_info.map, qid, (void **)&rel_info_ptr);
-          free(qid);
-        } else {
-          error = hashmap_get(all_rel_info.map, all_results.results[i].qid,
-                              (void **)&rel_info_ptr);
-        }
-
-        if (MAP_OK != error) {
-          continue;
-        }
-
-	/* zero out all measures for new query */
-	for (m = 0; m < q_eval.num_values; m++)
-	    q_eval.values[m].value = 0;
-	q_eval.qid = all_results.results[i].qid;
-
-	/* Calculate all measure scores */
-	for (m = 0; m < te_num_trec_measures; m++) {
-	    if (MEASURE_REQUESTED(te_trec_measures[m])) {
-		if (UNDEF == te_trec_measures[m]->calc_meas (&epi,
-						    rel_info_ptr,
-						    &all_results.results[i],
-						    te_trec_measures[m],
-						    &q_eval)) {
-		    fprintf (stderr,"trec_eval: Can't calculate measure '%s'\n",
-			     te_trec_measures[m]->name);
-		    exit (4);
-		}
-	    }
+    if (stream_flag) {
+	/* Results were not read above; get one query at a time */
+	RESULTS results;
+	int status;
+	if (epi->timing_flag)
+	    te_timing_phase (TE_PHASE_RESULTS);
+	while (1 == (status = te_get_trec_results_stream_next (epi,
+							       &results))) {
+	    if (epi->timing_flag)
+		te_timing_results (&results, 1);
+	    if (tag_run && '\0' == *epi->run_tag &&
+		UNDEF == set_run_tag (epi, results.run_id, trec_results_file))
+		return (UNDEF);
+	    if (UNDEF == eval_query (epi, all_rel_info, &results,
+				     match_prefix, all_zscores,
+				     &q_eval, &accum_eval))
+		return (UNDEF);
+	    if (epi->timing_flag)
+		te_timing_phase (TE_PHASE_RESULTS);
 	}
-
-	/* Convert values to zscores if requested */
-	if (epi.zscore_flag) {
-	    if (UNDEF == te_convert_to_zscore (&all_zscores, &q_eval))
+	if (UNDEF == status) {
+	    fprintf (stderr, "trec_eval: Quit in file '%s'\n",
+		     trec_results_file);
+	    exit (2);
+	}
+    }
+    else {
+	if (tag_run &&
+	    UNDEF == set_run_tag (epi, all_results.num_q_results > 0 ?
+				  all_results.results[0].run_id : NULL,
+				  trec_results_file))
+	    return (UNDEF);
+	if (epi->num_threads > 1 && 0 == epi->debug_level) {
+	    /* Evaluate several queries at once; debug output (which would
+	       be interleaved) forces a serial evaluation */
+	    if (UNDEF == eval_queries_threaded (epi, all_rel_info,
+						&all_results, match_prefix,
+						all_zscores, &q_eval,
+						&accum_eval))
 		return (UNDEF);
 	}
-
-	/* Add this topics value to accumulated values, and possibly print */
-	for (m = 0; m < te_num_trec_measures; m++) {
-	    if (MEASURE_REQUESTED(te_trec_measures[m])) {
-		if (UNDEF == te_trec_measures[m]->acc_meas (&epi,
-						   te_trec_measures[m],
-						   &q_eval,
-						   &accum_eval)) {
-		    fprintf(stderr,"trec_eval: Can't accumulate measure '%s'\n",
-			    te_trec_measures[m]->name);
-		    exit (5);
-		}
-		if (epi.query_flag &&
-		    UNDEF == te_trec_measures[m]->print_single_meas (&epi,
-						   te_trec_measures[m],
-						   &q_eval)) {
-		    fprintf(stderr,
-			    "trec_eval: Can't print query measure '%s'\n",
-			    te_trec_measures[m]->name);
-		    exit (6);
-		}
+	else {
+	    for (i = 0; i < all_results.num_q_results; i++) {
+		if (UNDEF == eval_query (epi, all_rel_info,
+					 &all_results.results[i],
+					 match_prefix, all_zscores,
+					 &q_eval, &accum_eval))
+		    return (UNDEF);
 	    }
 	}
-	accum_eval.num_queries++;
     }
 
     if (accum_eval.num_queries == 0) {
 	fprintf (stderr,
-		"trec_eval: No queries with both results and relevance info\n");
+		"trec_eval: No queries with both results and relevance info in '%s'\n",
+		 trec_results_file);
 	exit (7);
     }
 
     /* Calculate final averages, and print (if desired) */
     /* Note that averages may depend on the entire rel_info data if
-       epi.average_complete_flag is set */
+       epi->average_complete_flag is set */
+    if (epi->timing_flag)
+	te_timing_phase (TE_PHASE_PRINT);
     for (m = 0; m < te_num_trec_measures; m++) {
 	if (MEASURE_REQUESTED(te_trec_measures[m])) {
 	    if (UNDEF == te_trec_measures[m]->calc_avg_meas
-		    (&epi, te_trec_measures[m],
-		     &all_rel_info, &accum_eval) ||
+		    (epi, te_trec_measures[m],
+		     all_rel_info, &accum_eval) ||
 		UNDEF == te_trec_measures[m]->print_final_and_cleanup_meas 
-		(&epi, te_trec_measures[m],  &accum_eval)) {
+		(epi, te_trec_measures[m],  &accum_eval)) {
 		    fprintf (stderr,"trec_eval: Can't print measure '%s'\n",
 			     te_trec_measures[m]->name);
 		    exit (8);
@@ -459,15 +960,428 @@ char *argv[];
 	}
     }
 
-    if (UNDEF == cleanup (&epi)) {
-	fprintf (stderr,"trec_eval: cleanup failed\n");
-	exit (10);
+
+    if (epi->timing_flag) {
+	(void) fflush (stdout);
+	te_timing_queries (accum_eval.num_queries);
+	te_timing_phase (TE_PHASE_NONE);
+    }
+
+    /* Free this run's results and cached intermediate forms, and mark
+       the measures to be initialized again for the next run */
+    for (i = 0; i < te_num_results_format; i++) {
+	if (0 == strcmp (epi->results_format, te_results_format[i].name)) {
+	    if (UNDEF == te_results_format[i].cleanup ())
+		return (UNDEF);
+	    break;
+	}
+    }
+    for (i = 0; i < te_num_form_inter_procs; i++) {
+	if (UNDEF == te_form_inter_procs[i].cleanup ())
+	    return (UNDEF);
+    }
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (MEASURE_REQUESTED(te_trec_measures[m]))
+	    te_trec_measures[m]->eval_index = -2;
+    }
+    if (*epi->run_tag) {
+	Free (epi->run_tag);
+	epi->run_tag = "";
     }
     Free (q_eval.values);
     Free (accum_eval.values);
-    Free (epi.meas_arg);
+    return (1);
+}
 
-    exit (0);
+/* Set epi->run_tag, printed at the start of each output line, to run_id
+   (or to trec_results_file if the run has no run_id) */
+static int
+set_run_tag (EPI *epi, char *run_id, char *trec_results_file)
+{
+    char *tag = (run_id && *run_id) ? run_id : trec_results_file;
+
+    if (NULL == (epi->run_tag = Malloc (strlen (tag) + 2, char)))
+	return (UNDEF);
+    (void) strcpy (epi->run_tag, tag);
+    (void) strcat (epi->run_tag, "\t");
+    return (1);
+}
+
+static int comp_file_name ();
+
+/* Add name to the list of results files to be evaluated.  If name is a
+   directory, add all the regular files within it (excluding hidden
+   files), sorted by name.  All names in the list are malloc'd */
+static int
+add_results_files (char *name, char ***files, long *num_files,
+		   long *max_files, long *num_dirs)
+{
+    struct stat buf;
+#if ! (defined(_WIN32) || defined(_WIN64))
+    DIR *dir;
+    struct dirent *entry;
+    char *path;
+    long start;
+#endif
+
+    if (strcmp (name, "-") && 0 == stat (name, &buf) &&
+	S_ISDIR (buf.st_mode)) {
+	(*num_dirs)++;
+#if defined(_WIN32) || defined(_WIN64)
+	fprintf (stderr, "trec_eval: Results directory '%s' not supported on Windows\n", name);
+	return (UNDEF);
+#else
+	if (NULL == (dir = opendir (name))) {
+	    fprintf (stderr, "trec_eval: Cannot read results directory '%s'\n",
+		     name);
+	    return (UNDEF);
+	}
+	start = *num_files;
+	while (NULL != (entry = readdir (dir))) {
+	    if (entry->d_name[0] == '.')
+		continue;
+	    if (NULL == (path = Malloc (strlen (name) +
+					strlen (entry->d_name) + 2, char)))
+		return (UNDEF);
+	    sprintf (path, "%s/%s", name, entry->d_name);
+	    if (stat (path, &buf) || ! S_ISREG (buf.st_mode)) {
+		Free (path);
+		continue;
+	    }
+	    if (NULL == (*files = te_chk_and_realloc (*files, max_files,
+						      *num_files + 1,
+						      sizeof (char *))))
+		return (UNDEF);
+	    (*files)[(*num_files)++] = path;
+	}
+	(void) closedir (dir);
+	qsort ((char *) &(*files)[start],
+	       (int) (*num_files - start),
+	       sizeof (char *),
+	       comp_file_name);
+	return (1);
+#endif
+    }
+
+    if (NULL == (*files = te_chk_and_realloc (*files, max_files,
+					      *num_files + 1,
+					      sizeof (char *))) ||
+	NULL == ((*files)[*num_files] = Malloc (strlen (name) + 1, char)))
+	return (UNDEF);
+    (void) strcpy ((*files)[(*num_files)++], name);
+    return (1);
+}
+
+static int
+comp_file_name (ptr1, ptr2)
+char **ptr1;
+char **ptr2;
+{
+    return (strcmp (*ptr1, *ptr2));
+}
+
+/* Find the rel info for the query of results.  Returns NULL if the query
+   is to be skipped (no rel info or not the debug query) */
+static REL_INFO *
+find_rel_info (const EPI *epi, ALL_REL_INFO *all_rel_info,
+	       const RESULTS *results, long match_prefix)
+{
+    REL_INFO *rel_info_ptr = NULL;
+    int error;
+
+    /* If debugging a particular query, then skip all others */
+    if (epi->debug_query &&
+	strcmp (epi->debug_query, results->qid))
+	return (NULL);
+    /* Find rel info for this query (skip if no rel info) */
+    if (match_prefix) {
+      error = hashmap_get_len(all_rel_info->map, results->qid,
+			      qno_len_of_vno(results->qid),
+			      (void **)&rel_info_ptr);
+    } else {
+      error = hashmap_get(all_rel_info->map, results->qid,
+			  (void **)&rel_info_ptr);
+    }
+
+    if (MAP_OK != error) {
+      return (NULL);
+    }
+    return (rel_info_ptr);
+}
+
+/* Which of the requested measures calc_query calculates.  Measures whose
+   calculation only sets their values in q_eval (te_meas_values_only) can
+   be calculated for different queries at the same time (-j); others are
+   always calculated in the main thread */
+#define CALC_ALL 0
+#define CALC_THREAD_SAFE 1
+#define CALC_SERIAL 2
+
+/* Calculate the requested measure scores (those selected by which) for
+   one query into q_eval */
+static void
+calc_query (EPI *epi, REL_INFO *rel_info_ptr, RESULTS *results,
+	    TREC_EVAL *q_eval, int which)
+{
+    long m;
+
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (MEASURE_REQUESTED(te_trec_measures[m]) &&
+	    (which == CALC_ALL ||
+	     (which == CALC_THREAD_SAFE) ==
+	     te_meas_values_only (te_trec_measures[m]))) {
+	    if (epi->profile_flag)
+		te_profile_meas_begin ();
+	    if (UNDEF == te_trec_measures[m]->calc_meas (epi,
+						rel_info_ptr,
+						results,
+						te_trec_measures[m],
+						q_eval)) {
+		fprintf (stderr,"trec_eval: Can't calculate measure '%s'\n",
+			 te_trec_measures[m]->name);
+		exit (4);
+	    }
+	    if (epi->profile_flag)
+		te_profile_meas_end (m);
+	}
+    }
+}
+
+/* Convert a calculated query to zscores if requested, accumulate its values
+   into accum_eval, and possibly print (if query_flag) */
+static int
+finish_query (EPI *epi, ALL_ZSCORES *all_zscores,
+	      TREC_EVAL *q_eval, TREC_EVAL *accum_eval)
+{
+    long m;
+
+    /* Convert values to zscores if requested */
+    if (epi->zscore_flag) {
+	if (UNDEF == te_convert_to_zscore (all_zscores, q_eval))
+	    return (UNDEF);
+    }
+
+    /* Keep the values of each run for --compare */
+    if (epi->compare_flag && UNDEF == te_compare_add_query (q_eval))
+	return (UNDEF);
+
+    /* Add this topics value to accumulated values, and possibly print */
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (MEASURE_REQUESTED(te_trec_measures[m])) {
+	    if (UNDEF == te_trec_measures[m]->acc_meas (epi,
+					       te_trec_measures[m],
+					       q_eval,
+					       accum_eval)) {
+		fprintf(stderr,"trec_eval: Can't accumulate measure '%s'\n",
+			te_trec_measures[m]->name);
+		exit (5);
+	    }
+	    if (epi->query_flag &&
+		UNDEF == te_trec_measures[m]->print_single_meas (epi,
+					       te_trec_measures[m],
+					       q_eval)) {
+		fprintf(stderr,
+			"trec_eval: Can't print query measure '%s'\n",
+			te_trec_measures[m]->name);
+		exit (6);
+	    }
+	}
+    }
+    accum_eval->num_queries++;
+    return (1);
+}
+
+/* Evaluate a single query's results, possibly printing (if query_flag), and
+   accumulate its values into accum_eval.  Returns 1 if the query was
+   evaluated, 0 if skipped (no rel info or not the debug query), UNDEF on
+   error. */
+static int
+eval_query (EPI *epi, ALL_REL_INFO *all_rel_info, RESULTS *results,
+	    long match_prefix, ALL_ZSCORES *all_zscores,
+	    TREC_EVAL *q_eval, TREC_EVAL *accum_eval)
+{
+    long m;
+    REL_INFO *rel_info_ptr;
+    uint64_t key;
+    int cached;
+
+    if (NULL == (rel_info_ptr = find_rel_info (epi, all_rel_info, results,
+					       match_prefix)))
+	return (0);
+
+    /* zero out all measures for new query */
+    for (m = 0; m < q_eval->num_values; m++)
+	q_eval->values[m].value = 0;
+    q_eval->qid = results->qid;
+
+    /* Calculate all measure scores (only those not cacheable if the
+       query's values were cached) */
+    if (epi->timing_flag)
+	te_timing_phase (TE_PHASE_EVAL);
+    cached = te_eval_cache_get (epi, rel_info_ptr, results, &key, q_eval);
+    calc_query (epi, rel_info_ptr, results, q_eval,
+		cached == 1 ? CALC_SERIAL : CALC_ALL);
+    if (cached != UNDEF && UNDEF == te_eval_cache_put (key, q_eval))
+	return (UNDEF);
+    if (epi->timing_flag)
+	te_timing_phase (TE_PHASE_ACC);
+
+    if (UNDEF == finish_query (epi, all_zscores, q_eval, accum_eval))
+	return (UNDEF);
+    return (1);
+}
+
+/* Evaluating queries with several threads (-j).
+   Queries are taken a window at a time.  The threads share the queries of
+   a window between them through an atomic counter, each calculating the
+   thread safe measures of a query into its own q_eval, and saving the
+   values in the query's slot of the window.  The main thread then goes
+   through the window in results order, calculating any remaining measures
+   and accumulating and printing exactly as eval_query does, so that the
+   output is identical to that of a serial evaluation.
+   The intermediate forms (form_res_rels etc) cache the current query in
+   thread local storage, so each thread keeps its own cache. */
+
+/* Number of queries per thread in each window */
+#define QUERIES_PER_THREAD 256
+
+typedef struct {
+    EPI *epi;
+    ALL_REL_INFO *all_rel_info;
+    long match_prefix;
+    RESULTS *results;           /* Results of the queries in the window */
+    long num_queries;           /* Number of queries in the window */
+    volatile long next_query;   /* Next query in window to be evaluated */
+    REL_INFO **rel_info;        /* For each query in window, its rel_info
+				   or NULL if the query is skipped */
+    double *values;             /* For each query in window, the num_values
+				   calculated values */
+    long num_values;
+    uint64_t *keys;             /* For each query in window, its cache key */
+    int *cached;                /* For each query in window, the result of
+				   te_eval_cache_get */
+} EVAL_WINDOW;
+
+typedef struct {
+    EVAL_WINDOW *window;
+    TREC_EVAL q_eval;           /* This thread's query evaluation */
+} EVAL_THREAD;
+
+static int
+eval_window_proc (void *arg)
+{
+    EVAL_THREAD *thread = (EVAL_THREAD *) arg;
+    EVAL_WINDOW *window = thread->window;
+    TREC_EVAL *q_eval = &thread->q_eval;
+    RESULTS *results;
+    long q, m;
+
+    while ((q = te_atomic_next (&window->next_query)) < window->num_queries) {
+	results = &window->results[q];
+	if (NULL == (window->rel_info[q] =
+		     find_rel_info (window->epi, window->all_rel_info,
+				    results, window->match_prefix)))
+	    continue;
+	for (m = 0; m < q_eval->num_values; m++)
+	    q_eval->values[m].value = 0;
+	q_eval->qid = results->qid;
+	window->cached[q] = te_eval_cache_get (window->epi,
+					       window->rel_info[q], results,
+					       &window->keys[q], q_eval);
+	if (window->cached[q] != 1)
+	    calc_query (window->epi, window->rel_info[q], results, q_eval,
+			CALC_THREAD_SAFE);
+	for (m = 0; m < q_eval->num_values; m++)
+	    window->values[q * window->num_values + m] =
+		q_eval->values[m].value;
+    }
+
+    /* Free this thread's cached intermediate forms */
+    for (m = 0; m < te_num_form_inter_procs; m++) {
+	if (UNDEF == te_form_inter_procs[m].cleanup ())
+	    return (UNDEF);
+    }
+    return (1);
+}
+
+/* Evaluate all queries of all_results using epi->num_threads threads.
+   Output and accumulated values are as for calling eval_query on each
+   query in turn. */
+static int
+eval_queries_threaded (EPI *epi, ALL_REL_INFO *all_rel_info,
+		       ALL_RESULTS *all_results, long match_prefix,
+		       ALL_ZSCORES *all_zscores,
+		       TREC_EVAL *q_eval, TREC_EVAL *accum_eval)
+{
+    EVAL_WINDOW window;
+    EVAL_THREAD *threads;
+    long window_size = epi->num_threads * QUERIES_PER_THREAD;
+    long start, q, m, t;
+
+    window.epi = epi;
+    window.all_rel_info = all_rel_info;
+    window.match_prefix = match_prefix;
+    window.num_values = q_eval->num_values;
+    if (NULL == (window.rel_info = Malloc (window_size, REL_INFO *)) ||
+	NULL == (window.values = Malloc (window_size * q_eval->num_values,
+					 double)) ||
+	NULL == (window.keys = Malloc (window_size, uint64_t)) ||
+	NULL == (window.cached = Malloc (window_size, int)) ||
+	NULL == (threads = Malloc (epi->num_threads, EVAL_THREAD)))
+	return (UNDEF);
+    for (t = 0; t < epi->num_threads; t++) {
+	threads[t].window = &window;
+	threads[t].q_eval = *q_eval;
+	if (NULL == (threads[t].q_eval.values =
+		     Malloc (q_eval->num_values, TREC_EVAL_VALUE)))
+	    return (UNDEF);
+	(void) memcpy (threads[t].q_eval.values, q_eval->values,
+		       q_eval->num_values * sizeof (TREC_EVAL_VALUE));
+    }
+
+    for (start = 0; start < all_results->num_q_results; start += window_size) {
+	window.results = &all_results->results[start];
+	window.num_queries = MIN (window_size,
+				  all_results->num_q_results - start);
+	window.next_query = 0;
+	if (epi->timing_flag)
+	    te_timing_phase (TE_PHASE_EVAL);
+	if (UNDEF == te_run_threads (eval_window_proc, threads,
+				     sizeof (EVAL_THREAD),
+				     MIN (epi->num_threads,
+					  window.num_queries)))
+	    return (UNDEF);
+
+	/* Finish the window's queries in order */
+	for (q = 0; q < window.num_queries; q++) {
+	    if (NULL == window.rel_info[q])
+		continue;
+	    for (m = 0; m < q_eval->num_values; m++)
+		q_eval->values[m].value =
+		    window.values[q * window.num_values + m];
+	    q_eval->qid = window.results[q].qid;
+	    if (epi->timing_flag)
+		te_timing_phase (TE_PHASE_EVAL);
+	    calc_query (epi, window.rel_info[q], &window.results[q], q_eval,
+			CALC_SERIAL);
+	    if (window.cached[q] != UNDEF &&
+		UNDEF == te_eval_cache_put (window.keys[q], q_eval))
+		return (UNDEF);
+	    if (epi->timing_flag)
+		te_timing_phase (TE_PHASE_ACC);
+	    if (UNDEF == finish_query (epi, all_zscores, q_eval, accum_eval))
+		return (UNDEF);
+	}
+    }
+
+    for (t = 0; t < epi->num_threads; t++)
+	Free (threads[t].q_eval.values);
+    Free (threads);
+    Free (window.values);
+    Free (window.keys);
+    Free (window.cached);
+    Free (window.rel_info);
+    return (1);
 }
 
 static int 
@@ -623,6 +1537,8 @@ cleanup (EPI *epi)
 	if (UNDEF == te_form_inter_procs[i].cleanup ())
 	    return (UNDEF);
     }
+    if (UNDEF == te_form_gains_tables_cleanup ())
+	return (UNDEF);
     if (epi->zscore_flag) {
 	if (UNDEF == te_get_zscores_cleanup())
 	    return (UNDEF);
@@ -630,12 +1546,13 @@ cleanup (EPI *epi)
     return (1);
 }
 
-static char *qno_of_vno(const char *vno) {
+/* Length of the qid prefix (leading alphanumerics) of a variant qid */
+static int qno_len_of_vno(const char *vno) {
   const char *src = vno;
 
   while (*src && isalnum(*src)) {
     src++;
   }
 
-  return strndup(vno, src-vno);
+  return src - vno;
 }
@@ -47,6 +47,25 @@ typedef struct {
     char *results_format;         /* "trec_results"  format of input results*/
     long zscore_flag;             /* 0. If set, output Z score for measure
 				     instead of raw score */
+    long num_threads;             /* 1. Number of threads used to parse the
+				     results and rel_info files, and to
+				     evaluate queries */
+    char *run_tag;                /* "". Printed at the start of every output
+				     line ("run_id\t" when evaluating
+				     several runs) */
+    char *cache_file;             /* NULL. If set, the values of each query
+				     are cached in this file (--cache) */
+    long timing_flag;             /* 0. If set, the time of each phase of
+				     the evaluation is reported on stderr
+				     (--timing) */
+    long profile_flag;            /* 0. If set, hardware counters of each
+				     phase and measure are reported on
+				     stderr (--profile) */
+    long compare_flag;            /* 0. If set, the two runs evaluated are
+				     compared with paired significance
+				     tests instead of printed (--compare) */
+    long num_permutations;        /* 0. Permutations of the randomization
+				     test of --compare */
     /* List of command line arguments giving individual measure parameters.
        meas_arg is NULL if there are no such arguments.  
        If arguments, final list member contains a NULL measure_name */
@@ -162,6 +181,10 @@ typedef struct trec_meas {
 	-2 indicates measure to be calculated, but has not yet been initialized.
         Set in init_meas */
     long eval_index;
+    /* Info formed from meas_params once, by init_meas, for calc_meas (eg
+       the gain table of the ndcg measures, see form_gains.c).  NULL if
+       none */
+    void *meas_info;
 } TREC_MEAS;
 
 /* Mapping of a nickname to a group of measures that it applies to.
@@ -196,6 +219,8 @@ typedef struct {
     char *explanation;
     /*    int (*form_file) (); */
     int (*cleanup) ();
+    /* Forget the query cached, but keep the space (see libtrec_eval) */
+    int (*reset) ();
 } FORM_INTER_PROCS;
 
 /* Storage for mean and stddev of scores for a measure on a query.
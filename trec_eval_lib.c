@@ -0,0 +1,746 @@
+/*
+   Copyright (c) 2008 - Chris Buckley.
+
+   Permission is granted for use and modification of this file for
+   research, non-commercial purposes.
+*/
+
+#include "common.h"
+#include "sysfunc.h"
+#include "trec_eval.h"
+#include "functions.h"
+#include "trec_format.h"
+#include "libtrec_eval.h"
+
+/* Evaluation contexts of libtrec_eval (see libtrec_eval.h).
+
+   trec_eval itself keeps its state in globals: the measures requested
+   (te_trec_measures eval_index and meas_params), the qrels and results
+   pools of the file readers, and the docno table (docno.c).  A context
+   instead owns all of its state:
+   - Its own EPI, and its own copy of each requested TREC_MEAS and its
+     PARAMS, initialized against that EPI.  The copies are the compiled
+     plan; te_trec_measures is never changed.
+   - Its own qrels, in the "qrels" format.  The judged docs of each query
+     get docids 0 .. num_text_qrels-1 of their own (equal docnos share
+     one), so a retrieved docno is given its docid by a binary search of
+     the judgements of its query, and the global docno table is not used.
+   - The accumulated values of the queries evaluated.
+   The form_* procedures cache the intermediate forms of the last query
+   (per thread), keyed by qid.  Since a context may evaluate different
+   rankings of the same qid, the cached query is forgotten after every
+   query evaluated, but the space of the forms is kept for the next query
+   (of any context in the thread) and only freed by te_ctx_free.
+   The gain table of an ndcg measure is formed when its copy is
+   initialized, and kept in its meas_info (see form_gains.c).
+*/
+
+extern int te_num_trec_measures;
+extern TREC_MEAS *te_trec_measures[];
+extern int te_num_trec_measure_nicknames;
+extern TREC_MEASURE_NICKNAMES te_trec_measure_nicknames[];
+extern int te_num_form_inter_procs;
+extern FORM_INTER_PROCS te_form_inter_procs[];
+
+/* Judgement while loading; qid and docno are offsets into strings */
+typedef struct {
+    long qid;
+    long docno;
+    long rel;
+} CTX_QREL;
+
+/* Judgement while compiling */
+typedef struct {
+    char *qid;
+    char *docno;
+    long rel;
+} SORT_QREL;
+
+struct te_ctx {
+    EPI epi;
+    MEAS_ARG *meas_arg;          /* Params of requested measures.  Terminated
+				    by a NULL measure_name */
+    long num_meas_arg;
+    long max_meas_arg;
+    char *marked;                /* marked[m] set if te_trec_measures[m]
+				    requested */
+    long compiled;               /* 1 once plan compiled, UNDEF if that
+				    failed */
+
+    /* Plan: copies of the requested measures, in te_trec_measures order */
+    TREC_MEAS *meas;
+    PARAMS *params;
+    long num_meas;               /* Number initialized */
+    TREC_EVAL q_eval;            /* Values of the current query */
+    TREC_EVAL accum_eval;        /* Values accumulated over queries */
+    TREC_EVAL summ_eval;         /* Averaged copy of accum_eval */
+
+    /* Judgements */
+    char *strings;               /* qids and docnos, NULL terminated */
+    long num_strings;
+    long max_strings;
+    CTX_QREL *qrels;
+    long num_qrels;
+    long max_qrels;
+    SORT_QREL *sort_qrels;
+    TEXT_QRELS *text_qrels;
+    TEXT_QRELS_INFO *text_qrels_info;
+    ALL_REL_INFO all_rel_info;
+
+    /* Scratch space for the ranking being evaluated */
+    TEXT_RESULTS *text_results;
+    long max_text_results;
+};
+
+static int compile_plan (TE_CTX *ctx);
+static int compile_qrels (TE_CTX *ctx);
+static int mark_measure (TE_CTX *ctx, const char *name, long nickname);
+static long add_string (TE_CTX *ctx, const char *str);
+static long find_docid (const TEXT_QRELS_INFO *trec_qrels,
+			const char *docno, const long docno_len);
+static void reset_forms ();
+static void cleanup_forms ();
+static int comp_qrel ();
+
+TE_CTX *
+te_ctx_new ()
+{
+    TE_CTX *ctx;
+    long m;
+
+    if (NULL == (ctx = Malloc (1, TE_CTX)))
+	return (NULL);
+    (void) memset (ctx, 0, sizeof (TE_CTX));
+    ctx->epi.query_flag = 0;
+    ctx->epi.average_complete_flag = 0;
+    ctx->epi.judged_docs_only_flag = 0;
+    ctx->epi.summary_flag = 0;
+    ctx->epi.relation_flag = 1;
+    ctx->epi.debug_level = 0;
+    ctx->epi.debug_query = NULL;
+    ctx->epi.num_docs_in_coll = 0;
+    ctx->epi.relevance_level = 1;
+    ctx->epi.max_num_docs_per_topic = MAXLONG;
+    ctx->epi.rel_info_format = "qrels";
+    ctx->epi.results_format = "trec_results";
+    ctx->epi.zscore_flag = 0;
+    ctx->epi.num_threads = 1;
+    ctx->epi.run_tag = "";
+    ctx->epi.meas_arg = NULL;
+    ctx->q_eval = (TREC_EVAL) {"", 0, NULL, 0, 0};
+    ctx->accum_eval = (TREC_EVAL) {"all", 0, NULL, 0, 0};
+    ctx->summ_eval = (TREC_EVAL) {"all", 0, NULL, 0, 0};
+    if (NULL == (ctx->marked = Malloc (te_num_trec_measures, char)) ||
+	NULL == (ctx->meas_arg =
+		 te_chk_and_realloc (ctx->meas_arg, &ctx->max_meas_arg,
+				     1, sizeof (MEAS_ARG)))) {
+	te_ctx_free (ctx);
+	return (NULL);
+    }
+    for (m = 0; m < te_num_trec_measures; m++)
+	ctx->marked[m] = 0;
+    ctx->meas_arg[0].measure_name = NULL;
+    return (ctx);
+}
+
+int
+te_ctx_set_option (TE_CTX *ctx, const char *option, long value)
+{
+    if (0 == strcmp (option, "relevance_level"))
+	ctx->epi.relevance_level = value;
+    else if (0 == strcmp (option, "judged_docs_only"))
+	ctx->epi.judged_docs_only_flag = value;
+    else if (0 == strcmp (option, "average_complete"))
+	ctx->epi.average_complete_flag = value;
+    else if (0 == strcmp (option, "num_docs_in_coll"))
+	ctx->epi.num_docs_in_coll = value;
+    else if (0 == strcmp (option, "max_num_docs_per_topic"))
+	ctx->epi.max_num_docs_per_topic = value;
+    else {
+	fprintf (stderr, "trec_eval.lib: Unknown option '%s'\n", option);
+	return (UNDEF);
+    }
+    return (1);
+}
+
+int
+te_ctx_add_measure (TE_CTX *ctx, const char *measure)
+{
+    char *name, *ptr;
+    long i;
+    long has_params = 0;
+
+    if (ctx->compiled) {
+	fprintf (stderr, "trec_eval.lib: Measure '%s' added after the first evaluation\n",
+		 measure);
+	return (UNDEF);
+    }
+    if (NULL == (name = Malloc (strlen (measure) + 1, char)))
+	return (UNDEF);
+    (void) strcpy (name, measure);
+
+    /* Split off parameters, kept (as by trec_eval -m) for the init_meas
+       procedure of the measure */
+    for (ptr = name; *ptr && *ptr != '.'; ptr++)
+	;
+    if (*ptr == '.') {
+	*ptr++ = '\0';
+	if (*ptr == '\0') {
+	    fprintf (stderr, "trec_eval.lib: improper measure in parameter '%s'\n",
+		     name);
+	    Free (name);
+	    return (UNDEF);
+	}
+	if (NULL == (ctx->meas_arg =
+		     te_chk_and_realloc (ctx->meas_arg, &ctx->max_meas_arg,
+					 ctx->num_meas_arg + 2,
+					 sizeof (MEAS_ARG)))) {
+	    Free (name);
+	    return (UNDEF);
+	}
+	ctx->meas_arg[ctx->num_meas_arg].measure_name = name;
+	ctx->meas_arg[ctx->num_meas_arg].parameters = ptr;
+	ctx->num_meas_arg++;
+	ctx->meas_arg[ctx->num_meas_arg].measure_name = NULL;
+	has_params = 1;
+    }
+
+    for (i = 0; i < te_num_trec_measure_nicknames; i++) {
+	if (0 == strcmp (name, te_trec_measure_nicknames[i].name)) {
+	    /* Mark all the available measures the nickname refers to */
+	    char **nick_name = te_trec_measure_nicknames[i].name_list;
+	    while (*nick_name) {
+		if (UNDEF == mark_measure (ctx, *nick_name, 1))
+		    break;
+		nick_name++;
+	    }
+	    break;
+	}
+    }
+    i = (i < te_num_trec_measure_nicknames ||
+	 UNDEF != mark_measure (ctx, name, 0));
+    /* name is kept in meas_arg if it has parameters */
+    if (! has_params)
+	Free (name);
+    return (i ? 1 : UNDEF);
+}
+
+int
+te_ctx_add_qrel (TE_CTX *ctx, const char *qid, const char *docno, long rel)
+{
+    CTX_QREL *qrel;
+
+    if (ctx->compiled) {
+	fprintf (stderr, "trec_eval.lib: Judgements added after the first evaluation\n");
+	return (UNDEF);
+    }
+    if (NULL == (ctx->qrels =
+		 te_chk_and_realloc (ctx->qrels, &ctx->max_qrels,
+				     ctx->num_qrels + 1, sizeof (CTX_QREL))))
+	return (UNDEF);
+    qrel = &ctx->qrels[ctx->num_qrels];
+    if (UNDEF == (qrel->qid = add_string (ctx, qid)) ||
+	UNDEF == (qrel->docno = add_string (ctx, docno)))
+	return (UNDEF);
+    qrel->rel = rel;
+    ctx->num_qrels++;
+    return (1);
+}
+
+int
+te_ctx_load_qrels (TE_CTX *ctx, const char *qrels_file)
+{
+    FILE *fd;
+    long size, line_num, num_tokens;
+    char *buf, *end, *line, *eol, *ptr;
+    char *tokens[4];
+    int ret = 1;
+
+    if (NULL == (fd = fopen (qrels_file, "rb")) ||
+	0 != fseek (fd, 0L, SEEK_END) ||
+	0 > (size = ftell (fd)) ||
+	0 != fseek (fd, 0L, SEEK_SET)) {
+	fprintf (stderr, "trec_eval.lib: Cannot read qrels file '%s'\n",
+		 qrels_file);
+	if (fd)
+	    (void) fclose (fd);
+	return (UNDEF);
+    }
+    if (NULL == (buf = Malloc (size + 1, char))) {
+	(void) fclose (fd);
+	return (UNDEF);
+    }
+    if (size != (long) fread (buf, 1, (size_t) size, fd)) {
+	fprintf (stderr, "trec_eval.lib: Cannot read qrels file '%s'\n",
+		 qrels_file);
+	(void) fclose (fd);
+	Free (buf);
+	return (UNDEF);
+    }
+    (void) fclose (fd);
+    end = buf + size;
+    *end = '\0';
+
+    /* Lines are "qid iter docno rel" */
+    line_num = 0;
+    for (line = buf; line < end; line = eol + 1) {
+	line_num++;
+	if (NULL == (eol = memchr (line, '\n', (size_t) (end - line))))
+	    eol = end;
+	*eol = '\0';
+	num_tokens = 0;
+	ptr = line;
+	while (1) {
+	    while (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')
+		ptr++;
+	    if (*ptr == '\0' || num_tokens > 4)
+		break;
+	    if (num_tokens < 4)
+		tokens[num_tokens] = ptr;
+	    num_tokens++;
+	    while (*ptr && *ptr != ' ' && *ptr != '\t' && *ptr != '\r')
+		ptr++;
+	    if (*ptr)
+		*ptr++ = '\0';
+	}
+	if (num_tokens == 0)
+	    continue;
+	if (num_tokens != 4) {
+	    fprintf (stderr, "trec_eval.lib: Malformed line %ld of '%s'\n",
+		     line_num, qrels_file);
+	    ret = UNDEF;
+	    break;
+	}
+	if (UNDEF == te_ctx_add_qrel (ctx, tokens[0], tokens[2],
+				      atol (tokens[3]))) {
+	    ret = UNDEF;
+	    break;
+	}
+    }
+
+    Free (buf);
+    return (ret);
+}
+
+long
+te_ctx_num_values (TE_CTX *ctx)
+{
+    if (UNDEF == compile_plan (ctx))
+	return (UNDEF);
+    return (ctx->accum_eval.num_values);
+}
+
+const char *
+te_ctx_value_name (TE_CTX *ctx, long i)
+{
+    if (UNDEF == compile_plan (ctx) ||
+	i < 0 || i >= ctx->accum_eval.num_values)
+	return (NULL);
+    return (ctx->accum_eval.values[i].name);
+}
+
+int
+te_ctx_eval_query (TE_CTX *ctx, const char *qid, long num_docs,
+		   const char **docnos, const double *scores,
+		   double *values)
+{
+    TEXT_RESULTS_INFO text_results_info;
+    TEXT_QRELS_INFO *trec_qrels;
+    RESULTS results;
+    REL_INFO *rel_info;
+    any_t value;
+    long i, m;
+    int ret = 1;
+
+    if (UNDEF == compile_plan (ctx))
+	return (UNDEF);
+    if (num_docs <= 0 ||
+	MAP_OK != hashmap_get (ctx->all_rel_info.map, (char *) qid, &value))
+	return (0);
+    rel_info = (REL_INFO *) value;
+    trec_qrels = (TEXT_QRELS_INFO *) rel_info->q_rel_info;
+
+    /* Form the ranking as read from a trec_results file */
+    if (NULL == (ctx->text_results =
+		 te_chk_and_malloc (ctx->text_results, &ctx->max_text_results,
+				    num_docs, sizeof (TEXT_RESULTS))))
+	return (UNDEF);
+    for (i = 0; i < num_docs; i++) {
+	ctx->text_results[i].docno = (char *) docnos[i];
+	ctx->text_results[i].docno_len = strlen (docnos[i]);
+	ctx->text_results[i].docid =
+	    find_docid (trec_qrels, docnos[i],
+			ctx->text_results[i].docno_len);
+	ctx->text_results[i].sim = scores[i];
+    }
+    text_results_info.num_text_results = num_docs;
+    text_results_info.max_num_text_results = ctx->max_text_results;
+    text_results_info.text_results = ctx->text_results;
+    text_results_info.rank_ordered = 0;
+    results.qid = rel_info->qid;
+    results.run_id = "";
+    results.ret_format = "trec_results";
+    results.q_results = &text_results_info;
+
+    for (i = 0; i < ctx->q_eval.num_values; i++)
+	ctx->q_eval.values[i].value = 0;
+    ctx->q_eval.qid = rel_info->qid;
+    for (m = 0; m < ctx->num_meas; m++) {
+	if (UNDEF == ctx->meas[m].calc_meas (&ctx->epi, rel_info, &results,
+					     &ctx->meas[m], &ctx->q_eval)) {
+	    fprintf (stderr, "trec_eval.lib: Can't calculate measure '%s'\n",
+		     ctx->meas[m].name);
+	    ret = UNDEF;
+	    break;
+	}
+    }
+    reset_forms ();
+    if (UNDEF == ret)
+	return (UNDEF);
+
+    for (m = 0; m < ctx->num_meas; m++) {
+	if (UNDEF == ctx->meas[m].acc_meas (&ctx->epi, &ctx->meas[m],
+					    &ctx->q_eval, &ctx->accum_eval)) {
+	    fprintf (stderr, "trec_eval.lib: Can't accumulate measure '%s'\n",
+		     ctx->meas[m].name);
+	    return (UNDEF);
+	}
+    }
+    ctx->accum_eval.num_queries++;
+    if (values) {
+	for (i = 0; i < ctx->q_eval.num_values; i++)
+	    values[i] = ctx->q_eval.values[i].value;
+    }
+    return (1);
+}
+
+long
+te_ctx_summary (TE_CTX *ctx, double *values)
+{
+    long i, m;
+
+    if (UNDEF == compile_plan (ctx))
+	return (UNDEF);
+
+    /* Average a copy, so that more queries may still be accumulated */
+    (void) memcpy (ctx->summ_eval.values, ctx->accum_eval.values,
+		   ctx->accum_eval.num_values * sizeof (TREC_EVAL_VALUE));
+    ctx->summ_eval.num_values = ctx->accum_eval.num_values;
+    ctx->summ_eval.num_queries = ctx->accum_eval.num_queries;
+    for (m = 0; m < ctx->num_meas; m++) {
+	if (UNDEF == ctx->meas[m].calc_avg_meas (&ctx->epi, &ctx->meas[m],
+						 &ctx->all_rel_info,
+						 &ctx->summ_eval)) {
+	    fprintf (stderr, "trec_eval.lib: Can't average measure '%s'\n",
+		     ctx->meas[m].name);
+	    return (UNDEF);
+	}
+    }
+    if (values) {
+	for (i = 0; i < ctx->summ_eval.num_values; i++)
+	    values[i] = ctx->summ_eval.values[i].value;
+    }
+    return (ctx->summ_eval.num_queries);
+}
+
+int
+te_ctx_reset (TE_CTX *ctx)
+{
+    long i;
+
+    for (i = 0; i < ctx->accum_eval.num_values; i++)
+	ctx->accum_eval.values[i].value = 0;
+    ctx->accum_eval.num_queries = 0;
+    return (1);
+}
+
+void
+te_ctx_free (TE_CTX *ctx)
+{
+    long m;
+
+    if (NULL == ctx)
+	return;
+
+    /* With summary_flag off, print_final_and_cleanup_meas only frees the
+       names and params of the measure */
+    ctx->epi.summary_flag = 0;
+    for (m = 0; m < ctx->num_meas; m++) {
+	(void) ctx->meas[m].print_final_and_cleanup_meas (&ctx->epi,
+							  &ctx->meas[m],
+							  &ctx->accum_eval);
+	(void) te_form_gains_release (&ctx->meas[m]);
+    }
+    cleanup_forms ();
+    if (ctx->meas)
+	Free (ctx->meas);
+    if (ctx->params)
+	Free (ctx->params);
+    if (ctx->max_meas_arg > 0) {
+	for (m = 0; m < ctx->num_meas_arg; m++)
+	    Free (ctx->meas_arg[m].measure_name);
+	Free (ctx->meas_arg);
+    }
+    if (ctx->marked)
+	Free (ctx->marked);
+    if (ctx->q_eval.values)
+	Free (ctx->q_eval.values);
+    if (ctx->accum_eval.max_num_values > 0)
+	Free (ctx->accum_eval.values);
+    if (ctx->summ_eval.values)
+	Free (ctx->summ_eval.values);
+
+    if (ctx->max_strings > 0)
+	Free (ctx->strings);
+    if (ctx->max_qrels > 0)
+	Free (ctx->qrels);
+    if (ctx->sort_qrels)
+	Free (ctx->sort_qrels);
+    if (ctx->text_qrels)
+	Free (ctx->text_qrels);
+    if (ctx->text_qrels_info)
+	Free (ctx->text_qrels_info);
+    if (ctx->all_rel_info.rel_info)
+	Free (ctx->all_rel_info.rel_info);
+    if (ctx->all_rel_info.map)
+	hashmap_free (ctx->all_rel_info.map);
+    if (ctx->max_text_results > 0)
+	Free (ctx->text_results);
+    Free (ctx);
+}
+
+/* Mark measure name to be calculated.  Measures of a nickname that are
+   not available are skipped */
+static int
+mark_measure (TE_CTX *ctx, const char *name, long nickname)
+{
+    long m;
+
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (0 == strcmp (name, te_trec_measures[m]->name))
+	    break;
+    }
+    if (m >= te_num_trec_measures) {
+	fprintf (stderr, "trec_eval.lib: Unknown measure '%s'\n", name);
+	return (UNDEF);
+    }
+    if (! te_meas_values_only (te_trec_measures[m])) {
+	if (nickname)
+	    return (0);
+	fprintf (stderr, "trec_eval.lib: Measure '%s' is not available in a context\n",
+		 name);
+	return (UNDEF);
+    }
+    ctx->marked[m] = 1;
+    return (1);
+}
+
+/* Compile the plan (and judgements) on first use */
+static int
+compile_plan (TE_CTX *ctx)
+{
+    long m, num_marked;
+    TREC_MEAS *tm;
+
+    if (ctx->compiled)
+	return (ctx->compiled);
+
+    /* As trec_eval, use the official measures if none were requested */
+    num_marked = 0;
+    for (m = 0; m < te_num_trec_measures; m++)
+	num_marked += ctx->marked[m];
+    if (num_marked == 0) {
+	if (UNDEF == te_ctx_add_measure (ctx, "official"))
+	    return (UNDEF);
+	for (m = 0; m < te_num_trec_measures; m++)
+	    num_marked += ctx->marked[m];
+    }
+
+    ctx->compiled = UNDEF;
+    if (UNDEF == compile_qrels (ctx))
+	return (UNDEF);
+
+    /* Initialize a copy of each measure (and its default params) against
+       the EPI of the context */
+    if (NULL == (ctx->meas = Malloc (num_marked, TREC_MEAS)) ||
+	NULL == (ctx->params = Malloc (num_marked, PARAMS)))
+	return (UNDEF);
+    ctx->epi.meas_arg = ctx->meas_arg;
+    for (m = 0; m < te_num_trec_measures; m++) {
+	if (! ctx->marked[m])
+	    continue;
+	tm = &ctx->meas[ctx->num_meas];
+	*tm = *te_trec_measures[m];
+	tm->meas_info = NULL;
+	if (tm->meas_params) {
+	    ctx->params[ctx->num_meas] = *tm->meas_params;
+	    tm->meas_params = &ctx->params[ctx->num_meas];
+	}
+	if (UNDEF == tm->init_meas (&ctx->epi, tm, &ctx->accum_eval)) {
+	    fprintf (stderr, "trec_eval.lib: Cannot initialize measure '%s'\n",
+		     tm->name);
+	    return (UNDEF);
+	}
+	ctx->num_meas++;
+    }
+
+    if (NULL == (ctx->q_eval.values = Malloc (ctx->accum_eval.num_values + 1,
+					      TREC_EVAL_VALUE)) ||
+	NULL == (ctx->summ_eval.values = Malloc (ctx->accum_eval.num_values+1,
+						 TREC_EVAL_VALUE)))
+	return (UNDEF);
+    (void) memcpy (ctx->q_eval.values, ctx->accum_eval.values,
+		   ctx->accum_eval.num_values * sizeof (TREC_EVAL_VALUE));
+    ctx->q_eval.num_values = ctx->accum_eval.num_values;
+
+    ctx->compiled = 1;
+    return (1);
+}
+
+/* Sort the judgements by qid and docno, and form the REL_INFO of each
+   query */
+static int
+compile_qrels (TE_CTX *ctx)
+{
+    long i, start, num_q;
+    REL_INFO *rel_info;
+    TEXT_QRELS_INFO *text_qrels_info;
+
+    if (NULL == (ctx->sort_qrels = Malloc (ctx->num_qrels + 1, SORT_QREL)) ||
+	NULL == (ctx->text_qrels = Malloc (ctx->num_qrels + 1, TEXT_QRELS)))
+	return (UNDEF);
+    for (i = 0; i < ctx->num_qrels; i++) {
+	ctx->sort_qrels[i].qid = ctx->strings + ctx->qrels[i].qid;
+	ctx->sort_qrels[i].docno = ctx->strings + ctx->qrels[i].docno;
+	ctx->sort_qrels[i].rel = ctx->qrels[i].rel;
+    }
+    qsort ((char *) ctx->sort_qrels, (size_t) ctx->num_qrels,
+	   sizeof (SORT_QREL), comp_qrel);
+
+    num_q = 0;
+    for (i = 0; i < ctx->num_qrels; i++) {
+	if (i == 0 || strcmp (ctx->sort_qrels[i].qid,
+			      ctx->sort_qrels[i-1].qid))
+	    num_q++;
+    }
+    if (NULL == (ctx->all_rel_info.rel_info = Malloc (num_q + 1, REL_INFO)) ||
+	NULL == (ctx->text_qrels_info = Malloc (num_q + 1, TEXT_QRELS_INFO)) ||
+	NULL == (ctx->all_rel_info.map = hashmap_new_size ((size_t) num_q)))
+	return (UNDEF);
+    ctx->all_rel_info.num_q_rels = num_q;
+    ctx->all_rel_info.max_num_q_rels = num_q + 1;
+
+    /* Docids of a query number its distinct docnos, in docno order */
+    num_q = 0;
+    for (start = 0; start < ctx->num_qrels; start = i) {
+	for (i = start;
+	     i < ctx->num_qrels &&
+		 0 == strcmp (ctx->sort_qrels[i].qid,
+			      ctx->sort_qrels[start].qid);
+	     i++) {
+	    ctx->text_qrels[i].docno = ctx->sort_qrels[i].docno;
+	    ctx->text_qrels[i].rel = ctx->sort_qrels[i].rel;
+	    if (i > start && 0 == strcmp (ctx->sort_qrels[i].docno,
+					  ctx->sort_qrels[i-1].docno))
+		ctx->text_qrels[i].docid = ctx->text_qrels[i-1].docid;
+	    else
+		ctx->text_qrels[i].docid = i - start;
+	}
+	text_qrels_info = &ctx->text_qrels_info[num_q];
+	text_qrels_info->num_text_qrels = i - start;
+	text_qrels_info->max_num_text_qrels = i - start;
+	text_qrels_info->text_qrels = &ctx->text_qrels[start];
+	rel_info = &ctx->all_rel_info.rel_info[num_q];
+	rel_info->qid = ctx->sort_qrels[start].qid;
+	rel_info->rel_format = "qrels";
+	rel_info->q_rel_info = text_qrels_info;
+	if (MAP_OK != hashmap_put (ctx->all_rel_info.map, rel_info->qid,
+				   rel_info))
+	    return (UNDEF);
+	num_q++;
+    }
+
+    /* The strings stay, but the loading forms are no longer needed */
+    Free (ctx->sort_qrels);
+    ctx->sort_qrels = NULL;
+    if (ctx->max_qrels > 0) {
+	Free (ctx->qrels);
+	ctx->max_qrels = 0;
+	ctx->num_qrels = 0;
+    }
+    return (1);
+}
+
+/* Append NULL terminated str to the strings of ctx, returning its
+   offset */
+static long
+add_string (TE_CTX *ctx, const char *str)
+{
+    long len = strlen (str) + 1;
+    long offset = ctx->num_strings;
+
+    if (NULL == (ctx->strings =
+		 te_chk_and_realloc (ctx->strings, &ctx->max_strings,
+				     ctx->num_strings + len, sizeof (char))))
+	return (UNDEF);
+    (void) memcpy (ctx->strings + offset, str, (size_t) len);
+    ctx->num_strings += len;
+    return (offset);
+}
+
+/* Docid of the docno span among the judgements (sorted by docno) of a
+   query, or DOCID_NONPOOL if it was not judged */
+static long
+find_docid (const TEXT_QRELS_INFO *trec_qrels, const char *docno,
+	    const long docno_len)
+{
+    long lo = 0;
+    long hi = trec_qrels->num_text_qrels;
+    long mid;
+    int cmp;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	cmp = te_docno_strcmp (trec_qrels->text_qrels[mid].docno,
+			       docno, docno_len);
+	if (cmp == 0)
+	    return (trec_qrels->text_qrels[mid].docid);
+	if (cmp < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return (DOCID_NONPOOL);
+}
+
+/* Forget the intermediate forms cached for the last query (whose qid the
+   next ranking evaluated may share), keeping their space */
+static void
+reset_forms ()
+{
+    long i;
+
+    for (i = 0; i < te_num_form_inter_procs; i++)
+	(void) te_form_inter_procs[i].reset ();
+}
+
+/* Free the space of the intermediate forms (of this thread) */
+static void
+cleanup_forms ()
+{
+    long i;
+
+    for (i = 0; i < te_num_form_inter_procs; i++)
+	(void) te_form_inter_procs[i].cleanup ();
+}
+
+static int
+comp_qrel (ptr1, ptr2)
+SORT_QREL *ptr1;
+SORT_QREL *ptr2;
+{
+    int cmp = strcmp (ptr1->qid, ptr2->qid);
+    if (cmp)
+	return (cmp);
+    return (strcmp (ptr1->docno, ptr2->docno));
+}
@@ -10,20 +10,32 @@
 /* ---------------------------------------------------------------------- */
 /* Format specific definitions for file input for results and rel_info */
 /* trec_results - pointed to by results->q_results */
+/* docid of a retrieved docno that does not occur in the rel_info file */
+#define DOCID_NONPOOL -1
+
 typedef struct {                /* For each retrieved document result */
-    char *docno;                /* document id */
+    char *docno;                /* document id.  Not NULL terminated; points
+				   into the read-only results file buffer */
+    long docno_len;             /* length of docno */
+    long docid;                 /* interned docid of docno (see docno.c), or
+				   DOCID_NONPOOL */
     double sim;                  /* score */
 } TEXT_RESULTS;
 
 typedef struct {                    /* For each query in retrieved results */
     long num_text_results;           /* number results for query*/
     long max_num_text_results;       /* number results space reserved for */
-    TEXT_RESULTS *text_results;     /* Array of TEXT_RESULTS results */
+    TEXT_RESULTS *text_results;     /* Array of TEXT_RESULTS results.
+				       In input order */
+    long rank_ordered;              /* If set, text_results are known to be
+				       in rank order (decreasing sim, ties
+				       by decreasing docno) */
 } TEXT_RESULTS_INFO;
 
 /* qrels pointed to by rel_info->q_rel_info */
 typedef struct {                    /* For each relevance judgement */
     char *docno;                       /* document id */
+    long docid;                        /* interned docid of docno */
     long rel;                          /* document judgement */
 } TEXT_QRELS;
 
@@ -92,6 +104,78 @@ typedef struct {
 			      length of list is rank_rel->num_ret */
 } RES_RELS;
 
+/* Statistics of the ranked relevance list of RES_RELS, from which the
+   rank-based measures (map, P, recall, Rprec, recip_rank, bpref, infAP,
+   success, iprec_at_recall, ...) are calculated directly.  All are derived
+   in a single pass over results_rel_list by te_form_rank_stats.
+   A doc is relevant if its value is >= epi->relevance_level.  With a
+   negative relevance_level, that includes nonpool (and unjudged) docs,
+   which num_rel_ret never counts; num_rel_ranked then exceeds num_rel_ret.
+   As historically, interpolated precision then counts relevant docs down
+   from num_rel_ret at the last one (see int_prec) */
+typedef struct {
+    RES_RELS res_rels;
+    long num_rel_ranked;   /* Number of retrieved docs that are relevant
+			      (num_rel_ret if relevance_level >= 0) */
+    long *rel_so_far;      /* rel_so_far[i] is the number of relevant docs
+			      in the top i retrieved (0 through num_ret) */
+    long first_rel_rank;   /* Rank (starting at 1) of the first relevant
+			      retrieved doc, 0 if none */
+    double *sum_prec;      /* sum_prec[j] is the sum of the precisions at
+			      the first j relevant retrieved docs
+			      (0 through num_rel_ranked) */
+    double *int_prec;      /* int_prec[j] is the interpolated precision
+			      (max precision at that rank or below) at the
+			      jth relevant retrieved doc (1 through
+			      num_rel_ret).  int_prec[0] is int_prec[1], or
+			      num_rel_ret / num_ret if there is none.
+			      If num_rel_ranked > num_rel_ret, the jth doc
+			      is the (j + num_rel_ranked - num_rel_ret)th,
+			      and precisions are taken with num_rel_ranked -
+			      num_rel_ret fewer relevant docs */
+    double bpref;          /* bpref summed over relevant retrieved docs */
+    double inf_ap;         /* infAP summed over relevant retrieved docs */
+} RANK_STATS;
+
+/* The RES_RELS of a query under the relevance level gains of a measure of
+   the ndcg family, with the ideal ranking of the judged docs under those
+   gains and the dcg of both it and the retrieved ranking.  Formed by
+   te_form_gains (see form_gains.c) */
+typedef struct {
+    RES_RELS res_rels;
+    double *level_gain;    /* level_gain[rel] is the gain of a doc with
+			      relevance rel, for rel from RELVALUE_UNJUDGED
+			      through num_gain_levels-1.  Higher levels have
+			      gain rel.  Use TE_GAIN */
+    long num_gain_levels;
+    long num_ideal;        /* Number of judged docs with positive gain, the
+			      length of the ideal ranking */
+    long *ideal_rel;       /* ideal_rel[i] is the relevance of the doc at
+			      rank i+1 of the ideal ranking (by decreasing
+			      gain) (0 through num_ideal-1) */
+    double *ideal_gain;    /* ideal_gain[i] is the gain of that doc */
+    double *ideal_dcg;     /* ideal_dcg[i] is the dcg of the top i docs of
+			      the ideal ranking (0 through num_ideal) */
+    double *results_dcg;   /* results_dcg[i] is the dcg of the top i
+			      retrieved docs (0 through num_ret) */
+    double *log2_rank;     /* log2_rank[i] is log2(i+2), the discount of
+			      rank i+1 (0 through MAX (num_ret, num_ideal)) */
+} GAINS;
+
+#define TE_GAIN(gains,rel) ((rel) < (gains)->num_gain_levels ? \
+			    (gains)->level_gain[rel] : (double) (rel))
+
+/* Relevance level and gain of the doc at rank i+1 of the ideal ranking,
+   as printed by the debug output of the ndcg measures.  Past the end of
+   the ideal ranking that is level 0 with gain 0.0 (or the highest judged
+   level, if none has a positive gain) */
+#define TE_IDEAL_LEVEL(gains,i) ((i) < (gains)->num_ideal ? \
+				 (gains)->ideal_rel[i] : \
+				 (gains)->num_ideal > 0 ? 0 : \
+				 (gains)->res_rels.num_rel_levels - 1)
+#define TE_IDEAL_GAIN(gains,i) ((i) < (gains)->num_ideal ? \
+				(gains)->ideal_gain[i] : 0.0)
+
 /* If Judgments group info is included (qrels_jg), then return multiple jgs */
 typedef struct {
     char *qid;
@@ -117,11 +201,12 @@ typedef struct {
                                    docid_rank numbers. */
 } EC;
 
-/* Preference array.  A square array, num_judgments * num_judgments, where
-   pref_array[i][j] is 1 iff doc with docid_rank i is preferred to doc with 
-   docid_rank j.
-   could use bitstring to save more space, but at present not worth the
-   added complexity.
+/* Preference array.  A square bit array, num_judgments * num_judgments,
+   where bit j of row i is 1 iff doc with docid_rank i is preferred to doc
+   with docid_rank j.  Rows are packed into num_words 64 bit words each, bit
+   j being bit j % 64 of word j / 64 (bits past num_judged are 0).  Use
+   PA_TEST and PA_SET for single bits; whole words can be or'd together or
+   have their bits counted.
    Given preference array PA there are five areas of importance, divided
    by lines i == NJR (where NJR is num_judged_ret), j == NJR, and i == j
                        NJR
@@ -145,17 +230,35 @@ typedef struct {
     Area A5 is both i and j not retrieved.
 */
 typedef struct {
-    unsigned char *full_array;
-    unsigned char **array;
+    uint64_t *full_array;
+    uint64_t **array;
     unsigned long num_judged;
+    unsigned long num_words;    /* Number of words in each row */
 } PREFS_ARRAY;
-/* Counts array.  A summary square array, num_judgments * num_judgments, where
-   counts_array[i][j] gives the number of JGs preferring i to j as above.
-   Note number of JGs countaining the same docno must be bounded by
-   MAX_SHORT */
+#define PA_WORD_BITS 64
+#define PA_NUM_WORDS(num_judged) (((num_judged) + PA_WORD_BITS - 1) / \
+				  PA_WORD_BITS)
+#define PA_TEST(pa,i,j) (((pa)->array[i][(j) / PA_WORD_BITS] >> \
+			  ((j) % PA_WORD_BITS)) & 1)
+#define PA_SET(pa,i,j) ((pa)->array[i][(j) / PA_WORD_BITS] |= \
+			(uint64_t) 1 << ((j) % PA_WORD_BITS))
+
+/* Counts array.  A sparse summary of the num_judgments * num_judgments
+   counts, where count[i][j] gives the number of JGs preferring i to j as
+   above.  Only pairs of docs with a preference in some JG are present,
+   one entry per pair with docid_rank1 < docid_rank2, sorted by
+   docid_rank1 then docid_rank2.  A confirmation is a count > 1, a conflict
+   is an entry with both counts non-zero. */
 typedef struct {
-    unsigned short *full_array;
-    unsigned short **array;
+    unsigned int docid_rank1;
+    unsigned int docid_rank2;
+    unsigned int count12;       /* Num JGs preferring docid_rank1 to 2 */
+    unsigned int count21;       /* Num JGs preferring docid_rank2 to 1 */
+} PAIR_COUNTS;
+
+typedef struct {
+    PAIR_COUNTS *pairs;
+    long num_pairs;
     unsigned long num_judged;
 } COUNTS_ARRAY;
 
@@ -171,7 +274,7 @@ typedef struct {
     long num_ecs;           /* num_ecs == 0 means prefs_array being used for
 			       preference info rather than EC */
 
-    PREFS_ARRAY prefs_array;    /* prefs_array[i][j] is 1 iff doc with docid_rank i
+    PREFS_ARRAY prefs_array;    /* Bit j of row i is 1 iff doc with docid_rank i
                                    is preferred to doc with docid_rank j.
                                    Size num_judged * num_judged where
                                    num_judged is the same for all JGs and is the
@@ -217,7 +320,7 @@ typedef struct {
    directly give information about conflicts or multiple representations
    of a preference (as when docno_i and docno_j both appear in multiple JGs).
 
-   The second is an array of counts, size num_judged ** 2.
+   The second is a (sparse) array of counts, conceptually size num_judged ** 2.
    pref_counts[i,j] gives the number of times docno_i is preferred to docno_j in
    judged preferences.  If i < j, then it is a preference fulfilled,
    if i > j, then a preference was not fulfilled.  This structure gives
@@ -229,8 +332,9 @@ typedef struct {
     JG *jgs;
     long num_judged;                    /* Num docs mentioned in trec_prefs */
     long num_judged_ret;                /* number of those docs retrieved */
-    COUNTS_ARRAY pref_counts;           /* Array size num_judged**2  where
-					   counts_array[i][j] gives num of
+    COUNTS_ARRAY pref_counts;           /* Sparse counts where count[i][j]
+					   (empty unless formed by
+					   form_prefs_pair_counts) gives num of
 					   JG with doc i preferred to doc j
 					   (i and j are internal ids, sorted
 					   by retrieval rank then docno) */
@@ -246,6 +350,14 @@ typedef struct {
 int te_form_res_rels (const EPI *epi, const REL_INFO *rel_info,
                       const RESULTS *results, RES_RELS *res_rels);
 
+/* trec_results and qrels to RANK_STATS */
+int te_form_rank_stats (const EPI *epi, const REL_INFO *rel_info,
+			const RESULTS *results, RANK_STATS *rank_stats);
+
+/* trec_results and qrels to GAINS under the gains of measure tm */
+int te_form_gains (const EPI *epi, const REL_INFO *rel_info,
+		   const RESULTS *results, const TREC_MEAS *tm, GAINS *gains);
+
 /* trec_results and qrels to RES_RELS */
 int te_form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
 			 const RESULTS *results, RES_RELS_JG *res_rels);
@@ -253,6 +365,10 @@ int te_form_res_rels_jg (const EPI *epi, const REL_INFO *rel_info,
 /* trec_results and prefs (or qrels_prefs) to RESULT_PREFS */
 int form_prefs_counts (const EPI *epi, const REL_INFO *rel_info,
                        const RESULTS *results, RESULTS_PREFS *results_prefs);
+/* As form_prefs_counts, also forming RESULT_PREFS pref_counts */
+int form_prefs_pair_counts (const EPI *epi, const REL_INFO *rel_info,
+			    const RESULTS *results,
+			    RESULTS_PREFS *results_prefs);
 
 
 
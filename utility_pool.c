@@ -53,3 +53,21 @@ te_chk_and_realloc (void *ptr, long *current_bound,
     *current_bound += needed;
     return ((void *) realloc (ptr, *current_bound * size));
 }
+
+#if ! defined(__GNUC__)
+/* Portable versions of the bit counting builtins (see sysfunc.h) */
+int
+te_popcount64 (uint64_t w)
+{
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return ((int) ((w * 0x0101010101010101ULL) >> 56));
+}
+
+int
+te_ctz64 (uint64_t w)
+{
+    return (te_popcount64 ((w & (0 - w)) - 1));
+}
+#endif